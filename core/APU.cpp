@@ -165,14 +165,12 @@ APU::~APU() {
 }
 
 void APU::reset() {
-    if (cpu->headless) return;
-    blip_delete(left_buffer);
-    blip_delete(right_buffer);
-    left_buffer = blip_new(16383);
-    right_buffer = blip_new(16383);
-    u32 srcRate = cpu->doubleSpeedMode ? 2097152*2 : 2097152;
-    blip_set_rates(left_buffer, srcRate, 44100);
-    blip_set_rates(right_buffer, srcRate, 44100);
+    clock = cpu->scheduler.now;
+    if (isRunning()) {
+        blip_clear(left_buffer);
+        blip_clear(right_buffer);
+        setRates();
+    }
 
     audioBuffer.clear();
     for (auto& c : channels)
@@ -181,11 +179,38 @@ void APU::reset() {
     ch4.lsfr = 0xFF;
 }
 
-void APU::update(u32 cycles) {
-    if (cpu->headless) return;
-    //if (cpu->doubleSpeedMode) cycles /= 2;
-    u32 mCycles = cycles / 4;
-    bool dividerCycle = isBitSet(cpu->mmu.IO[0x04], 4 + (cpu->doubleSpeedMode ? 1 : 0));
+// picks up at the current cycle, nothing is generated for the time the APU was stopped
+void APU::start(u8 divider) {
+    clock = cpu->scheduler.now;
+    lastCounter = isBitSet(divider, 4 + (cpu->doubleSpeedMode ? 1 : 0));
+    if (isRunning()) return;
+    left_buffer = blip_new(16383);
+    right_buffer = blip_new(16383);
+    setRates();
+}
+
+void APU::stop() {
+    blip_delete(left_buffer);
+    blip_delete(right_buffer);
+    left_buffer = right_buffer = nullptr;
+    audioBuffer = std::vector<short>();
+}
+
+void APU::setRates() {
+    u32 srcRate = cpu->doubleSpeedMode ? 2097152*2 : 2097152;
+    blip_set_rates(left_buffer, srcRate, 44100);
+    blip_set_rates(right_buffer, srcRate, 44100);
+}
+
+// generates the samples between the last update and timestamp
+void APU::catchUp(u64 timestamp) {
+    if (timestamp > clock) update(timestamp - clock);
+    clock = timestamp;
+}
+
+// the frame sequencer steps when the divider bit falls, called by the scheduler whenever it changes
+void APU::clockFrameSequencer(u8 divider) {
+    bool dividerCycle = isBitSet(divider, 4 + (cpu->doubleSpeedMode ? 1 : 0));
     if (lastCounter && !dividerCycle) {
         frame = (frame + 1) & 0x7;
         for (auto& channel : channels) {
@@ -193,6 +218,11 @@ void APU::update(u32 cycles) {
         }
     }
     lastCounter = dividerCycle;
+}
+
+void APU::update(u32 cycles) {
+    //if (cpu->doubleSpeedMode) cycles /= 2;
+    u32 mCycles = cycles / 4;
     for (size_t i = 0; i < mCycles * 2; i++) {
         if (++sample == 0) {
             blip_end_frame(left_buffer, 0xFF);
@@ -221,6 +251,11 @@ void APU::update(u32 cycles) {
 }
 
 void APU::readSamples() {
+    if (!isRunning()) {
+        audioBuffer.clear();
+        return;
+    }
+    catchUp(cpu->scheduler.now);
     int size = blip_samples_avail(right_buffer);
     audioBuffer.resize(size * 2);
     blip_read_samples(left_buffer, audioBuffer.data(), size, true);
@@ -98,14 +98,24 @@ public:
     APU(CPU* cpu);
     ~APU();
     void update(u32 cycles);
+    void catchUp(u64 timestamp);
+    void clockFrameSequencer(u8 divider);
     void readSamples();
 
     void reset();
+    // the APU only runs while the CPU ticks with an audio policy, it holds sample buffers while it does
+    void start(u8 divider);
+    void stop();
+    bool isRunning() const { return left_buffer != nullptr; }
 private:
+    void setRates();
+
     CPU* cpu;
 
     bool lastCounter = false;
     u8 sample = 0;
+    // master clock up to which samples have been generated
+    u64 clock = 0;
     u8 frame = 0;
 
     blip_t *left_buffer, *right_buffer;
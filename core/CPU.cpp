@@ -1,7 +1,11 @@
+#include <cstring>
+
 #include "CPU.hpp"
+#include "Opcodes.hpp"
 
 CPU::CPU():
     r(0, 0, 0, 0, 0, 0, 0),
+    mmu(arena),
     gpu(this, &mmu),
     joypad(this),
     apu(this),
@@ -10,448 +14,467 @@ CPU::CPU():
     ticksPerFrame(70224),
     halted(false),
     timerCounter(1024),
-    dividerCounter(0),
     headless(false),
     runCGBinDMGMode(false),
     doubleSpeedMode(false),
+    cachedInterpreter(false),
+    jitEnabled(false),
+    memoryLoopDetection(true),
+    idleLoopDetection(true),
+    idleCyclesSkipped(0),
     isExecutingInstruction(false),
-    partialTicks(0)
+    partialTicks(0),
+    stepStart(0),
+    delayedOverflow(false),
+    ramCodePages((WRAM_BANK_SIZE * 8 + ZRAM_SIZE + 0xFF) / 256, 0),
+    currentBlock(nullptr),
+    operands(nullptr),
+    blockCycles(0),
+    blockVBlank(false),
+    fastBlock(false),
+    lazyFlags {},
+    loopHead(0),
+    loopEnd(0),
+    loopKey(0),
+    idleLoopBackoff(0),
+    idleLoopCooldown(0),
+    recompiledBlock {}
     {
     mmu.cpu = this;
     mmu.gpu = &gpu;
-
-    byteRegisterMap[0x0] = &r.b;
-    byteRegisterMap[0x1] = &r.c;
-    byteRegisterMap[0x2] = &r.d;
-    byteRegisterMap[0x3] = &r.e;
-    byteRegisterMap[0x4] = &r.h;
-    byteRegisterMap[0x5] = &r.l;
-    byteRegisterMap[0x6] = &r.f;
-    byteRegisterMap[0x7] = &r.a;
-
-    shortRegisterMap[0x0] = &r.bc;
-    shortRegisterMap[0x1] = &r.de;
-    shortRegisterMap[0x2] = &r.hl;
-    shortRegisterMap[0x3] = &r.sp;
-
-    // Z80 Instructions //
-
-    instructions[0x06] = &CPU::LD_r_n;
-    instructions[0x0E] = &CPU::LD_r_n;
-    instructions[0x16] = &CPU::LD_r_n;
-    instructions[0x1E] = &CPU::LD_r_n;
-    instructions[0x26] = &CPU::LD_r_n;
-    instructions[0x2E] = &CPU::LD_r_n;
-    instructions[0x3E] = &CPU::LD_r_n;
-
-    instructions[0x7F] = &CPU::LD_r_r;
-    instructions[0x78] = &CPU::LD_r_r;
-    instructions[0x79] = &CPU::LD_r_r;
-    instructions[0x7A] = &CPU::LD_r_r;
-    instructions[0x7B] = &CPU::LD_r_r;
-    instructions[0x7C] = &CPU::LD_r_r;
-    instructions[0x7D] = &CPU::LD_r_r;
-    instructions[0x40] = &CPU::LD_r_r;
-    instructions[0x41] = &CPU::LD_r_r;
-    instructions[0x42] = &CPU::LD_r_r;
-    instructions[0x43] = &CPU::LD_r_r;
-    instructions[0x44] = &CPU::LD_r_r;
-    instructions[0x45] = &CPU::LD_r_r;
-    instructions[0x48] = &CPU::LD_r_r;
-    instructions[0x49] = &CPU::LD_r_r;
-    instructions[0x4A] = &CPU::LD_r_r;
-    instructions[0x4B] = &CPU::LD_r_r;
-    instructions[0x4C] = &CPU::LD_r_r;
-    instructions[0x4D] = &CPU::LD_r_r;
-    instructions[0x50] = &CPU::LD_r_r;
-    instructions[0x51] = &CPU::LD_r_r;
-    instructions[0x52] = &CPU::LD_r_r;
-    instructions[0x53] = &CPU::LD_r_r;
-    instructions[0x54] = &CPU::LD_r_r;
-    instructions[0x55] = &CPU::LD_r_r;
-    instructions[0x58] = &CPU::LD_r_r;
-    instructions[0x59] = &CPU::LD_r_r;
-    instructions[0x5A] = &CPU::LD_r_r;
-    instructions[0x5B] = &CPU::LD_r_r;
-    instructions[0x5C] = &CPU::LD_r_r;
-    instructions[0x5D] = &CPU::LD_r_r;
-    instructions[0x60] = &CPU::LD_r_r;
-    instructions[0x61] = &CPU::LD_r_r;
-    instructions[0x62] = &CPU::LD_r_r;
-    instructions[0x63] = &CPU::LD_r_r;
-    instructions[0x64] = &CPU::LD_r_r;
-    instructions[0x65] = &CPU::LD_r_r;
-    instructions[0x68] = &CPU::LD_r_r;
-    instructions[0x69] = &CPU::LD_r_r;
-    instructions[0x6A] = &CPU::LD_r_r;
-    instructions[0x6B] = &CPU::LD_r_r;
-    instructions[0x6C] = &CPU::LD_r_r;
-    instructions[0x6D] = &CPU::LD_r_r;
-    instructions[0x47] = &CPU::LD_r_r;
-    instructions[0x4F] = &CPU::LD_r_r;
-    instructions[0x57] = &CPU::LD_r_r;
-    instructions[0x5F] = &CPU::LD_r_r;
-    instructions[0x67] = &CPU::LD_r_r;
-    instructions[0x6F] = &CPU::LD_r_r;
-
-    instructions[0x7E] = &CPU::LD_r_HL;
-    instructions[0x46] = &CPU::LD_r_HL;
-    instructions[0x4E] = &CPU::LD_r_HL;
-    instructions[0x56] = &CPU::LD_r_HL;
-    instructions[0x5E] = &CPU::LD_r_HL;
-    instructions[0x66] = &CPU::LD_r_HL;
-    instructions[0x6E] = &CPU::LD_r_HL;
-
-    instructions[0x70] = &CPU::LD_HL_r;
-    instructions[0x71] = &CPU::LD_HL_r;
-    instructions[0x72] = &CPU::LD_HL_r;
-    instructions[0x73] = &CPU::LD_HL_r;
-    instructions[0x74] = &CPU::LD_HL_r;
-    instructions[0x75] = &CPU::LD_HL_r;
-    instructions[0x77] = &CPU::LD_HL_r;
-
-    instructions[0x36] = &CPU::LD_HL_n;
-    instructions[0x0A] = &CPU::LD_A_BC;
-    instructions[0x1A] = &CPU::LD_A_DE;
-    instructions[0xFA] = &CPU::LD_A_nn;
-    instructions[0x02] = &CPU::LD_BC_A;
-    instructions[0x12] = &CPU::LD_DE_A;
-    instructions[0xEA] = &CPU::LD_nn_A;
-    instructions[0xF2] = &CPU::LD_A_Cff00;
-    instructions[0xE2] = &CPU::LD_Cff00_A;
-    instructions[0x3A] = &CPU::LDD_A_HL;
-    instructions[0x32] = &CPU::LDD_HL_A;
-    instructions[0x2A] = &CPU::LDI_A_HL;
-    instructions[0x22] = &CPU::LDI_HL_A;
-    instructions[0xE0] = &CPU::LD_nff00_A;
-    instructions[0xF0] = &CPU::LD_A_nff00;
-
-    instructions[0x01] = &CPU::LD_r2_nn;
-    instructions[0x11] = &CPU::LD_r2_nn;
-    instructions[0x21] = &CPU::LD_r2_nn;
-    instructions[0x31] = &CPU::LD_r2_nn;
-
-    instructions[0xF9] = &CPU::LD_SP_HL;
-    instructions[0xF8] = &CPU::LD_HL_SPn;
-    instructions[0x08] = &CPU::LD_nn_SP;
-
-    instructions[0xF5] = &CPU::PUSH_r2;
-    instructions[0xC5] = &CPU::PUSH_r2;
-    instructions[0xD5] = &CPU::PUSH_r2;
-    instructions[0xE5] = &CPU::PUSH_r2;
-    instructions[0xF1] = &CPU::POP_r2;
-    instructions[0xC1] = &CPU::POP_r2;
-    instructions[0xD1] = &CPU::POP_r2;
-    instructions[0xE1] = &CPU::POP_r2;
-
-    instructions[0x87] = &CPU::ADD_A_r;
-    instructions[0x80] = &CPU::ADD_A_r;
-    instructions[0x81] = &CPU::ADD_A_r;
-    instructions[0x82] = &CPU::ADD_A_r;
-    instructions[0x83] = &CPU::ADD_A_r;
-    instructions[0x84] = &CPU::ADD_A_r;
-    instructions[0x85] = &CPU::ADD_A_r;
-    instructions[0x86] = &CPU::ADD_A_HL;
-    instructions[0xC6] = &CPU::ADD_A_n;
-
-    instructions[0x8F] = &CPU::ADC_A_r;
-    instructions[0x88] = &CPU::ADC_A_r;
-    instructions[0x89] = &CPU::ADC_A_r;
-    instructions[0x8A] = &CPU::ADC_A_r;
-    instructions[0x8B] = &CPU::ADC_A_r;
-    instructions[0x8C] = &CPU::ADC_A_r;
-    instructions[0x8D] = &CPU::ADC_A_r;
-    instructions[0x8E] = &CPU::ADC_A_HL;
-    instructions[0xCE] = &CPU::ADC_A_n;
-
-    instructions[0x97] = &CPU::SUB_A_r;
-    instructions[0x90] = &CPU::SUB_A_r;
-    instructions[0x91] = &CPU::SUB_A_r;
-    instructions[0x92] = &CPU::SUB_A_r;
-    instructions[0x93] = &CPU::SUB_A_r;
-    instructions[0x94] = &CPU::SUB_A_r;
-    instructions[0x95] = &CPU::SUB_A_r;
-    instructions[0x96] = &CPU::SUB_A_HL;
-    instructions[0xD6] = &CPU::SUB_A_n;
-
-    instructions[0x9F] = &CPU::SBC_A_r;
-    instructions[0x98] = &CPU::SBC_A_r;
-    instructions[0x99] = &CPU::SBC_A_r;
-    instructions[0x9A] = &CPU::SBC_A_r;
-    instructions[0x9B] = &CPU::SBC_A_r;
-    instructions[0x9C] = &CPU::SBC_A_r;
-    instructions[0x9D] = &CPU::SBC_A_r;
-    instructions[0x9E] = &CPU::SBC_A_HL;
-    instructions[0xDE] = &CPU::SBC_A_n;
-
-    instructions[0xA7] = &CPU::AND_A_r;
-    instructions[0xA0] = &CPU::AND_A_r;
-    instructions[0xA1] = &CPU::AND_A_r;
-    instructions[0xA2] = &CPU::AND_A_r;
-    instructions[0xA3] = &CPU::AND_A_r;
-    instructions[0xA4] = &CPU::AND_A_r;
-    instructions[0xA5] = &CPU::AND_A_r;
-    instructions[0xA6] = &CPU::AND_A_HL;
-    instructions[0xE6] = &CPU::AND_A_n;
-
-    instructions[0xB7] = &CPU::OR_A_r;
-    instructions[0xB0] = &CPU::OR_A_r;
-    instructions[0xB1] = &CPU::OR_A_r;
-    instructions[0xB2] = &CPU::OR_A_r;
-    instructions[0xB3] = &CPU::OR_A_r;
-    instructions[0xB4] = &CPU::OR_A_r;
-    instructions[0xB5] = &CPU::OR_A_r;
-    instructions[0xB6] = &CPU::OR_A_HL;
-    instructions[0xF6] = &CPU::OR_A_n;
-
-    instructions[0xAF] = &CPU::XOR_A_r;
-    instructions[0xA8] = &CPU::XOR_A_r;
-    instructions[0xA9] = &CPU::XOR_A_r;
-    instructions[0xAA] = &CPU::XOR_A_r;
-    instructions[0xAB] = &CPU::XOR_A_r;
-    instructions[0xAC] = &CPU::XOR_A_r;
-    instructions[0xAD] = &CPU::XOR_A_r;
-    instructions[0xAE] = &CPU::XOR_A_HL;
-    instructions[0xEE] = &CPU::XOR_A_n;
-
-    instructions[0xBF] = &CPU::CP_A_r;
-    instructions[0xB8] = &CPU::CP_A_r;
-    instructions[0xB9] = &CPU::CP_A_r;
-    instructions[0xBA] = &CPU::CP_A_r;
-    instructions[0xBB] = &CPU::CP_A_r;
-    instructions[0xBC] = &CPU::CP_A_r;
-    instructions[0xBD] = &CPU::CP_A_r;
-    instructions[0xBE] = &CPU::CP_A_HL;
-    instructions[0xFE] = &CPU::CP_A_n;
-
-    instructions[0x3C] = &CPU::INC_r;
-    instructions[0x04] = &CPU::INC_r;
-    instructions[0x0C] = &CPU::INC_r;
-    instructions[0x14] = &CPU::INC_r;
-    instructions[0x1C] = &CPU::INC_r;
-    instructions[0x24] = &CPU::INC_r;
-    instructions[0x2C] = &CPU::INC_r;
-    instructions[0x34] = &CPU::INC_HL;
-
-    instructions[0x3D] = &CPU::DEC_r;
-    instructions[0x05] = &CPU::DEC_r;
-    instructions[0x0D] = &CPU::DEC_r;
-    instructions[0x15] = &CPU::DEC_r;
-    instructions[0x1D] = &CPU::DEC_r;
-    instructions[0x25] = &CPU::DEC_r;
-    instructions[0x2D] = &CPU::DEC_r;
-    instructions[0x35] = &CPU::DEC_HL;
-
-    instructions[0x09] = &CPU::ADD_HL_r2;
-    instructions[0x19] = &CPU::ADD_HL_r2;
-    instructions[0x29] = &CPU::ADD_HL_r2;
-    instructions[0x39] = &CPU::ADD_HL_r2;
-    instructions[0xE8] = &CPU::ADD_SP_sn;
-    instructions[0x03] = &CPU::INC_r2;
-    instructions[0x13] = &CPU::INC_r2;
-    instructions[0x23] = &CPU::INC_r2;
-    instructions[0x33] = &CPU::INC_r2;
-    instructions[0x0B] = &CPU::DEC_r2;
-    instructions[0x1B] = &CPU::DEC_r2;
-    instructions[0x2B] = &CPU::DEC_r2;
-    instructions[0x3B] = &CPU::DEC_r2;
-
-    instructions[0x27] = &CPU::DAA;
-    instructions[0x2F] = &CPU::CPL;
-    instructions[0x3F] = &CPU::CCF;
-    instructions[0x37] = &CPU::SCF;
-    instructions[0x00] = &CPU::NOP;
-    instructions[0x76] = &CPU::HALT;
-    instructions[0x10] = &CPU::STOP;
-    instructions[0xF3] = &CPU::DI;
-    instructions[0xFB] = &CPU::EI;
-
-    instructions[0x07] = &CPU::RLCA;
-    instructions[0x17] = &CPU::RLA;
-    instructions[0x0F] = &CPU::RRCA;
-    instructions[0x1F] = &CPU::RRA;
-
-    instructions[0xC3] = &CPU::JP_nn;
-    instructions[0xC2] = &CPU::JP_cc_nn;
-    instructions[0xCA] = &CPU::JP_cc_nn;
-    instructions[0xD2] = &CPU::JP_cc_nn;
-    instructions[0xDA] = &CPU::JP_cc_nn;
-    instructions[0xE9] = &CPU::JP_HL;
-    instructions[0x18] = &CPU::JR_sn;
-    instructions[0x20] = &CPU::JR_cc_sn;
-    instructions[0x28] = &CPU::JR_cc_sn;
-    instructions[0x30] = &CPU::JR_cc_sn;
-    instructions[0x38] = &CPU::JR_cc_sn;
-
-    instructions[0xCD] = &CPU::CALL_nn;
-    instructions[0xC4] = &CPU::CALL_cc_nn;
-    instructions[0xCC] = &CPU::CALL_cc_nn;
-    instructions[0xD4] = &CPU::CALL_cc_nn;
-    instructions[0xDC] = &CPU::CALL_cc_nn;
-
-    instructions[0xC7] = &CPU::RST_n;
-    instructions[0xCF] = &CPU::RST_n;
-    instructions[0xD7] = &CPU::RST_n;
-    instructions[0xDF] = &CPU::RST_n;
-    instructions[0xE7] = &CPU::RST_n;
-    instructions[0xEF] = &CPU::RST_n;
-    instructions[0xF7] = &CPU::RST_n;
-    instructions[0xFF] = &CPU::RST_n;
-    instructions[0xC9] = &CPU::RET;
-    instructions[0xC0] = &CPU::RET_cc;
-    instructions[0xC8] = &CPU::RET_cc;
-    instructions[0xD0] = &CPU::RET_cc;
-    instructions[0xD8] = &CPU::RET_cc;
-    instructions[0xD9] = &CPU::RETI;
-
-    // CB Instructions //
-
-    instructionsCB[0x07] = &CPU::RLC_r;     instructionsCB[0x17] = &CPU::RL_r;
-    instructionsCB[0x00] = &CPU::RLC_r;     instructionsCB[0x10] = &CPU::RL_r;
-    instructionsCB[0x01] = &CPU::RLC_r;     instructionsCB[0x11] = &CPU::RL_r;
-    instructionsCB[0x02] = &CPU::RLC_r;     instructionsCB[0x12] = &CPU::RL_r;
-    instructionsCB[0x03] = &CPU::RLC_r;     instructionsCB[0x13] = &CPU::RL_r;
-    instructionsCB[0x04] = &CPU::RLC_r;     instructionsCB[0x14] = &CPU::RL_r;
-    instructionsCB[0x05] = &CPU::RLC_r;     instructionsCB[0x15] = &CPU::RL_r;
-    instructionsCB[0x06] = &CPU::RLC_HL;    instructionsCB[0x16] = &CPU::RL_HL;
-
-    instructionsCB[0x0F] = &CPU::RRC_r;     instructionsCB[0x1F] = &CPU::RR_r;
-    instructionsCB[0x08] = &CPU::RRC_r;     instructionsCB[0x18] = &CPU::RR_r;
-    instructionsCB[0x09] = &CPU::RRC_r;     instructionsCB[0x19] = &CPU::RR_r;
-    instructionsCB[0x0A] = &CPU::RRC_r;     instructionsCB[0x1A] = &CPU::RR_r;
-    instructionsCB[0x0B] = &CPU::RRC_r;     instructionsCB[0x1B] = &CPU::RR_r;
-    instructionsCB[0x0C] = &CPU::RRC_r;     instructionsCB[0x1C] = &CPU::RR_r;
-    instructionsCB[0x0D] = &CPU::RRC_r;     instructionsCB[0x1D] = &CPU::RR_r;
-    instructionsCB[0x0E] = &CPU::RRC_HL;    instructionsCB[0x1E] = &CPU::RR_HL;
-
-    instructionsCB[0x27] = &CPU::SLA_r;     instructionsCB[0x2F] = &CPU::SRA_r;
-    instructionsCB[0x20] = &CPU::SLA_r;     instructionsCB[0x28] = &CPU::SRA_r;
-    instructionsCB[0x21] = &CPU::SLA_r;     instructionsCB[0x29] = &CPU::SRA_r;
-    instructionsCB[0x22] = &CPU::SLA_r;     instructionsCB[0x2A] = &CPU::SRA_r;
-    instructionsCB[0x23] = &CPU::SLA_r;     instructionsCB[0x2B] = &CPU::SRA_r;
-    instructionsCB[0x24] = &CPU::SLA_r;     instructionsCB[0x2C] = &CPU::SRA_r;
-    instructionsCB[0x25] = &CPU::SLA_r;     instructionsCB[0x2D] = &CPU::SRA_r;
-    instructionsCB[0x26] = &CPU::SLA_HL;    instructionsCB[0x2E] = &CPU::SRA_HL;
-
-    instructionsCB[0x3F] = &CPU::SRL_r;     instructionsCB[0x37] = &CPU::SWAP_r;
-    instructionsCB[0x38] = &CPU::SRL_r;     instructionsCB[0x30] = &CPU::SWAP_r;
-    instructionsCB[0x39] = &CPU::SRL_r;     instructionsCB[0x31] = &CPU::SWAP_r;
-    instructionsCB[0x3A] = &CPU::SRL_r;     instructionsCB[0x32] = &CPU::SWAP_r;
-    instructionsCB[0x3B] = &CPU::SRL_r;     instructionsCB[0x33] = &CPU::SWAP_r;
-    instructionsCB[0x3C] = &CPU::SRL_r;     instructionsCB[0x34] = &CPU::SWAP_r;
-    instructionsCB[0x3D] = &CPU::SRL_r;     instructionsCB[0x35] = &CPU::SWAP_r;
-    instructionsCB[0x3E] = &CPU::SRL_HL;    instructionsCB[0x36] = &CPU::SWAP_HL;
-
-    instructionsCB[0x40] = &CPU::BIT_b_r;   instructionsCB[0x50] = &CPU::BIT_b_r;
-    instructionsCB[0x41] = &CPU::BIT_b_r;   instructionsCB[0x51] = &CPU::BIT_b_r;
-    instructionsCB[0x42] = &CPU::BIT_b_r;   instructionsCB[0x52] = &CPU::BIT_b_r;
-    instructionsCB[0x43] = &CPU::BIT_b_r;   instructionsCB[0x53] = &CPU::BIT_b_r;
-    instructionsCB[0x44] = &CPU::BIT_b_r;   instructionsCB[0x54] = &CPU::BIT_b_r;
-    instructionsCB[0x45] = &CPU::BIT_b_r;   instructionsCB[0x55] = &CPU::BIT_b_r;
-    instructionsCB[0x46] = &CPU::BIT_b_HL;  instructionsCB[0x56] = &CPU::BIT_b_HL;
-    instructionsCB[0x47] = &CPU::BIT_b_r;   instructionsCB[0x57] = &CPU::BIT_b_r;
-    instructionsCB[0x48] = &CPU::BIT_b_r;   instructionsCB[0x58] = &CPU::BIT_b_r;
-    instructionsCB[0x49] = &CPU::BIT_b_r;   instructionsCB[0x59] = &CPU::BIT_b_r;
-    instructionsCB[0x4A] = &CPU::BIT_b_r;   instructionsCB[0x5A] = &CPU::BIT_b_r;
-    instructionsCB[0x4B] = &CPU::BIT_b_r;   instructionsCB[0x5B] = &CPU::BIT_b_r;
-    instructionsCB[0x4C] = &CPU::BIT_b_r;   instructionsCB[0x5C] = &CPU::BIT_b_r;
-    instructionsCB[0x4D] = &CPU::BIT_b_r;   instructionsCB[0x5D] = &CPU::BIT_b_r;
-    instructionsCB[0x4E] = &CPU::BIT_b_HL;  instructionsCB[0x5E] = &CPU::BIT_b_HL;
-    instructionsCB[0x4F] = &CPU::BIT_b_r;   instructionsCB[0x5F] = &CPU::BIT_b_r;
-
-    instructionsCB[0x60] = &CPU::BIT_b_r;   instructionsCB[0x70] = &CPU::BIT_b_r;
-    instructionsCB[0x61] = &CPU::BIT_b_r;   instructionsCB[0x71] = &CPU::BIT_b_r;
-    instructionsCB[0x62] = &CPU::BIT_b_r;   instructionsCB[0x72] = &CPU::BIT_b_r;
-    instructionsCB[0x63] = &CPU::BIT_b_r;   instructionsCB[0x73] = &CPU::BIT_b_r;
-    instructionsCB[0x64] = &CPU::BIT_b_r;   instructionsCB[0x74] = &CPU::BIT_b_r;
-    instructionsCB[0x65] = &CPU::BIT_b_r;   instructionsCB[0x75] = &CPU::BIT_b_r;
-    instructionsCB[0x66] = &CPU::BIT_b_HL;  instructionsCB[0x76] = &CPU::BIT_b_HL;
-    instructionsCB[0x67] = &CPU::BIT_b_r;   instructionsCB[0x77] = &CPU::BIT_b_r;
-    instructionsCB[0x68] = &CPU::BIT_b_r;   instructionsCB[0x78] = &CPU::BIT_b_r;
-    instructionsCB[0x69] = &CPU::BIT_b_r;   instructionsCB[0x79] = &CPU::BIT_b_r;
-    instructionsCB[0x6A] = &CPU::BIT_b_r;   instructionsCB[0x7A] = &CPU::BIT_b_r;
-    instructionsCB[0x6B] = &CPU::BIT_b_r;   instructionsCB[0x7B] = &CPU::BIT_b_r;
-    instructionsCB[0x6C] = &CPU::BIT_b_r;   instructionsCB[0x7C] = &CPU::BIT_b_r;
-    instructionsCB[0x6D] = &CPU::BIT_b_r;   instructionsCB[0x7D] = &CPU::BIT_b_r;
-    instructionsCB[0x6E] = &CPU::BIT_b_HL;  instructionsCB[0x7E] = &CPU::BIT_b_HL;
-    instructionsCB[0x6F] = &CPU::BIT_b_r;   instructionsCB[0x7F] = &CPU::BIT_b_r;
-
-    instructionsCB[0xC0] = &CPU::SET_b_r;   instructionsCB[0xD0] = &CPU::SET_b_r;
-    instructionsCB[0xC1] = &CPU::SET_b_r;   instructionsCB[0xD1] = &CPU::SET_b_r;
-    instructionsCB[0xC2] = &CPU::SET_b_r;   instructionsCB[0xD2] = &CPU::SET_b_r;
-    instructionsCB[0xC3] = &CPU::SET_b_r;   instructionsCB[0xD3] = &CPU::SET_b_r;
-    instructionsCB[0xC4] = &CPU::SET_b_r;   instructionsCB[0xD4] = &CPU::SET_b_r;
-    instructionsCB[0xC5] = &CPU::SET_b_r;   instructionsCB[0xD5] = &CPU::SET_b_r;
-    instructionsCB[0xC6] = &CPU::SET_b_HL;  instructionsCB[0xD6] = &CPU::SET_b_HL;
-    instructionsCB[0xC7] = &CPU::SET_b_r;   instructionsCB[0xD7] = &CPU::SET_b_r;
-    instructionsCB[0xC8] = &CPU::SET_b_r;   instructionsCB[0xD8] = &CPU::SET_b_r;
-    instructionsCB[0xC9] = &CPU::SET_b_r;   instructionsCB[0xD9] = &CPU::SET_b_r;
-    instructionsCB[0xCA] = &CPU::SET_b_r;   instructionsCB[0xDA] = &CPU::SET_b_r;
-    instructionsCB[0xCB] = &CPU::SET_b_r;   instructionsCB[0xDB] = &CPU::SET_b_r;
-    instructionsCB[0xCC] = &CPU::SET_b_r;   instructionsCB[0xDC] = &CPU::SET_b_r;
-    instructionsCB[0xCD] = &CPU::SET_b_r;   instructionsCB[0xDD] = &CPU::SET_b_r;
-    instructionsCB[0xCE] = &CPU::SET_b_HL;  instructionsCB[0xDE] = &CPU::SET_b_HL;
-    instructionsCB[0xCF] = &CPU::SET_b_r;   instructionsCB[0xDF] = &CPU::SET_b_r;
-
-    instructionsCB[0xE0] = &CPU::SET_b_r;   instructionsCB[0xF0] = &CPU::SET_b_r;
-    instructionsCB[0xE1] = &CPU::SET_b_r;   instructionsCB[0xF1] = &CPU::SET_b_r;
-    instructionsCB[0xE2] = &CPU::SET_b_r;   instructionsCB[0xF2] = &CPU::SET_b_r;
-    instructionsCB[0xE3] = &CPU::SET_b_r;   instructionsCB[0xF3] = &CPU::SET_b_r;
-    instructionsCB[0xE4] = &CPU::SET_b_r;   instructionsCB[0xF4] = &CPU::SET_b_r;
-    instructionsCB[0xE5] = &CPU::SET_b_r;   instructionsCB[0xF5] = &CPU::SET_b_r;
-    instructionsCB[0xE6] = &CPU::SET_b_HL;  instructionsCB[0xF6] = &CPU::SET_b_HL;
-    instructionsCB[0xE7] = &CPU::SET_b_r;   instructionsCB[0xF7] = &CPU::SET_b_r;
-    instructionsCB[0xE8] = &CPU::SET_b_r;   instructionsCB[0xF8] = &CPU::SET_b_r;
-    instructionsCB[0xE9] = &CPU::SET_b_r;   instructionsCB[0xF9] = &CPU::SET_b_r;
-    instructionsCB[0xEA] = &CPU::SET_b_r;   instructionsCB[0xFA] = &CPU::SET_b_r;
-    instructionsCB[0xEB] = &CPU::SET_b_r;   instructionsCB[0xFB] = &CPU::SET_b_r;
-    instructionsCB[0xEC] = &CPU::SET_b_r;   instructionsCB[0xFC] = &CPU::SET_b_r;
-    instructionsCB[0xED] = &CPU::SET_b_r;   instructionsCB[0xFD] = &CPU::SET_b_r;
-    instructionsCB[0xEE] = &CPU::SET_b_HL;  instructionsCB[0xFE] = &CPU::SET_b_HL;
-    instructionsCB[0xEF] = &CPU::SET_b_r;   instructionsCB[0xFF] = &CPU::SET_b_r;
-
-    instructionsCB[0x80] = &CPU::RES_b_r;   instructionsCB[0x90] = &CPU::RES_b_r;
-    instructionsCB[0x81] = &CPU::RES_b_r;   instructionsCB[0x91] = &CPU::RES_b_r;
-    instructionsCB[0x82] = &CPU::RES_b_r;   instructionsCB[0x92] = &CPU::RES_b_r;
-    instructionsCB[0x83] = &CPU::RES_b_r;   instructionsCB[0x93] = &CPU::RES_b_r;
-    instructionsCB[0x84] = &CPU::RES_b_r;   instructionsCB[0x94] = &CPU::RES_b_r;
-    instructionsCB[0x85] = &CPU::RES_b_r;   instructionsCB[0x95] = &CPU::RES_b_r;
-    instructionsCB[0x86] = &CPU::RES_b_HL;  instructionsCB[0x96] = &CPU::RES_b_HL;
-    instructionsCB[0x87] = &CPU::RES_b_r;   instructionsCB[0x97] = &CPU::RES_b_r;
-    instructionsCB[0x88] = &CPU::RES_b_r;   instructionsCB[0x98] = &CPU::RES_b_r;
-    instructionsCB[0x89] = &CPU::RES_b_r;   instructionsCB[0x99] = &CPU::RES_b_r;
-    instructionsCB[0x8A] = &CPU::RES_b_r;   instructionsCB[0x9A] = &CPU::RES_b_r;
-    instructionsCB[0x8B] = &CPU::RES_b_r;   instructionsCB[0x9B] = &CPU::RES_b_r;
-    instructionsCB[0x8C] = &CPU::RES_b_r;   instructionsCB[0x9C] = &CPU::RES_b_r;
-    instructionsCB[0x8D] = &CPU::RES_b_r;   instructionsCB[0x9D] = &CPU::RES_b_r;
-    instructionsCB[0x8E] = &CPU::RES_b_HL;  instructionsCB[0x9E] = &CPU::RES_b_HL;
-    instructionsCB[0x8F] = &CPU::RES_b_r;   instructionsCB[0x9F] = &CPU::RES_b_r;
-
-    instructionsCB[0xA0] = &CPU::RES_b_r;   instructionsCB[0xB0] = &CPU::RES_b_r;
-    instructionsCB[0xA1] = &CPU::RES_b_r;   instructionsCB[0xB1] = &CPU::RES_b_r;
-    instructionsCB[0xA2] = &CPU::RES_b_r;   instructionsCB[0xB2] = &CPU::RES_b_r;
-    instructionsCB[0xA3] = &CPU::RES_b_r;   instructionsCB[0xB3] = &CPU::RES_b_r;
-    instructionsCB[0xA4] = &CPU::RES_b_r;   instructionsCB[0xB4] = &CPU::RES_b_r;
-    instructionsCB[0xA5] = &CPU::RES_b_r;   instructionsCB[0xB5] = &CPU::RES_b_r;
-    instructionsCB[0xA6] = &CPU::RES_b_HL;  instructionsCB[0xB6] = &CPU::RES_b_HL;
-    instructionsCB[0xA7] = &CPU::RES_b_r;   instructionsCB[0xB7] = &CPU::RES_b_r;
-    instructionsCB[0xA8] = &CPU::RES_b_r;   instructionsCB[0xB8] = &CPU::RES_b_r;
-    instructionsCB[0xA9] = &CPU::RES_b_r;   instructionsCB[0xB9] = &CPU::RES_b_r;
-    instructionsCB[0xAA] = &CPU::RES_b_r;   instructionsCB[0xBA] = &CPU::RES_b_r;
-    instructionsCB[0xAB] = &CPU::RES_b_r;   instructionsCB[0xBB] = &CPU::RES_b_r;
-    instructionsCB[0xAC] = &CPU::RES_b_r;   instructionsCB[0xBC] = &CPU::RES_b_r;
-    instructionsCB[0xAD] = &CPU::RES_b_r;   instructionsCB[0xBD] = &CPU::RES_b_r;
-    instructionsCB[0xAE] = &CPU::RES_b_HL;  instructionsCB[0xBE] = &CPU::RES_b_HL;
-    instructionsCB[0xAF] = &CPU::RES_b_r;   instructionsCB[0xBF] = &CPU::RES_b_r;
-
 }
 
+// the decode tables are built at compile time and indexed with the opcode
+
+constexpr CPU::InstructionTable CPU::buildInstructionTable() {
+    InstructionTable t {};
+
+    t[0x06] = &CPU::LD_r_n<REG_B>;
+    t[0x0E] = &CPU::LD_r_n<REG_C>;
+    t[0x16] = &CPU::LD_r_n<REG_D>;
+    t[0x1E] = &CPU::LD_r_n<REG_E>;
+    t[0x26] = &CPU::LD_r_n<REG_H>;
+    t[0x2E] = &CPU::LD_r_n<REG_L>;
+    t[0x3E] = &CPU::LD_r_n<REG_A>;
+
+    t[0x7F] = &CPU::LD_r_r<REG_A, REG_A>;
+    t[0x78] = &CPU::LD_r_r<REG_A, REG_B>;
+    t[0x79] = &CPU::LD_r_r<REG_A, REG_C>;
+    t[0x7A] = &CPU::LD_r_r<REG_A, REG_D>;
+    t[0x7B] = &CPU::LD_r_r<REG_A, REG_E>;
+    t[0x7C] = &CPU::LD_r_r<REG_A, REG_H>;
+    t[0x7D] = &CPU::LD_r_r<REG_A, REG_L>;
+    t[0x40] = &CPU::LD_r_r<REG_B, REG_B>;
+    t[0x41] = &CPU::LD_r_r<REG_B, REG_C>;
+    t[0x42] = &CPU::LD_r_r<REG_B, REG_D>;
+    t[0x43] = &CPU::LD_r_r<REG_B, REG_E>;
+    t[0x44] = &CPU::LD_r_r<REG_B, REG_H>;
+    t[0x45] = &CPU::LD_r_r<REG_B, REG_L>;
+    t[0x48] = &CPU::LD_r_r<REG_C, REG_B>;
+    t[0x49] = &CPU::LD_r_r<REG_C, REG_C>;
+    t[0x4A] = &CPU::LD_r_r<REG_C, REG_D>;
+    t[0x4B] = &CPU::LD_r_r<REG_C, REG_E>;
+    t[0x4C] = &CPU::LD_r_r<REG_C, REG_H>;
+    t[0x4D] = &CPU::LD_r_r<REG_C, REG_L>;
+    t[0x50] = &CPU::LD_r_r<REG_D, REG_B>;
+    t[0x51] = &CPU::LD_r_r<REG_D, REG_C>;
+    t[0x52] = &CPU::LD_r_r<REG_D, REG_D>;
+    t[0x53] = &CPU::LD_r_r<REG_D, REG_E>;
+    t[0x54] = &CPU::LD_r_r<REG_D, REG_H>;
+    t[0x55] = &CPU::LD_r_r<REG_D, REG_L>;
+    t[0x58] = &CPU::LD_r_r<REG_E, REG_B>;
+    t[0x59] = &CPU::LD_r_r<REG_E, REG_C>;
+    t[0x5A] = &CPU::LD_r_r<REG_E, REG_D>;
+    t[0x5B] = &CPU::LD_r_r<REG_E, REG_E>;
+    t[0x5C] = &CPU::LD_r_r<REG_E, REG_H>;
+    t[0x5D] = &CPU::LD_r_r<REG_E, REG_L>;
+    t[0x60] = &CPU::LD_r_r<REG_H, REG_B>;
+    t[0x61] = &CPU::LD_r_r<REG_H, REG_C>;
+    t[0x62] = &CPU::LD_r_r<REG_H, REG_D>;
+    t[0x63] = &CPU::LD_r_r<REG_H, REG_E>;
+    t[0x64] = &CPU::LD_r_r<REG_H, REG_H>;
+    t[0x65] = &CPU::LD_r_r<REG_H, REG_L>;
+    t[0x68] = &CPU::LD_r_r<REG_L, REG_B>;
+    t[0x69] = &CPU::LD_r_r<REG_L, REG_C>;
+    t[0x6A] = &CPU::LD_r_r<REG_L, REG_D>;
+    t[0x6B] = &CPU::LD_r_r<REG_L, REG_E>;
+    t[0x6C] = &CPU::LD_r_r<REG_L, REG_H>;
+    t[0x6D] = &CPU::LD_r_r<REG_L, REG_L>;
+    t[0x47] = &CPU::LD_r_r<REG_B, REG_A>;
+    t[0x4F] = &CPU::LD_r_r<REG_C, REG_A>;
+    t[0x57] = &CPU::LD_r_r<REG_D, REG_A>;
+    t[0x5F] = &CPU::LD_r_r<REG_E, REG_A>;
+    t[0x67] = &CPU::LD_r_r<REG_H, REG_A>;
+    t[0x6F] = &CPU::LD_r_r<REG_L, REG_A>;
+
+    t[0x7E] = &CPU::LD_r_HL<REG_A>;
+    t[0x46] = &CPU::LD_r_HL<REG_B>;
+    t[0x4E] = &CPU::LD_r_HL<REG_C>;
+    t[0x56] = &CPU::LD_r_HL<REG_D>;
+    t[0x5E] = &CPU::LD_r_HL<REG_E>;
+    t[0x66] = &CPU::LD_r_HL<REG_H>;
+    t[0x6E] = &CPU::LD_r_HL<REG_L>;
+
+    t[0x70] = &CPU::LD_HL_r<REG_B>;
+    t[0x71] = &CPU::LD_HL_r<REG_C>;
+    t[0x72] = &CPU::LD_HL_r<REG_D>;
+    t[0x73] = &CPU::LD_HL_r<REG_E>;
+    t[0x74] = &CPU::LD_HL_r<REG_H>;
+    t[0x75] = &CPU::LD_HL_r<REG_L>;
+    t[0x77] = &CPU::LD_HL_r<REG_A>;
+
+    t[0x36] = &CPU::LD_HL_n;
+    t[0x0A] = &CPU::LD_A_BC;
+    t[0x1A] = &CPU::LD_A_DE;
+    t[0xFA] = &CPU::LD_A_nn;
+    t[0x02] = &CPU::LD_BC_A;
+    t[0x12] = &CPU::LD_DE_A;
+    t[0xEA] = &CPU::LD_nn_A;
+    t[0xF2] = &CPU::LD_A_Cff00;
+    t[0xE2] = &CPU::LD_Cff00_A;
+    t[0x3A] = &CPU::LDD_A_HL;
+    t[0x32] = &CPU::LDD_HL_A;
+    t[0x2A] = &CPU::LDI_A_HL;
+    t[0x22] = &CPU::LDI_HL_A;
+    t[0xE0] = &CPU::LD_nff00_A;
+    t[0xF0] = &CPU::LD_A_nff00;
+
+    t[0x01] = &CPU::LD_r2_nn<REG_BC>;
+    t[0x11] = &CPU::LD_r2_nn<REG_DE>;
+    t[0x21] = &CPU::LD_r2_nn<REG_HL>;
+    t[0x31] = &CPU::LD_r2_nn<REG_SP>;
+
+    t[0xF9] = &CPU::LD_SP_HL;
+    t[0xF8] = &CPU::LD_HL_SPn;
+    t[0x08] = &CPU::LD_nn_SP;
+
+    t[0xF5] = &CPU::PUSH_r2<REG_AF>;
+    t[0xC5] = &CPU::PUSH_r2<REG_BC>;
+    t[0xD5] = &CPU::PUSH_r2<REG_DE>;
+    t[0xE5] = &CPU::PUSH_r2<REG_HL>;
+    t[0xF1] = &CPU::POP_r2<REG_AF>;
+    t[0xC1] = &CPU::POP_r2<REG_BC>;
+    t[0xD1] = &CPU::POP_r2<REG_DE>;
+    t[0xE1] = &CPU::POP_r2<REG_HL>;
+
+    t[0x87] = &CPU::ADD_A_r<REG_A>;
+    t[0x80] = &CPU::ADD_A_r<REG_B>;
+    t[0x81] = &CPU::ADD_A_r<REG_C>;
+    t[0x82] = &CPU::ADD_A_r<REG_D>;
+    t[0x83] = &CPU::ADD_A_r<REG_E>;
+    t[0x84] = &CPU::ADD_A_r<REG_H>;
+    t[0x85] = &CPU::ADD_A_r<REG_L>;
+    t[0x86] = &CPU::ADD_A_HL;
+    t[0xC6] = &CPU::ADD_A_n;
+
+    t[0x8F] = &CPU::ADC_A_r<REG_A>;
+    t[0x88] = &CPU::ADC_A_r<REG_B>;
+    t[0x89] = &CPU::ADC_A_r<REG_C>;
+    t[0x8A] = &CPU::ADC_A_r<REG_D>;
+    t[0x8B] = &CPU::ADC_A_r<REG_E>;
+    t[0x8C] = &CPU::ADC_A_r<REG_H>;
+    t[0x8D] = &CPU::ADC_A_r<REG_L>;
+    t[0x8E] = &CPU::ADC_A_HL;
+    t[0xCE] = &CPU::ADC_A_n;
+
+    t[0x97] = &CPU::SUB_A_r<REG_A>;
+    t[0x90] = &CPU::SUB_A_r<REG_B>;
+    t[0x91] = &CPU::SUB_A_r<REG_C>;
+    t[0x92] = &CPU::SUB_A_r<REG_D>;
+    t[0x93] = &CPU::SUB_A_r<REG_E>;
+    t[0x94] = &CPU::SUB_A_r<REG_H>;
+    t[0x95] = &CPU::SUB_A_r<REG_L>;
+    t[0x96] = &CPU::SUB_A_HL;
+    t[0xD6] = &CPU::SUB_A_n;
+
+    t[0x9F] = &CPU::SBC_A_r<REG_A>;
+    t[0x98] = &CPU::SBC_A_r<REG_B>;
+    t[0x99] = &CPU::SBC_A_r<REG_C>;
+    t[0x9A] = &CPU::SBC_A_r<REG_D>;
+    t[0x9B] = &CPU::SBC_A_r<REG_E>;
+    t[0x9C] = &CPU::SBC_A_r<REG_H>;
+    t[0x9D] = &CPU::SBC_A_r<REG_L>;
+    t[0x9E] = &CPU::SBC_A_HL;
+    t[0xDE] = &CPU::SBC_A_n;
+
+    t[0xA7] = &CPU::AND_A_r<REG_A>;
+    t[0xA0] = &CPU::AND_A_r<REG_B>;
+    t[0xA1] = &CPU::AND_A_r<REG_C>;
+    t[0xA2] = &CPU::AND_A_r<REG_D>;
+    t[0xA3] = &CPU::AND_A_r<REG_E>;
+    t[0xA4] = &CPU::AND_A_r<REG_H>;
+    t[0xA5] = &CPU::AND_A_r<REG_L>;
+    t[0xA6] = &CPU::AND_A_HL;
+    t[0xE6] = &CPU::AND_A_n;
+
+    t[0xB7] = &CPU::OR_A_r<REG_A>;
+    t[0xB0] = &CPU::OR_A_r<REG_B>;
+    t[0xB1] = &CPU::OR_A_r<REG_C>;
+    t[0xB2] = &CPU::OR_A_r<REG_D>;
+    t[0xB3] = &CPU::OR_A_r<REG_E>;
+    t[0xB4] = &CPU::OR_A_r<REG_H>;
+    t[0xB5] = &CPU::OR_A_r<REG_L>;
+    t[0xB6] = &CPU::OR_A_HL;
+    t[0xF6] = &CPU::OR_A_n;
+
+    t[0xAF] = &CPU::XOR_A_r<REG_A>;
+    t[0xA8] = &CPU::XOR_A_r<REG_B>;
+    t[0xA9] = &CPU::XOR_A_r<REG_C>;
+    t[0xAA] = &CPU::XOR_A_r<REG_D>;
+    t[0xAB] = &CPU::XOR_A_r<REG_E>;
+    t[0xAC] = &CPU::XOR_A_r<REG_H>;
+    t[0xAD] = &CPU::XOR_A_r<REG_L>;
+    t[0xAE] = &CPU::XOR_A_HL;
+    t[0xEE] = &CPU::XOR_A_n;
+
+    t[0xBF] = &CPU::CP_A_r<REG_A>;
+    t[0xB8] = &CPU::CP_A_r<REG_B>;
+    t[0xB9] = &CPU::CP_A_r<REG_C>;
+    t[0xBA] = &CPU::CP_A_r<REG_D>;
+    t[0xBB] = &CPU::CP_A_r<REG_E>;
+    t[0xBC] = &CPU::CP_A_r<REG_H>;
+    t[0xBD] = &CPU::CP_A_r<REG_L>;
+    t[0xBE] = &CPU::CP_A_HL;
+    t[0xFE] = &CPU::CP_A_n;
+
+    t[0x3C] = &CPU::INC_r<REG_A>;
+    t[0x04] = &CPU::INC_r<REG_B>;
+    t[0x0C] = &CPU::INC_r<REG_C>;
+    t[0x14] = &CPU::INC_r<REG_D>;
+    t[0x1C] = &CPU::INC_r<REG_E>;
+    t[0x24] = &CPU::INC_r<REG_H>;
+    t[0x2C] = &CPU::INC_r<REG_L>;
+    t[0x34] = &CPU::INC_HL;
+
+    t[0x3D] = &CPU::DEC_r<REG_A>;
+    t[0x05] = &CPU::DEC_r<REG_B>;
+    t[0x0D] = &CPU::DEC_r<REG_C>;
+    t[0x15] = &CPU::DEC_r<REG_D>;
+    t[0x1D] = &CPU::DEC_r<REG_E>;
+    t[0x25] = &CPU::DEC_r<REG_H>;
+    t[0x2D] = &CPU::DEC_r<REG_L>;
+    t[0x35] = &CPU::DEC_HL;
+
+    t[0x09] = &CPU::ADD_HL_r2<REG_BC>;
+    t[0x19] = &CPU::ADD_HL_r2<REG_DE>;
+    t[0x29] = &CPU::ADD_HL_r2<REG_HL>;
+    t[0x39] = &CPU::ADD_HL_r2<REG_SP>;
+    t[0xE8] = &CPU::ADD_SP_sn;
+    t[0x03] = &CPU::INC_r2<REG_BC>;
+    t[0x13] = &CPU::INC_r2<REG_DE>;
+    t[0x23] = &CPU::INC_r2<REG_HL>;
+    t[0x33] = &CPU::INC_r2<REG_SP>;
+    t[0x0B] = &CPU::DEC_r2<REG_BC>;
+    t[0x1B] = &CPU::DEC_r2<REG_DE>;
+    t[0x2B] = &CPU::DEC_r2<REG_HL>;
+    t[0x3B] = &CPU::DEC_r2<REG_SP>;
+
+    t[0x27] = &CPU::DAA;
+    t[0x2F] = &CPU::CPL;
+    t[0x3F] = &CPU::CCF;
+    t[0x37] = &CPU::SCF;
+    t[0x00] = &CPU::NOP;
+    t[0x76] = &CPU::HALT;
+    t[0x10] = &CPU::STOP;
+    t[0xF3] = &CPU::DI;
+    t[0xFB] = &CPU::EI;
+
+    t[0x07] = &CPU::RLCA;
+    t[0x17] = &CPU::RLA;
+    t[0x0F] = &CPU::RRCA;
+    t[0x1F] = &CPU::RRA;
+
+    t[0xC3] = &CPU::JP_nn;
+    t[0xC2] = &CPU::JP_cc_nn<COND_NZ>;
+    t[0xCA] = &CPU::JP_cc_nn<COND_Z>;
+    t[0xD2] = &CPU::JP_cc_nn<COND_NC>;
+    t[0xDA] = &CPU::JP_cc_nn<COND_C>;
+    t[0xE9] = &CPU::JP_HL;
+    t[0x18] = &CPU::JR_sn;
+    t[0x20] = &CPU::JR_cc_sn<COND_NZ>;
+    t[0x28] = &CPU::JR_cc_sn<COND_Z>;
+    t[0x30] = &CPU::JR_cc_sn<COND_NC>;
+    t[0x38] = &CPU::JR_cc_sn<COND_C>;
+
+    t[0xCD] = &CPU::CALL_nn;
+    t[0xC4] = &CPU::CALL_cc_nn<COND_NZ>;
+    t[0xCC] = &CPU::CALL_cc_nn<COND_Z>;
+    t[0xD4] = &CPU::CALL_cc_nn<COND_NC>;
+    t[0xDC] = &CPU::CALL_cc_nn<COND_C>;
+
+    t[0xC7] = &CPU::RST_n<0x00>;
+    t[0xCF] = &CPU::RST_n<0x08>;
+    t[0xD7] = &CPU::RST_n<0x10>;
+    t[0xDF] = &CPU::RST_n<0x18>;
+    t[0xE7] = &CPU::RST_n<0x20>;
+    t[0xEF] = &CPU::RST_n<0x28>;
+    t[0xF7] = &CPU::RST_n<0x30>;
+    t[0xFF] = &CPU::RST_n<0x38>;
+    t[0xC9] = &CPU::RET;
+    t[0xC0] = &CPU::RET_cc<COND_NZ>;
+    t[0xC8] = &CPU::RET_cc<COND_Z>;
+    t[0xD0] = &CPU::RET_cc<COND_NC>;
+    t[0xD8] = &CPU::RET_cc<COND_C>;
+    t[0xD9] = &CPU::RETI;
+
+    return t;
+}
+
+constexpr CPU::InstructionTable CPU::buildInstructionTableCB() {
+    InstructionTable t {};
+
+    t[0x07] = &CPU::RLC_r<REG_A>;         t[0x17] = &CPU::RL_r<REG_A>;
+    t[0x00] = &CPU::RLC_r<REG_B>;         t[0x10] = &CPU::RL_r<REG_B>;
+    t[0x01] = &CPU::RLC_r<REG_C>;         t[0x11] = &CPU::RL_r<REG_C>;
+    t[0x02] = &CPU::RLC_r<REG_D>;         t[0x12] = &CPU::RL_r<REG_D>;
+    t[0x03] = &CPU::RLC_r<REG_E>;         t[0x13] = &CPU::RL_r<REG_E>;
+    t[0x04] = &CPU::RLC_r<REG_H>;         t[0x14] = &CPU::RL_r<REG_H>;
+    t[0x05] = &CPU::RLC_r<REG_L>;         t[0x15] = &CPU::RL_r<REG_L>;
+    t[0x06] = &CPU::RLC_HL;               t[0x16] = &CPU::RL_HL;
+
+    t[0x0F] = &CPU::RRC_r<REG_A>;         t[0x1F] = &CPU::RR_r<REG_A>;
+    t[0x08] = &CPU::RRC_r<REG_B>;         t[0x18] = &CPU::RR_r<REG_B>;
+    t[0x09] = &CPU::RRC_r<REG_C>;         t[0x19] = &CPU::RR_r<REG_C>;
+    t[0x0A] = &CPU::RRC_r<REG_D>;         t[0x1A] = &CPU::RR_r<REG_D>;
+    t[0x0B] = &CPU::RRC_r<REG_E>;         t[0x1B] = &CPU::RR_r<REG_E>;
+    t[0x0C] = &CPU::RRC_r<REG_H>;         t[0x1C] = &CPU::RR_r<REG_H>;
+    t[0x0D] = &CPU::RRC_r<REG_L>;         t[0x1D] = &CPU::RR_r<REG_L>;
+    t[0x0E] = &CPU::RRC_HL;               t[0x1E] = &CPU::RR_HL;
+
+    t[0x27] = &CPU::SLA_r<REG_A>;         t[0x2F] = &CPU::SRA_r<REG_A>;
+    t[0x20] = &CPU::SLA_r<REG_B>;         t[0x28] = &CPU::SRA_r<REG_B>;
+    t[0x21] = &CPU::SLA_r<REG_C>;         t[0x29] = &CPU::SRA_r<REG_C>;
+    t[0x22] = &CPU::SLA_r<REG_D>;         t[0x2A] = &CPU::SRA_r<REG_D>;
+    t[0x23] = &CPU::SLA_r<REG_E>;         t[0x2B] = &CPU::SRA_r<REG_E>;
+    t[0x24] = &CPU::SLA_r<REG_H>;         t[0x2C] = &CPU::SRA_r<REG_H>;
+    t[0x25] = &CPU::SLA_r<REG_L>;         t[0x2D] = &CPU::SRA_r<REG_L>;
+    t[0x26] = &CPU::SLA_HL;               t[0x2E] = &CPU::SRA_HL;
+
+    t[0x3F] = &CPU::SRL_r<REG_A>;         t[0x37] = &CPU::SWAP_r<REG_A>;
+    t[0x38] = &CPU::SRL_r<REG_B>;         t[0x30] = &CPU::SWAP_r<REG_B>;
+    t[0x39] = &CPU::SRL_r<REG_C>;         t[0x31] = &CPU::SWAP_r<REG_C>;
+    t[0x3A] = &CPU::SRL_r<REG_D>;         t[0x32] = &CPU::SWAP_r<REG_D>;
+    t[0x3B] = &CPU::SRL_r<REG_E>;         t[0x33] = &CPU::SWAP_r<REG_E>;
+    t[0x3C] = &CPU::SRL_r<REG_H>;         t[0x34] = &CPU::SWAP_r<REG_H>;
+    t[0x3D] = &CPU::SRL_r<REG_L>;         t[0x35] = &CPU::SWAP_r<REG_L>;
+    t[0x3E] = &CPU::SRL_HL;               t[0x36] = &CPU::SWAP_HL;
+
+    t[0x40] = &CPU::BIT_b_r<0, REG_B>;    t[0x50] = &CPU::BIT_b_r<2, REG_B>;
+    t[0x41] = &CPU::BIT_b_r<0, REG_C>;    t[0x51] = &CPU::BIT_b_r<2, REG_C>;
+    t[0x42] = &CPU::BIT_b_r<0, REG_D>;    t[0x52] = &CPU::BIT_b_r<2, REG_D>;
+    t[0x43] = &CPU::BIT_b_r<0, REG_E>;    t[0x53] = &CPU::BIT_b_r<2, REG_E>;
+    t[0x44] = &CPU::BIT_b_r<0, REG_H>;    t[0x54] = &CPU::BIT_b_r<2, REG_H>;
+    t[0x45] = &CPU::BIT_b_r<0, REG_L>;    t[0x55] = &CPU::BIT_b_r<2, REG_L>;
+    t[0x46] = &CPU::BIT_b_HL<0>;          t[0x56] = &CPU::BIT_b_HL<2>;
+    t[0x47] = &CPU::BIT_b_r<0, REG_A>;    t[0x57] = &CPU::BIT_b_r<2, REG_A>;
+    t[0x48] = &CPU::BIT_b_r<1, REG_B>;    t[0x58] = &CPU::BIT_b_r<3, REG_B>;
+    t[0x49] = &CPU::BIT_b_r<1, REG_C>;    t[0x59] = &CPU::BIT_b_r<3, REG_C>;
+    t[0x4A] = &CPU::BIT_b_r<1, REG_D>;    t[0x5A] = &CPU::BIT_b_r<3, REG_D>;
+    t[0x4B] = &CPU::BIT_b_r<1, REG_E>;    t[0x5B] = &CPU::BIT_b_r<3, REG_E>;
+    t[0x4C] = &CPU::BIT_b_r<1, REG_H>;    t[0x5C] = &CPU::BIT_b_r<3, REG_H>;
+    t[0x4D] = &CPU::BIT_b_r<1, REG_L>;    t[0x5D] = &CPU::BIT_b_r<3, REG_L>;
+    t[0x4E] = &CPU::BIT_b_HL<1>;          t[0x5E] = &CPU::BIT_b_HL<3>;
+    t[0x4F] = &CPU::BIT_b_r<1, REG_A>;    t[0x5F] = &CPU::BIT_b_r<3, REG_A>;
+
+    t[0x60] = &CPU::BIT_b_r<4, REG_B>;    t[0x70] = &CPU::BIT_b_r<6, REG_B>;
+    t[0x61] = &CPU::BIT_b_r<4, REG_C>;    t[0x71] = &CPU::BIT_b_r<6, REG_C>;
+    t[0x62] = &CPU::BIT_b_r<4, REG_D>;    t[0x72] = &CPU::BIT_b_r<6, REG_D>;
+    t[0x63] = &CPU::BIT_b_r<4, REG_E>;    t[0x73] = &CPU::BIT_b_r<6, REG_E>;
+    t[0x64] = &CPU::BIT_b_r<4, REG_H>;    t[0x74] = &CPU::BIT_b_r<6, REG_H>;
+    t[0x65] = &CPU::BIT_b_r<4, REG_L>;    t[0x75] = &CPU::BIT_b_r<6, REG_L>;
+    t[0x66] = &CPU::BIT_b_HL<4>;          t[0x76] = &CPU::BIT_b_HL<6>;
+    t[0x67] = &CPU::BIT_b_r<4, REG_A>;    t[0x77] = &CPU::BIT_b_r<6, REG_A>;
+    t[0x68] = &CPU::BIT_b_r<5, REG_B>;    t[0x78] = &CPU::BIT_b_r<7, REG_B>;
+    t[0x69] = &CPU::BIT_b_r<5, REG_C>;    t[0x79] = &CPU::BIT_b_r<7, REG_C>;
+    t[0x6A] = &CPU::BIT_b_r<5, REG_D>;    t[0x7A] = &CPU::BIT_b_r<7, REG_D>;
+    t[0x6B] = &CPU::BIT_b_r<5, REG_E>;    t[0x7B] = &CPU::BIT_b_r<7, REG_E>;
+    t[0x6C] = &CPU::BIT_b_r<5, REG_H>;    t[0x7C] = &CPU::BIT_b_r<7, REG_H>;
+    t[0x6D] = &CPU::BIT_b_r<5, REG_L>;    t[0x7D] = &CPU::BIT_b_r<7, REG_L>;
+    t[0x6E] = &CPU::BIT_b_HL<5>;          t[0x7E] = &CPU::BIT_b_HL<7>;
+    t[0x6F] = &CPU::BIT_b_r<5, REG_A>;    t[0x7F] = &CPU::BIT_b_r<7, REG_A>;
+
+    t[0xC0] = &CPU::SET_b_r<0, REG_B>;    t[0xD0] = &CPU::SET_b_r<2, REG_B>;
+    t[0xC1] = &CPU::SET_b_r<0, REG_C>;    t[0xD1] = &CPU::SET_b_r<2, REG_C>;
+    t[0xC2] = &CPU::SET_b_r<0, REG_D>;    t[0xD2] = &CPU::SET_b_r<2, REG_D>;
+    t[0xC3] = &CPU::SET_b_r<0, REG_E>;    t[0xD3] = &CPU::SET_b_r<2, REG_E>;
+    t[0xC4] = &CPU::SET_b_r<0, REG_H>;    t[0xD4] = &CPU::SET_b_r<2, REG_H>;
+    t[0xC5] = &CPU::SET_b_r<0, REG_L>;    t[0xD5] = &CPU::SET_b_r<2, REG_L>;
+    t[0xC6] = &CPU::SET_b_HL<0>;          t[0xD6] = &CPU::SET_b_HL<2>;
+    t[0xC7] = &CPU::SET_b_r<0, REG_A>;    t[0xD7] = &CPU::SET_b_r<2, REG_A>;
+    t[0xC8] = &CPU::SET_b_r<1, REG_B>;    t[0xD8] = &CPU::SET_b_r<3, REG_B>;
+    t[0xC9] = &CPU::SET_b_r<1, REG_C>;    t[0xD9] = &CPU::SET_b_r<3, REG_C>;
+    t[0xCA] = &CPU::SET_b_r<1, REG_D>;    t[0xDA] = &CPU::SET_b_r<3, REG_D>;
+    t[0xCB] = &CPU::SET_b_r<1, REG_E>;    t[0xDB] = &CPU::SET_b_r<3, REG_E>;
+    t[0xCC] = &CPU::SET_b_r<1, REG_H>;    t[0xDC] = &CPU::SET_b_r<3, REG_H>;
+    t[0xCD] = &CPU::SET_b_r<1, REG_L>;    t[0xDD] = &CPU::SET_b_r<3, REG_L>;
+    t[0xCE] = &CPU::SET_b_HL<1>;          t[0xDE] = &CPU::SET_b_HL<3>;
+    t[0xCF] = &CPU::SET_b_r<1, REG_A>;    t[0xDF] = &CPU::SET_b_r<3, REG_A>;
+
+    t[0xE0] = &CPU::SET_b_r<4, REG_B>;    t[0xF0] = &CPU::SET_b_r<6, REG_B>;
+    t[0xE1] = &CPU::SET_b_r<4, REG_C>;    t[0xF1] = &CPU::SET_b_r<6, REG_C>;
+    t[0xE2] = &CPU::SET_b_r<4, REG_D>;    t[0xF2] = &CPU::SET_b_r<6, REG_D>;
+    t[0xE3] = &CPU::SET_b_r<4, REG_E>;    t[0xF3] = &CPU::SET_b_r<6, REG_E>;
+    t[0xE4] = &CPU::SET_b_r<4, REG_H>;    t[0xF4] = &CPU::SET_b_r<6, REG_H>;
+    t[0xE5] = &CPU::SET_b_r<4, REG_L>;    t[0xF5] = &CPU::SET_b_r<6, REG_L>;
+    t[0xE6] = &CPU::SET_b_HL<4>;          t[0xF6] = &CPU::SET_b_HL<6>;
+    t[0xE7] = &CPU::SET_b_r<4, REG_A>;    t[0xF7] = &CPU::SET_b_r<6, REG_A>;
+    t[0xE8] = &CPU::SET_b_r<5, REG_B>;    t[0xF8] = &CPU::SET_b_r<7, REG_B>;
+    t[0xE9] = &CPU::SET_b_r<5, REG_C>;    t[0xF9] = &CPU::SET_b_r<7, REG_C>;
+    t[0xEA] = &CPU::SET_b_r<5, REG_D>;    t[0xFA] = &CPU::SET_b_r<7, REG_D>;
+    t[0xEB] = &CPU::SET_b_r<5, REG_E>;    t[0xFB] = &CPU::SET_b_r<7, REG_E>;
+    t[0xEC] = &CPU::SET_b_r<5, REG_H>;    t[0xFC] = &CPU::SET_b_r<7, REG_H>;
+    t[0xED] = &CPU::SET_b_r<5, REG_L>;    t[0xFD] = &CPU::SET_b_r<7, REG_L>;
+    t[0xEE] = &CPU::SET_b_HL<5>;          t[0xFE] = &CPU::SET_b_HL<7>;
+    t[0xEF] = &CPU::SET_b_r<5, REG_A>;    t[0xFF] = &CPU::SET_b_r<7, REG_A>;
+
+    t[0x80] = &CPU::RES_b_r<0, REG_B>;    t[0x90] = &CPU::RES_b_r<2, REG_B>;
+    t[0x81] = &CPU::RES_b_r<0, REG_C>;    t[0x91] = &CPU::RES_b_r<2, REG_C>;
+    t[0x82] = &CPU::RES_b_r<0, REG_D>;    t[0x92] = &CPU::RES_b_r<2, REG_D>;
+    t[0x83] = &CPU::RES_b_r<0, REG_E>;    t[0x93] = &CPU::RES_b_r<2, REG_E>;
+    t[0x84] = &CPU::RES_b_r<0, REG_H>;    t[0x94] = &CPU::RES_b_r<2, REG_H>;
+    t[0x85] = &CPU::RES_b_r<0, REG_L>;    t[0x95] = &CPU::RES_b_r<2, REG_L>;
+    t[0x86] = &CPU::RES_b_HL<0>;          t[0x96] = &CPU::RES_b_HL<2>;
+    t[0x87] = &CPU::RES_b_r<0, REG_A>;    t[0x97] = &CPU::RES_b_r<2, REG_A>;
+    t[0x88] = &CPU::RES_b_r<1, REG_B>;    t[0x98] = &CPU::RES_b_r<3, REG_B>;
+    t[0x89] = &CPU::RES_b_r<1, REG_C>;    t[0x99] = &CPU::RES_b_r<3, REG_C>;
+    t[0x8A] = &CPU::RES_b_r<1, REG_D>;    t[0x9A] = &CPU::RES_b_r<3, REG_D>;
+    t[0x8B] = &CPU::RES_b_r<1, REG_E>;    t[0x9B] = &CPU::RES_b_r<3, REG_E>;
+    t[0x8C] = &CPU::RES_b_r<1, REG_H>;    t[0x9C] = &CPU::RES_b_r<3, REG_H>;
+    t[0x8D] = &CPU::RES_b_r<1, REG_L>;    t[0x9D] = &CPU::RES_b_r<3, REG_L>;
+    t[0x8E] = &CPU::RES_b_HL<1>;          t[0x9E] = &CPU::RES_b_HL<3>;
+    t[0x8F] = &CPU::RES_b_r<1, REG_A>;    t[0x9F] = &CPU::RES_b_r<3, REG_A>;
+
+    t[0xA0] = &CPU::RES_b_r<4, REG_B>;    t[0xB0] = &CPU::RES_b_r<6, REG_B>;
+    t[0xA1] = &CPU::RES_b_r<4, REG_C>;    t[0xB1] = &CPU::RES_b_r<6, REG_C>;
+    t[0xA2] = &CPU::RES_b_r<4, REG_D>;    t[0xB2] = &CPU::RES_b_r<6, REG_D>;
+    t[0xA3] = &CPU::RES_b_r<4, REG_E>;    t[0xB3] = &CPU::RES_b_r<6, REG_E>;
+    t[0xA4] = &CPU::RES_b_r<4, REG_H>;    t[0xB4] = &CPU::RES_b_r<6, REG_H>;
+    t[0xA5] = &CPU::RES_b_r<4, REG_L>;    t[0xB5] = &CPU::RES_b_r<6, REG_L>;
+    t[0xA6] = &CPU::RES_b_HL<4>;          t[0xB6] = &CPU::RES_b_HL<6>;
+    t[0xA7] = &CPU::RES_b_r<4, REG_A>;    t[0xB7] = &CPU::RES_b_r<6, REG_A>;
+    t[0xA8] = &CPU::RES_b_r<5, REG_B>;    t[0xB8] = &CPU::RES_b_r<7, REG_B>;
+    t[0xA9] = &CPU::RES_b_r<5, REG_C>;    t[0xB9] = &CPU::RES_b_r<7, REG_C>;
+    t[0xAA] = &CPU::RES_b_r<5, REG_D>;    t[0xBA] = &CPU::RES_b_r<7, REG_D>;
+    t[0xAB] = &CPU::RES_b_r<5, REG_E>;    t[0xBB] = &CPU::RES_b_r<7, REG_E>;
+    t[0xAC] = &CPU::RES_b_r<5, REG_H>;    t[0xBC] = &CPU::RES_b_r<7, REG_H>;
+    t[0xAD] = &CPU::RES_b_r<5, REG_L>;    t[0xBD] = &CPU::RES_b_r<7, REG_L>;
+    t[0xAE] = &CPU::RES_b_HL<5>;          t[0xBE] = &CPU::RES_b_HL<7>;
+    t[0xAF] = &CPU::RES_b_r<5, REG_A>;    t[0xBF] = &CPU::RES_b_r<7, REG_A>;
+
+    return t;
+}
+
+constexpr CPU::InstructionTable CPU::instructions = CPU::buildInstructionTable();
+constexpr CPU::InstructionTable CPU::instructionsCB = CPU::buildInstructionTableCB();
+
 bool CPU::init(std::string& romPath) {
     // TODO: remove hardcoded BIOS path
     std::string biosPath = "../gb/BootROM.gb";
 
     // MMU reset
     if (!mmu.init(romPath, biosPath)) return false;
+    // recompiled code belongs to the previous ROM
+    recompiled.unload();
     // CPU reset
     reset();
     // GPU reset
@@ -465,8 +488,18 @@ bool CPU::init(std::string& romPath) {
 }
 
 void CPU::reset() {
+    flushCodeCache();
+    scheduler.reset();
+    stepStart = 0;
+
     // startup values (https://problemkaputt.de/pandocs.htm#powerupsequence)
     r.af = (gbMode == DMG) ? 0x01B0 : 0x11B0;
+    lazyFlags = {};
+    loopHead = 0;
+    loopEnd = 0;
+    idleLoopBackoff = 0;
+    idleLoopCooldown = 0;
+    idleCyclesSkipped = 0;
     r.bc = 0x0013;
     r.de = 0x00D8;
     r.hl = 0x014D;
@@ -477,7 +510,12 @@ void CPU::reset() {
     cycles = 0;
     ticksPerFrame = 70224;
     timerCounter = 1024;
-    dividerCounter = 0;
+    delayedOverflow = false;
+    dividerOffset = mmu.IO[0x04];
+    timerBase = 0;
+    timerValue = 0;
+    // the frame sequencer is scheduled by the first tick with an audio policy
+    apu.stop();
 
     runCGBinDMGMode = false;
     doubleSpeedMode = false;
@@ -535,106 +573,856 @@ void CPU::handleInputUp(u8 key) {
 }
 
 u32 CPU::tick() {
+    return headless ? tick<Policy::NoAudio>() : tick<Policy::Accurate>();
+}
+
+template<class P> u32 CPU::tick() {
+    // the APU follows the policy of the running tick, it is paused and resumed when that changes
+    if constexpr (P::audio) {
+        if (!apu.isRunning()) startAudio();
+    } else {
+        if (apu.isRunning()) stopAudio();
+    }
+
+    u32 skippedTicks = 0;
+    if (r.pc == loopHead && !halted) skippedTicks = runLoop();
+
+    if (recompiled.isLoaded()) {
+        u32 ticks = runRecompiledBlock<P>();
+        if (ticks) return ticks + skippedTicks;
+    }
+    if (jitEnabled || cachedInterpreter) {
+        u32 ticks = runBlock<P>();
+        if (ticks) return ticks + skippedTicks;
+    }
+
     u32 ticks = 0;
     u8 opcode = 0;
     bool isCBInstruction = false;
     if (halted) {
-        ticks = NOP(0x00);
+        skippedTicks = fastForwardHalt();
+        ticks = NOP();
     } else {
-        opcode = readByte(r.pc++);
-        Instruction instruction;
+        opcode = fetchCode(r.pc++);
+        isExecutingInstruction = P::subInstructionTiming;
         if (opcode == 0xCB) {
             isCBInstruction = true;
-            opcode = readByte(r.pc++);
-            instruction = instructionsCB[opcode];
+            opcode = fetchCode(r.pc++);
+            ticks = executeCB(opcode);
         } else {
-            instruction = instructions[opcode];
-        }
-
-        if (instruction == nullptr) {
-            Log(F, "Invalid opcode 0x%02X at address 0x%04X\n", opcode, r.pc-1);
-            return 0;
+            ticks = execute(opcode);
         }
-
-        isExecutingInstruction = true;
-        ticks = (this->*instruction)(opcode);
         isExecutingInstruction = false;
     }
 
     if (ticks == 0) {
-        Log(F, "Unimplemented opcode");
+        Log(F, "Invalid opcode");
         if (isCBInstruction) LogRaw(F, " 0xCB");
-        LogRaw(F, " 0x%02X at address 0x%02X\n", opcode, r.pc-1);
+        LogRaw(F, " 0x%02X at address 0x%04X\n", opcode, r.pc-1);
         return 0;
     }
 
+    return finishInstruction(ticks) + skippedTicks;
+}
+
+template u32 CPU::tick<Policy::Accurate>();
+template u32 CPU::tick<Policy::NoAudio>();
+template u32 CPU::tick<Policy::Fast>();
+
+u32 CPU::finishInstruction(u32 ticks) {
     cycles = ticks;
     assert(ticks > partialTicks);
-    ticks -= partialTicks;
+    advance(ticks - partialTicks);
     partialTicks = 0;
 
-    gpu.tick(ticks);
+    checkInterrupts();
 
-    updateTimer(ticks);
+    return cycles;
+}
 
-    apu.update(ticks);
+// moves the master clock forward and runs the events that became due on the way
+void CPU::advance(u32 ticks) {
+    stepStart = scheduler.now;
+    scheduler.now += ticks;
+    if (scheduler.now >= scheduler.nextEvent()) runEvents();
 
-    checkInterrupts();
+    // the LY=LYC interrupt is requested again after every step while the line matches
+    if (gpu.coincidenceInterrupt) requestInterrupt(INTERRUPT_LCD_STAT);
+}
 
-    return cycles;
+void CPU::runEvents() {
+    u64 timestamp;
+    EVENT_TYPE event;
+    while ((event = scheduler.popDue(timestamp)) != EVENT_COUNT) {
+        switch (event) {
+            case EVENT_PPU:
+                gpu.sync();
+                gpu.scheduleNextEvent();
+                break;
+            case EVENT_PPU_COINCIDENCE:
+                gpu.sync();
+                gpu.checkCoincidence();
+                gpu.scheduleNextEvent();
+                break;
+            case EVENT_TIMER:
+                reloadTimer(timestamp);
+                break;
+            case EVENT_APU_FRAME:
+                // samples of the current step come after the frame sequencer step
+                apu.catchUp(stepStart);
+                apu.clockFrameSequencer(divider(timestamp));
+                scheduleFrameSequencer(timestamp);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+template<u8 opcode> u32 CPU::executeOpcode() {
+    constexpr Instruction instruction = instructions[opcode];
+    if constexpr (instruction == nullptr) return 0;
+    else return (this->*instruction)();
+}
+
+template<u8 opcode> u32 CPU::executeOpcodeCB() {
+    constexpr Instruction instruction = instructionsCB[opcode];
+    if constexpr (instruction == nullptr) return 0;
+    else return (this->*instruction)();
+}
+
+#ifndef PHOS_TABLE_DISPATCH
+// expands to one case per opcode, every case calls its own instantiation of FN
+#define OPCODE_CASE(FN, OP) case (OP): return FN<(OP)>();
+#define OPCODE_CASES_4(FN, OP) \
+    OPCODE_CASE(FN, (OP) + 0x0) OPCODE_CASE(FN, (OP) + 0x1) OPCODE_CASE(FN, (OP) + 0x2) OPCODE_CASE(FN, (OP) + 0x3)
+#define OPCODE_CASES_16(FN, OP) \
+    OPCODE_CASES_4(FN, (OP) + 0x0) OPCODE_CASES_4(FN, (OP) + 0x4) OPCODE_CASES_4(FN, (OP) + 0x8) OPCODE_CASES_4(FN, (OP) + 0xC)
+#define OPCODE_CASES_64(FN, OP) \
+    OPCODE_CASES_16(FN, (OP) + 0x00) OPCODE_CASES_16(FN, (OP) + 0x10) OPCODE_CASES_16(FN, (OP) + 0x20) OPCODE_CASES_16(FN, (OP) + 0x30)
+#define OPCODE_CASES_256(FN) \
+    OPCODE_CASES_64(FN, 0x00) OPCODE_CASES_64(FN, 0x40) OPCODE_CASES_64(FN, 0x80) OPCODE_CASES_64(FN, 0xC0)
+#endif
+
+u32 CPU::execute(u8 opcode) {
+#ifdef PHOS_TABLE_DISPATCH
+    Instruction instruction = instructions[opcode];
+    return instruction ? (this->*instruction)() : 0;
+#else
+    switch (opcode) {
+        OPCODE_CASES_256(executeOpcode)
+    }
+    return 0;
+#endif
+}
+
+u32 CPU::executeCB(u8 opcode) {
+#ifdef PHOS_TABLE_DISPATCH
+    Instruction instruction = instructionsCB[opcode];
+    return instruction ? (this->*instruction)() : 0;
+#else
+    switch (opcode) {
+        OPCODE_CASES_256(executeOpcodeCB)
+    }
+    return 0;
+#endif
+}
+
+CPU::CodeBlock* CPU::findCodeBlock(u16 address) {
+    // blocks never cross the boundary of a memory region
+    u16 end;
+    if (address < 0x4000) end = 0x4000;
+    else if (address < 0x8000) end = 0x8000;
+    else if (address >= 0xC000 && address < 0xD000) end = 0xD000;
+    else if (address >= 0xD000 && address < 0xE000) end = 0xE000;
+    else if (address >= 0xFF80 && address < 0xFFFF) end = 0xFFFF;
+    else return nullptr;
+
+    bool inROM = address < 0x8000;
+    u32 key = inROM ? address : codeRAMOffset(address);
+    if (address >= 0x4000 && inROM) key |= mmu.mbc->ROMBankPtr << 16;
+    auto& blocks = inROM ? romBlocks : ramBlocks;
+
+    auto it = blocks.find(key);
+    if (it != blocks.end()) return &it->second;
+
+    CodeBlock block = decodeBlock(address, end);
+    if (block.instructions.empty()) return nullptr;
+    if (!inROM) updateCodePages(key, block, 1);
+    return &blocks.emplace(key, std::move(block)).first->second;
+}
+
+CPU::CodeBlock CPU::decodeBlock(u16 address, u16 end) {
+    CodeBlock block {};
+    block.start = address;
+
+    u32 pc = address;
+    while (block.instructions.size() < MAX_BLOCK_LENGTH) {
+        u8 opcode = mmu.readByte(pc);
+        DecodedInstruction decoded {};
+        decoded.address = pc;
+        if (opcode == 0xCB) {
+            if (pc + 1 >= end) break;
+            decoded.opcode = mmu.readByte(pc + 1);
+            decoded.instruction = instructionsCB[decoded.opcode];
+            decoded.opcodeLength = 2;
+        } else {
+            decoded.opcode = opcode;
+            decoded.instruction = instructions[opcode];
+            decoded.opcodeLength = 1;
+        }
+        // invalid opcodes are left to the interpreter so it can report them
+        u8 operandLength = operandLengths[opcode];
+        u8 length = decoded.opcodeLength + operandLength;
+        if (!decoded.instruction || pc + length > end) break;
+
+        if (operandLength > 0) decoded.operands[0] = mmu.readByte(pc + 1);
+        if (operandLength > 1) decoded.operands[1] = mmu.readByte(pc + 2);
+        block.instructions.push_back(decoded);
+        block.cycles += decoded.opcodeLength == 2 ? maxCyclesCB(decoded.opcode) : maxCycles[opcode];
+        pc += length;
+        if (endsBlock(opcode)) break;
+    }
+
+    block.end = pc;
+    return block;
+}
+
+int CPU::codeRAMOffset(u16 address) {
+    // same mapping as MMU::readByte, HRAM is placed behind all WRAM banks
+    if (address >= 0xC000 && address < 0xD000) return address - 0xC000;
+    if (address >= 0xD000 && address < 0xE000) {
+        if (gbMode == DMG) return address - 0xC000;
+        return address - 0xC000 + mmu.WRAMBankPtr * WRAM_BANK_SIZE;
+    }
+    if (address >= 0xFF80 && address < 0xFFFF) return WRAM_BANK_SIZE * 8 + (address - 0xFF80);
+    return -1;
+}
+
+void CPU::updateCodePages(u32 offset, const CodeBlock& block, int delta) {
+    u32 last = offset + (block.end - block.start) - 1;
+    for (u32 page = offset >> 8; page <= (last >> 8); page++) {
+        ramCodePages[page] += delta;
+    }
+}
+
+void CPU::invalidateCode(u16 address) {
+    // MBC and WRAM bank switches only change which blocks are visible in the switchable regions
+    if (address < 0x8000) {
+        if (currentBlock && currentBlock->start >= 0x4000 && currentBlock->start < 0x8000) currentBlock = nullptr;
+        return;
+    }
+    if (address == 0xFF70) {
+        if (currentBlock && currentBlock->start >= 0xD000 && currentBlock->start < 0xE000) currentBlock = nullptr;
+        return;
+    }
+
+    int offset = codeRAMOffset(address);
+    if (offset < 0 || ramCodePages[offset >> 8] == 0) return;
+
+    for (auto it = ramBlocks.begin(); it != ramBlocks.end();) {
+        CodeBlock& block = it->second;
+        if ((u32) offset >= it->first && (u32) offset < it->first + (block.end - block.start)) {
+            updateCodePages(it->first, block, -1);
+            if (&block == currentBlock) currentBlock = nullptr;
+            it = ramBlocks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CPU::flushCodeCache() {
+    romBlocks.clear();
+    ramBlocks.clear();
+    std::fill(ramCodePages.begin(), ramCodePages.end(), 0);
+    currentBlock = nullptr;
+    jit.flush();
+    busyLoops.clear();
+    memoryLoops.clear();
+}
+
+// number of times a block is interpreted before it gets compiled
+constexpr u32 JIT_THRESHOLD = 16;
+
+template<class P> u32 CPU::runBlock() {
+    // only ROM is compiled, code in RAM can modify itself and only runs from decoded blocks
+    bool compile = jitEnabled && r.pc < 0x8000 && jit.isSupported();
+    if (halted || mmu.inBIOS || !(compile || cachedInterpreter)) return 0;
+    CodeBlock* block = findCodeBlock(r.pc);
+    if (!block) return 0;
+
+    JIT::Block& native = block->native[P::subInstructionTiming];
+    if (compile && !native && ++block->executions >= JIT_THRESHOLD) {
+        std::vector<JIT::Call> calls;
+        for (size_t i=0; i<block->instructions.size(); i++) {
+            DecodedInstruction& decoded = block->instructions[i];
+            JIT::Step step = decoded.opcodeLength == 2 ? stepsCB[P::subInstructionTiming][decoded.opcode]
+                                                       : steps[P::subInstructionTiming][decoded.opcode];
+            u16 nextPc = i + 1 < block->instructions.size() ? block->instructions[i + 1].address : block->end;
+            calls.push_back({step, decoded.operands, nextPc});
+        }
+        native = jit.compile(&CPU::enterBlock, block->cycles, calls);
+        if (!native) {
+            // the code buffer is full, start over
+            if (jit.isSupported()) flushCodeCache();
+            return 0;
+        }
+    }
+
+    blockCycles = 0;
+    blockVBlank = gpu.hitVBlank;
+    currentBlock = block;
+    if (native) {
+        native(this);
+    } else {
+        fastBlock = canRunFast(block->cycles);
+        // blocks that are not hot yet and the cached interpreter run through the same steps without generated code
+        for (size_t i=0; i<block->instructions.size(); i++) {
+            DecodedInstruction& decoded = block->instructions[i];
+            u16 nextPc = i + 1 < block->instructions.size() ? block->instructions[i + 1].address : block->end;
+            r.pc += decoded.opcodeLength;
+            operands = decoded.operands;
+            isExecutingInstruction = P::subInstructionTiming;
+            u32 ticks = (this->*decoded.instruction)();
+            isExecutingInstruction = false;
+            operands = nullptr;
+            if (!finishBlockStep(ticks, nextPc)) break;
+        }
+    }
+    currentBlock = nullptr;
+    fastBlock = false;
+    return blockCycles;
+}
+
+bool CPU::loadRecompiledCode(std::string& path) {
+    return recompiled.load(path, mmu.ROM_0, mmu.ROM);
+}
+
+template<class P> u32 CPU::runRecompiledBlock() {
+    if (halted || mmu.inBIOS) return 0;
+    const RecompEntry* entry = recompiled.find(r.pc);
+    if (!entry) return 0;
+
+    blockCycles = 0;
+    blockVBlank = gpu.hitVBlank;
+    recompiledBlock.start = r.pc;
+    currentBlock = &recompiledBlock;
+    entry->block[P::subInstructionTiming](this, recompHosts[P::subInstructionTiming]);
+    currentBlock = nullptr;
+    fastBlock = false;
+    return blockCycles;
+}
+
+// recompiled blocks only take their inline path if nothing can happen before the block ends,
+// the clock is only moved when memory is accessed and when the block is left
+bool CPU::enterRecompiledBlock(CPU* cpu, u32 cycles) {
+    cpu->fastBlock = cpu->canRunFast(cycles);
+    cpu->materializeFlags();
+    return cpu->fastBlock;
+}
+
+// blockCycles counts the cycles the clock was already moved by
+void CPU::syncRecompiledBlock(u32 elapsed) {
+    scheduler.now += elapsed - blockCycles;
+    blockCycles = elapsed;
+}
+
+u8 CPU::readInBlock(CPU* cpu, u16 address, u32 elapsed) {
+    cpu->syncRecompiledBlock(elapsed);
+    return cpu->readByte(address);
+}
+
+u16 CPU::readWordInBlock(CPU* cpu, u16 address, u32 elapsed) {
+    cpu->syncRecompiledBlock(elapsed);
+    return cpu->readWord(address);
+}
+
+bool CPU::writeInBlock(CPU* cpu, u16 address, u8 value, u32 elapsed) {
+    cpu->syncRecompiledBlock(elapsed);
+    cpu->writeByte(address, value);
+    return cpu->fastBlock && cpu->currentBlock;
+}
+
+bool CPU::writeWordInBlock(CPU* cpu, u16 address, u16 value, u32 elapsed) {
+    cpu->syncRecompiledBlock(elapsed);
+    cpu->writeWord(address, value);
+    return cpu->fastBlock && cpu->currentBlock;
+}
+
+void CPU::loopInBlock(CPU* cpu, u16 head, u16 end) {
+    cpu->loopHead = head;
+    cpu->loopEnd = end;
+}
+
+void CPU::leaveRecompiledBlock(CPU* cpu, u32 ticks, u32 last) {
+    if (cpu->fastBlock) {
+        cpu->syncRecompiledBlock(ticks);
+        cpu->cycles = last;
+        cpu->stepStart = cpu->scheduler.now - last;
+    } else {
+        // a write left the inline path, the last instruction is finished like the interpreter does it
+        cpu->partialTicks = cpu->blockCycles - (ticks - last);
+        cpu->blockCycles = ticks - last;
+        cpu->blockCycles += cpu->finishInstruction(last);
+    }
+}
+
+// events can only change what a block sees when they run, interrupts only matter if one is pending
+// or the LY=LYC interrupt has to be requested again after every step
+bool CPU::canRunFast(u32 ticks) {
+    if (scheduler.now + ticks >= scheduler.nextEvent() || gpu.coincidenceInterrupt) return false;
+    return !(r.ime && (mmu.readByte(0xFF0F) & mmu.readByte(0xFFFF) & 0x1F));
+}
+
+// called by the generated code before its first step
+void CPU::enterBlock(CPU* cpu, u32 cycles) {
+    cpu->fastBlock = cpu->canRunFast(cycles);
+}
+
+bool CPU::finishBlockStep(u32 ticks, u16 nextPc) {
+    if (fastBlock) {
+        // same as finishInstruction when advance can't run any events
+        cycles = ticks;
+        stepStart = scheduler.now;
+        scheduler.now += ticks - partialTicks;
+        partialTicks = 0;
+        blockCycles += ticks;
+    } else {
+        blockCycles += finishInstruction(ticks);
+    }
+    // leave the block on jumps, interrupts, HALT, bank switches and at the start of VBLANK,
+    // the frontends present the frame between two ticks
+    return r.pc == nextPc && !halted && currentBlock && gpu.hitVBlank == blockVBlank;
+}
+
+template<u8 opcode, bool timing> bool CPU::step(CPU* cpu, const u8* operands, u16 nextPc) {
+    cpu->r.pc += 1;
+    cpu->operands = operands;
+    cpu->isExecutingInstruction = timing;
+    u32 ticks = cpu->executeOpcode<opcode>();
+    cpu->isExecutingInstruction = false;
+    cpu->operands = nullptr;
+    return cpu->finishBlockStep(ticks, nextPc);
+}
+
+template<u8 opcode, bool timing> bool CPU::stepCB(CPU* cpu, const u8* operands, u16 nextPc) {
+    cpu->r.pc += 2;
+    cpu->isExecutingInstruction = timing;
+    u32 ticks = cpu->executeOpcodeCB<opcode>();
+    cpu->isExecutingInstruction = false;
+    return cpu->finishBlockStep(ticks, nextPc);
+}
+
+template<bool timing, size_t... opcodes> constexpr CPU::StepTable CPU::buildStepTable(std::index_sequence<opcodes...>) {
+    return {{ &CPU::step<opcodes, timing>... }};
+}
+
+template<bool timing, size_t... opcodes> constexpr CPU::StepTable CPU::buildStepTableCB(std::index_sequence<opcodes...>) {
+    return {{ &CPU::stepCB<opcodes, timing>... }};
+}
+
+constexpr std::array<CPU::StepTable, 2> CPU::steps = {
+    CPU::buildStepTable<false>(std::make_index_sequence<256>()),
+    CPU::buildStepTable<true>(std::make_index_sequence<256>())
+};
+constexpr std::array<CPU::StepTable, 2> CPU::stepsCB = {
+    CPU::buildStepTableCB<false>(std::make_index_sequence<256>()),
+    CPU::buildStepTableCB<true>(std::make_index_sequence<256>())
+};
+
+const std::array<RecompHost, 2> CPU::recompHosts = {{
+    {&CPU::enterRecompiledBlock, &CPU::readInBlock, &CPU::readWordInBlock, &CPU::writeInBlock,
+     &CPU::writeWordInBlock, &CPU::loopInBlock, &CPU::leaveRecompiledBlock, steps[0].data(), stepsCB[0].data()},
+    {&CPU::enterRecompiledBlock, &CPU::readInBlock, &CPU::readWordInBlock, &CPU::writeInBlock,
+     &CPU::writeWordInBlock, &CPU::loopInBlock, &CPU::leaveRecompiledBlock, steps[1].data(), stepsCB[1].data()}
+}};
+
+// code in ROM and RAM is read straight from its page, the page table is remapped on bank switches
+// and when the BIOS is unmapped, so the page pointer never goes stale
+u8 CPU::fetchCode(u16 address) {
+    const u8* page = mmu.readPage(address);
+    return page ? page[address & (PAGE_SIZE - 1)] : readByte(address);
+}
+
+u8 CPU::fetchByte() {
+    u8 value = operands ? *operands++ : fetchCode(r.pc);
+    r.pc++;
+    return value;
+}
+
+u16 CPU::fetchWord() {
+    u16 value;
+    const u8* page = mmu.readPage(r.pc);
+    u32 offset = r.pc & (PAGE_SIZE - 1);
+    if (operands) {
+        value = operands[0] | (operands[1] << 8);
+        operands += 2;
+    } else if (page && offset + 1 < PAGE_SIZE) {
+        value = page[offset] | (page[offset + 1] << 8);
+    } else {
+        value = readWord(r.pc);
+    }
+    r.pc += 2;
+    return value;
 }
 
 void CPU::runPartialInstruction(u32 ticks) {
     if (!isExecutingInstruction) return;
 
-    gpu.tick(ticks);
-    updateTimer(ticks);
-    apu.update(ticks);
+    advance(ticks);
 
     partialTicks += ticks;
 }
 
-void CPU::updateTimer(u32 ticks) {
-    dividerCounter += ticks;
-    if (dividerCounter >= 0xFF) {
-        dividerCounter -= 0xFF;
-        // access divider directly
-        mmu.IO[0x4]++;
+// the divider increments every 0xFF cycles of the master clock
+u8 CPU::divider(u64 timestamp) {
+    return (u8) (timestamp / 0xFF) + dividerOffset;
+}
+
+// TIMA at the current master clock, the timer runs while its overflow is scheduled
+u8 CPU::timer() {
+    if (!scheduler.isScheduled(EVENT_TIMER)) return timerValue;
+    return (u8) (timerValue + (scheduler.now - timerBase) / timerPeriod());
+}
+
+void CPU::writeTimer(u8 value) {
+    bool running = scheduler.isScheduled(EVENT_TIMER);
+    // an overflow in the last cycle still reloads TIMA
+    bool reloading = running && scheduler.timestamp(EVENT_TIMER) == scheduler.now + 1;
+    if (running) rebaseTimer(scheduler.now);
+    timerValue = value;
+    mmu.IO[0x05] = value;
+    if (running && !reloading) scheduleTimerOverflow();
+}
+
+// TIMA overflowed to 0 at timestamp - 1 and gets reloaded with TMA now
+void CPU::reloadTimer(u64 timestamp) {
+    rebaseTimer(timestamp - 1);
+    timerValue = mmu.IO[0x06];
+    mmu.IO[0x05] = timerValue;
+    requestInterrupt(INTERRUPT_TIMER);
+    scheduleTimerOverflow();
+}
+
+// moves timerBase to the last increment at or before timestamp
+void CPU::rebaseTimer(u64 timestamp) {
+    int period = timerPeriod();
+    u64 increments = (timestamp - timerBase) / period;
+    timerValue += increments;
+    timerBase += increments * period;
+}
+
+void CPU::scheduleTimerOverflow() {
+    scheduler.schedule(EVENT_TIMER, timerBase + (u64) (0x100 - timerValue) * timerPeriod() + 1);
+}
+
+// takes the timer out of the scheduler while TAC changes
+void CPU::stopTimer() {
+    if (!scheduler.isScheduled(EVENT_TIMER)) return;
+    if (scheduler.timestamp(EVENT_TIMER) == scheduler.now + 1) delayedOverflow = true;
+    rebaseTimer(scheduler.now);
+    timerCounter = timerBase + timerPeriod() - scheduler.now;
+    scheduler.cancel(EVENT_TIMER);
+}
+
+void CPU::startTimer() {
+    if (!isBitSet(readByte(0xFF07), 2)) return;
+    // the first increment comes after the cycles that were left when the timer stopped
+    timerBase = scheduler.now + timerCounter - timerPeriod();
+    if (delayedOverflow) {
+        scheduler.schedule(EVENT_TIMER, scheduler.now + 1);
+        delayedOverflow = false;
+    } else {
+        scheduleTimerOverflow();
+    }
+}
+
+void CPU::setTimerFreq() {
+    timerCounter = timerPeriod();
+}
+
+int CPU::timerPeriod() {
+    switch (readByte(0xFF07) & 0x03) {
+        case 0: return 1024;
+        case 1: return 16;
+        case 2: return 64;
+        default: return 256;
+    }
+}
+
+// CPU cycles until DIV or TIMA change next
+u32 CPU::ticksUntilTimerChange(u16 address) {
+    if (address == 0xFF04) return 0xFF - scheduler.now % 0xFF;
+    if (!scheduler.isScheduled(EVENT_TIMER)) return 0xFFFFFFFF;
+    int period = timerPeriod();
+    return period - (scheduler.now - timerBase) % period;
+}
+
+// the divider bit that clocks the APU frame sequencer changes after this many increments
+void CPU::scheduleFrameSequencer(u64 timestamp) {
+    u8 bit = 4 + (doubleSpeedMode ? 1 : 0);
+    u32 increments = (1u << bit) - (divider(timestamp) & ((1u << bit) - 1));
+    u64 nextIncrement = (timestamp / 0xFF + 1) * 0xFF;
+    scheduler.schedule(EVENT_APU_FRAME, nextIncrement + 0xFF * (increments - 1));
+}
+
+// the frame sequencer first looks at the divider bit of the current cycle
+void CPU::startAudio() {
+    apu.start(divider(scheduler.now));
+    scheduler.schedule(EVENT_APU_FRAME, scheduler.now);
+}
+
+void CPU::stopAudio() {
+    apu.stop();
+    scheduler.cancel(EVENT_APU_FRAME);
+}
+
+// CPU cycles that can pass before anything could request an interrupt or change what the CPU reads
+u32 CPU::ticksUntilNextEvent() {
+    u64 next = scheduler.nextEvent();
+    if (next <= scheduler.now) return 0;
+    return (u32) std::min<u64>(next - scheduler.now, 0xFFFFFFFF);
+}
+
+// same as stepping in small steps if no event happens in between, the APU catches up later
+void CPU::skipTicks(u32 ticks) {
+    scheduler.now += ticks;
+}
+
+// advances a halted CPU by all the 4 cycle NOP steps that can't request an interrupt,
+// the step that does is left to the normal path
+u32 CPU::fastForwardHalt() {
+    u32 steps = (ticksUntilNextEvent() + 3) / 4;
+    if (steps <= 1) return 0;
+    u32 ticks = (steps - 1) * 4;
+    skipTicks(ticks);
+    return ticks;
+}
+
+// address read by a side effect free instruction at r.pc, -1 if it doesn't access memory
+int CPU::memoryOperand(u8 opcode, bool isCB) {
+    if (isCB || (opcode >= 0x40 && opcode < 0xC0)) return ((opcode & 0x07) == 6) ? r.hl : -1;
+    switch (opcode) {
+        case 0x0A: return r.bc;
+        case 0x1A: return r.de;
+        case 0x2A: case 0x3A: return r.hl;
+        case 0xF0: return 0xFF00 + readByte(r.pc + 1);
+        case 0xF2: return 0xFF00 + r.c;
+        case 0xFA: return readWord(r.pc + 1);
+        default: return -1;
+    }
+}
+
+// called by backward jumps, the jump ends at r.pc
+void CPU::setLoopHead(u16 head) {
+    loopHead = head;
+    loopEnd = r.pc;
+}
+
+// loops in ROM are run in bulk when they copy or fill memory and skipped when they only poll it
+u32 CPU::runLoop() {
+    if (loopEnd > 0x8000 || mmu.inBIOS) return 0;
+    loopKey = r.pc;
+    if (r.pc >= 0x4000) loopKey |= mmu.mbc->ROMBankPtr << 16;
+
+    u32 ticks = 0;
+    if (memoryLoopDetection) ticks = runMemoryLoop();
+    if (ticks == 0 && idleLoopDetection) ticks = skipIdleLoop();
+    return ticks;
+}
+
+CPU::MemoryLoop CPU::matchMemoryLoop(u16 head, u16 end) {
+    MemoryLoop loop {};
+    u8 code[8];
+    u16 length = end - head;
+    if (length < 3 || length > sizeof(code)) return loop;
+    for (u16 i=0; i<length; i++) code[i] = readByte(head + i);
+    // JR NZ back to the head
+    if (code[length - 2] != 0x20 || static_cast<char>(code[length - 1]) != -length) return loop;
+
+    size_t i;
+    if (code[0] == 0x22 || code[0] == 0x32) {
+        loop = {MEMORY_LOOP_FILL, code[0] == 0x22 ? 1 : -1, false, 0, 8};
+        i = 1;
+    } else if (code[0] == 0x1A && (code[1] == 0x22 || code[1] == 0x32) && code[2] == 0x13) {
+        loop = {MEMORY_LOOP_COPY_TO_HL, code[1] == 0x22 ? 1 : -1, false, 0, 24};
+        i = 3;
+    } else if (code[0] == 0x2A && code[1] == 0x12 && code[2] == 0x13) {
+        loop = {MEMORY_LOOP_COPY_TO_DE, 1, false, 0, 24};
+        i = 3;
+    } else {
+        return {};
     }
 
-    u8 tac = readByte(0xFF07);
-    if (!isBitSet(tac, 2)) return;
-    static bool delayedOverflow = false;
+    // DEC B/C, or DEC D/E when DE isn't a pointer
+    u8 op = code[i];
+    if (op == 0x05 || op == 0x0D || (loop.kind == MEMORY_LOOP_FILL && (op == 0x15 || op == 0x1D))) {
+        loop.counter = op >> 3;
+        loop.ticks += 4;
+        i += 1;
+    // DEC BC; LD A,B; OR C overwrites A so it can't be used for fills
+    } else if (op == 0x0B && loop.kind != MEMORY_LOOP_FILL && i + 2 < length &&
+               ((code[i + 1] == 0x78 && code[i + 2] == 0xB1) || (code[i + 1] == 0x79 && code[i + 2] == 0xB0))) {
+        loop.wideCounter = true;
+        loop.ticks += 16;
+        i += 3;
+    } else {
+        return {};
+    }
+    if (i + 2 != length) return {};
+    loop.ticks += 12;
+    return loop;
+}
 
-    for (u32 i=0; i<ticks; i++) {
-        timerCounter--;
+u8& CPU::counterRegister(u8 reg) {
+    switch (reg) {
+        case REG_B: return r.b;
+        case REG_C: return r.c;
+        case REG_D: return r.d;
+        default: return r.e;
+    }
+}
 
-        if (delayedOverflow) {
-            writeByte(0xFF05, readByte(0xFF06));
-            requestInterrupt(INTERRUPT_TIMER);
-            delayedOverflow = false;
+// runs all iterations of a copy or fill loop before the next event in one step, the last one that
+// falls through is left to the interpreter
+u32 CPU::runMemoryLoop() {
+    auto it = memoryLoops.find(loopKey);
+    if (it == memoryLoops.end()) it = memoryLoops.emplace(loopKey, matchMemoryLoop(r.pc, loopEnd)).first;
+    const MemoryLoop& loop = it->second;
+    if (loop.kind == MEMORY_LOOP_NONE) return 0;
+
+    u16 source = (loop.kind == MEMORY_LOOP_COPY_TO_HL) ? r.de : r.hl;
+    u16 destination = (loop.kind == MEMORY_LOOP_COPY_TO_DE) ? r.de : r.hl;
+    u32 window = ticksUntilNextEvent();
+    // the PPU has to draw its next line before VRAM changes under it
+    if (destination >= 0x8000 && destination < 0xA000) window = std::min(window, gpu.ticksUntilModeChange());
+    if (window == 0) return 0;
+    u8& counter = counterRegister(loop.counter);
+    u32 remaining = loop.wideCounter ? (r.bc ? r.bc : 0x10000) : (counter ? counter : 0x100);
+    u32 iterations = std::min(remaining - 1, (window - 1) / loop.ticks);
+    if (iterations == 0) return 0;
+
+    int step = (loop.kind == MEMORY_LOOP_COPY_TO_DE) ? 1 : loop.step;
+    if (step < 0 && destination < iterations - 1) return 0;
+    u16 first = (step > 0) ? destination : destination - (iterations - 1);
+    u8* target = mmu.plainMemory(first, iterations);
+    if (!target) return 0;
+
+    if (loop.kind == MEMORY_LOOP_FILL) {
+        std::memset(target, r.a, iterations);
+    } else {
+        // ROM reads go through the MBC, IO and cartridge RAM are left to the interpreter
+        const u8* from = mmu.plainMemory(source, iterations);
+        if (!from && (u32) source + iterations > 0x8000) return 0;
+        // byte by byte like the CPU in case the ranges overlap
+        for (u32 i=0; i<iterations; i++) {
+            u8 value = from ? from[i] : mmu.readByte(source + i);
+            target[(step > 0) ? i : iterations - 1 - i] = value;
+            r.a = value;
         }
+    }
+    if (cachedInterpreter || jitEnabled) {
+        for (u32 i=0; i<iterations; i++) invalidateCode(first + i);
+    }
+    if (first >= 0x8000 && first < 0xA000) gpu.invalidateTiles(target - mmu.VRAM.data(), iterations);
+
+    if (loop.kind != MEMORY_LOOP_FILL) r.de += iterations;
+    r.hl += (loop.kind == MEMORY_LOOP_COPY_TO_DE) ? iterations : step * (int) iterations;
+    if (loop.wideCounter) {
+        r.bc -= iterations;
+        r.a = r.b | r.c;
+        setLogicFlags(r.a, false);
+    } else {
+        counter -= iterations;
+        setDecFlags(counter + 1, counter);
+    }
 
-        if (timerCounter <= 0) {
-            int remainder = timerCounter;
-            setTimerFreq();
-            timerCounter += remainder;
+    u32 ticks = iterations * loop.ticks;
+    skipTicks(ticks);
+    return ticks;
+}
+
+// longest loop body the idle loop detection looks at
+constexpr size_t MAX_IDLE_LOOP_LENGTH = 16;
+constexpr u16 MAX_IDLE_LOOP_SIZE = 64;
+constexpr u32 MAX_IDLE_LOOP_BACKOFF = 63;
+
+// runs one iteration of the loop at loopHead without advancing the clock,
+// returns its length in cycles or 0 if it doesn't get back to the start of the loop
+u32 CPU::runIdleIteration(u32& window) {
+    u32 ticks = 0;
+    for (size_t i=0; i<MAX_IDLE_LOOP_LENGTH; i++) {
+        // leaving the loop isn't a reason to give up on it
+        if (r.pc < loopHead || r.pc >= loopEnd) return 0;
+        u8 opcode = readByte(r.pc);
+        bool isCB = opcode == 0xCB;
+        if (isCB) opcode = readByte(r.pc + 1);
+        if (!(isCB ? isSideEffectFreeCB(opcode) : isSideEffectFree(opcode))) {
+            busyLoops.insert(loopKey);
+            return 0;
+        }
 
-            writeByte(0xFF05, readByte(0xFF05) + 1);
-            delayedOverflow = (readByte(0xFF05) == 0);
+        int address = memoryOperand(opcode, isCB);
+        if (address >= 0) {
+            // cartridge RAM may hold a real time clock, echo RAM and OAM are not worth it
+            if ((address >= 0xA000 && address < 0xC000) || (address >= 0xE000 && address < 0xFF00)) return 0;
+            // registers derived from the clock change without an event, the window ends before they do
+            if (address == LCDC_Y_COORDINATE || address == LCDC_STATUS) {
+                window = std::min(window, gpu.ticksUntilModeChange());
+            } else if (address == 0xFF04 || address == 0xFF05) {
+                window = std::min(window, ticksUntilTimerChange(address));
+            }
         }
+
+        r.pc += isCB ? 2 : 1;
+        u32 instructionTicks = isCB ? executeCB(opcode) : execute(opcode);
+        if (instructionTicks == 0) return 0;
+        ticks += instructionTicks;
+        if (r.pc == loopHead) return ticks;
     }
+    return 0;
 }
 
-void CPU::setTimerFreq() {
-    u8 freq = readByte(0xFF07) & 0x03;
-    switch (freq) {
-        case 0: timerCounter = 1024; break;
-        case 1: timerCounter = 16;   break;
-        case 2: timerCounter = 64;   break;
-        case 3: timerCounter = 256;  break;
-        default: Log(W, "Invalid timer frequency\n");
+// a loop that only reads memory repeats the same iteration until something changes the values it reads,
+// the iterations before the next event are skipped in one step
+u32 CPU::skipIdleLoop() {
+    if (loopEnd - r.pc > MAX_IDLE_LOOP_SIZE || busyLoops.count(loopKey)) return 0;
+    if (idleLoopCooldown > 0) {
+        idleLoopCooldown--;
+        return 0;
     }
+
+    u32 window = ticksUntilNextEvent();
+    if (window == 0) return 0;
+
+    // two dry runs must end in the same state, otherwise the loop counts or accumulates something
+    Registers start = r;
+    LazyFlags startFlags = lazyFlags;
+    u32 ticks = runIdleIteration(window);
+    materializeFlags();
+    Registers first = r;
+    u32 secondTicks = ticks ? runIdleIteration(window) : 0;
+    materializeFlags();
+
+    bool repeats = r.af == first.af && r.bc == first.bc && r.de == first.de && r.hl == first.hl && r.sp == first.sp;
+    if (ticks && secondTicks && !repeats) busyLoops.insert(loopKey);
+    u32 iterations = (ticks && ticks == secondTicks && repeats) ? (window - 1) / ticks : 0;
+    if (iterations == 0) {
+        r = start;
+        lazyFlags = startFlags;
+        // the dry runs cost as much as the real thing, try less often while they keep failing
+        idleLoopBackoff = std::min(idleLoopBackoff * 2 + 1, MAX_IDLE_LOOP_BACKOFF);
+        idleLoopCooldown = idleLoopBackoff;
+        return 0;
+    }
+    idleLoopBackoff = 0;
+
+    // the registers already hold the state after the skipped iterations
+    ticks *= iterations;
+    skipTicks(ticks);
+    idleCyclesSkipped += ticks;
+    return ticks;
 }
 
 void CPU::checkInterrupts() {
@@ -710,34 +1498,138 @@ u16 CPU::popWord() {
 }
 
 void CPU::setFlag(FLAG flag) {
+    materializeFlags();
     r.f |= flag;
 }
 
 void CPU::clearFlag(FLAG flag) {
+    materializeFlags();
     r.f &= ~flag;
 }
 
 bool CPU::isFlagSet(FLAG flag) {
-    return r.f & flag;
+    return computeFlags() & flag;
+}
+
+void CPU::materializeFlags() {
+    if (lazyFlags.op == FLAGS_NONE) return;
+    r.f = computeFlags();
+    lazyFlags.op = FLAGS_NONE;
+}
+
+u8 CPU::computeFlags() {
+    const LazyFlags& l = lazyFlags;
+    u8 zero = (l.result == 0) ? ZERO : 0;
+    switch (l.op) {
+        case FLAGS_ADD:
+            return zero | (((l.result ^ l.rhs ^ l.lhs) & 0x10) ? HALF_CARRY : 0) | ((l.result < l.lhs) ? CARRY : 0);
+        case FLAGS_SUB:
+            return zero | ADD_SUB | (((l.lhs & 0xF) < (l.rhs & 0xF)) ? HALF_CARRY : 0) | ((l.lhs < l.rhs) ? CARRY : 0);
+        case FLAGS_AND:
+            return zero | HALF_CARRY;
+        case FLAGS_LOGIC:
+            return zero;
+        // INC and DEC keep the carry flag, it stays in r.f
+        case FLAGS_INC:
+            return zero | (((l.lhs & 0xF) == 0xF) ? HALF_CARRY : 0) | (r.f & CARRY);
+        case FLAGS_DEC:
+            return zero | ADD_SUB | (((l.lhs & 0xF) == 0) ? HALF_CARRY : 0) | (r.f & CARRY);
+        default:
+            return r.f;
+    }
+}
+
+#ifdef PHOS_LAZY_FLAGS
+void CPU::setAddFlags(u8 lhs, u8 rhs, u8 result) {
+    lazyFlags = {FLAGS_ADD, lhs, rhs, result};
+}
+
+void CPU::setSubFlags(u8 lhs, u8 rhs, u8 result) {
+    lazyFlags = {FLAGS_SUB, lhs, rhs, result};
+}
+
+void CPU::setLogicFlags(u8 result, bool isAnd) {
+    lazyFlags = {isAnd ? FLAGS_AND : FLAGS_LOGIC, 0, 0, result};
+}
+
+void CPU::setIncFlags(u8 value, u8 result) {
+    r.f = computeFlags() & CARRY;
+    lazyFlags = {FLAGS_INC, value, 1, result};
+}
+
+void CPU::setDecFlags(u8 value, u8 result) {
+    r.f = computeFlags() & CARRY;
+    lazyFlags = {FLAGS_DEC, value, 1, result};
+}
+#else
+// without PHOS_LAZY_FLAGS the same operations are evaluated on the spot
+void CPU::setAddFlags(u8 lhs, u8 rhs, u8 result) {
+    lazyFlags = {FLAGS_ADD, lhs, rhs, result};
+    materializeFlags();
+}
+
+void CPU::setSubFlags(u8 lhs, u8 rhs, u8 result) {
+    lazyFlags = {FLAGS_SUB, lhs, rhs, result};
+    materializeFlags();
+}
+
+void CPU::setLogicFlags(u8 result, bool isAnd) {
+    lazyFlags = {isAnd ? FLAGS_AND : FLAGS_LOGIC, 0, 0, result};
+    materializeFlags();
+}
+
+void CPU::setIncFlags(u8 value, u8 result) {
+    lazyFlags = {FLAGS_INC, value, 1, result};
+    materializeFlags();
+}
+
+void CPU::setDecFlags(u8 value, u8 result) {
+    lazyFlags = {FLAGS_DEC, value, 1, result};
+    materializeFlags();
 }
+#endif
 
 u8 CPU::readByte(u16 address) {
     if (address == JOYPAD_ADDRESS) {
         return joypad.readByte();
     } else {
+        // LY and the STAT mode follow the master clock
+        if (address == LCDC_Y_COORDINATE || address == LCDC_STATUS) gpu.sync();
+        // so do DIV and TIMA
+        if (address == 0xFF04) mmu.IO[0x04] = divider(scheduler.now);
+        if (address == 0xFF05) mmu.IO[0x05] = timer();
         return mmu.readByte(address);
     }
 }
 
 void CPU::writeByte(u16 address, u8 value) {
+    // IO and IE writes can schedule events and request interrupts
+    if (address >= 0xFF00 && (address < 0xFF80 || address == 0xFFFF)) fastBlock = false;
+    // the PPU draws everything up to now with the old contents
+    if (isPPUAddress(address)) gpu.sync();
+
     if (address == JOYPAD_ADDRESS) {
         joypad.writeByte(value);
+    } else if (address == 0xFF04) {
+        mmu.writeByte(address, value);
+        dividerOffset = -(u8) (scheduler.now / 0xFF);
+        // resetting the divider can clock the frame sequencer
+        if (apu.isRunning()) scheduler.schedule(EVENT_APU_FRAME, scheduler.now);
+    } else if (address == 0xFF05) {
+        writeTimer(value);
     } else if (address == 0xFF07) {
+        stopTimer();
         u8 currentFreq = mmu.readByte(0xFF07) & (u8) 0x03;
         mmu.writeByte(address, value);
         u8 newFreq = mmu.readByte(0xFF07) & (u8) 0x03;
         if (currentFreq != newFreq) setTimerFreq();
+        startTimer();
+    } else if (address == LCDC_STATUS || address == LY_COMPARE) {
+        mmu.writeByte(address, value);
+        scheduler.schedule(EVENT_PPU_COINCIDENCE, scheduler.now);
     } else if (address >= 0xFF10 && address <= 0xFF26) {
+        // samples up to now use the old register values
+        if (apu.isRunning()) apu.catchUp(scheduler.now);
         u8 type = address & 0xFF;
         switch (type) {
             case CH1_FREQ_HIGH:
@@ -771,6 +1663,10 @@ void CPU::writeByte(u16 address, u8 value) {
         }
         // TODO: R/W
         mmu.writeByte(address, value);
+    } else if (address >= 0xFF30 && address <= 0xFF3F) {
+        // wave pattern RAM
+        if (apu.isRunning()) apu.catchUp(scheduler.now);
+        mmu.writeByte(address, value);
     } else {
         mmu.writeByte(address, value);
     }
@@ -784,24 +1680,39 @@ void CPU::writeWord(u16 address, u16 value) {
     mmu.writeWord(address, value);
 }
 
-u8* CPU::byteRegister(u8 opcode) {
-    return byteRegisterMap[opcode & 0x7];
-}
-
-u16* CPU::wordRegister(u8 opcode) {
-    return shortRegisterMap[opcode & 0x3];
+template<REG8 reg> u8& CPU::reg8() {
+    if constexpr (reg == REG_B) return r.b;
+    else if constexpr (reg == REG_C) return r.c;
+    else if constexpr (reg == REG_D) return r.d;
+    else if constexpr (reg == REG_E) return r.e;
+    else if constexpr (reg == REG_H) return r.h;
+    else if constexpr (reg == REG_L) return r.l;
+    else {
+        static_assert(reg == REG_A, "(HL) is not a register operand");
+        return r.a;
+    }
 }
 
-// TODO: remove these two functions
-void CPU::checkHalfCarry(u8 reg) {
-    ((r.a & 0x0F) < (reg & 0x0F)) ? setFlag(HALF_CARRY) : clearFlag(HALF_CARRY);
+template<REG16 reg> u16& CPU::reg16() {
+    if constexpr (reg == REG_BC) return r.bc;
+    else if constexpr (reg == REG_DE) return r.de;
+    else if constexpr (reg == REG_HL) return r.hl;
+    else if constexpr (reg == REG_SP) return r.sp;
+    else return r.af;
 }
 
-void CPU::checkCarry(u8 reg) {
-    ((r.a & 0xFF) < (reg & 0xFF)) ? setFlag(CARRY) : clearFlag(CARRY);
+template<CONDITION cond> bool CPU::checkCondition() {
+    if constexpr (cond == COND_NZ) return !isFlagSet(ZERO);
+    else if constexpr (cond == COND_Z) return isFlagSet(ZERO);
+    else if constexpr (cond == COND_NC) return !isFlagSet(CARRY);
+    else return isFlagSet(CARRY);
 }
 
 void CPU::serialize(serializer &s) {
+    // RAM contents and bank registers are replaced when a state is loaded
+    if (s.mode() == serializer::Load) flushCodeCache();
+    materializeFlags();
+
     s.integer(r.af);
     s.integer(r.bc);
     s.integer(r.de);
@@ -813,146 +1724,151 @@ void CPU::serialize(serializer &s) {
     s.integer(ticksPerFrame);
     s.integer(halted);
     s.integer(timerCounter);
-    s.integer(dividerCounter);
+    s.integer(delayedOverflow);
+    s.integer(dividerOffset);
+    s.integer(timerBase);
+    s.integer(timerValue);
+    scheduler.serialize(s);
+    // the next tick starts the APU again if its policy wants audio
+    if (s.mode() == serializer::Load) stopAudio();
     s.integer(headless);
     s.integer(runCGBinDMGMode);
     s.integer(doubleSpeedMode);
 }
 
+void CPU::restoreState(const std::vector<u8>& buffer) {
+    arena.restore(buffer);
+    gpu.invalidateTileCache();
+    gpu.invalidateSprites();
+    // RAM blocks were decoded from the old WRAM and HRAM contents
+    flushCodeCache();
+}
+
 // CPU Instructions //
 
-u32 CPU::LD_r_n(const u8& opcode) {
-    u8 n = readByte(r.pc++);
-    u8* reg = byteRegister(opcode >> 3);
-    *reg = n;
+template<REG8 reg> u32 CPU::LD_r_n() {
+    u8 n = fetchByte();
+    reg8<reg>() = n;
     return 8;
 }
 
-u32 CPU::LD_r_r(const u8& opcode) {
-    u8* dest = byteRegister(opcode >> 3);
-    u8* src = byteRegister(opcode);
-    *dest = *src;
+template<REG8 dst, REG8 src> u32 CPU::LD_r_r() {
+    reg8<dst>() = reg8<src>();
     return 4;
 }
 
-u32 CPU::LD_r_HL(const u8& opcode) {
-    u8* reg = byteRegister(opcode >> 3);
-    *reg = readByte(r.hl);
+template<REG8 reg> u32 CPU::LD_r_HL() {
+    reg8<reg>() = readByte(r.hl);
     return 8;
 }
 
-u32 CPU::LD_HL_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    writeByte(r.hl, *reg);
+template<REG8 reg> u32 CPU::LD_HL_r() {
+    writeByte(r.hl, reg8<reg>());
     return 8;
 }
 
-u32 CPU::LD_HL_n(const u8& opcode) {
-    u8 n = readByte(r.pc++);
+u32 CPU::LD_HL_n() {
+    u8 n = fetchByte();
     runPartialInstruction(4);
     writeByte(r.hl, n);
     return 12;
 }
 
-u32 CPU::LD_A_BC(const u8& opcode) {
+u32 CPU::LD_A_BC() {
     r.a = readByte(r.bc);
     return 8;
 }
 
-u32 CPU::LD_A_DE(const u8& opcode) {
+u32 CPU::LD_A_DE() {
     r.a = readByte(r.de);
     return 8;
 }
 
-u32 CPU::LD_A_nn(const u8& opcode) {
-    u16 address = readWord(r.pc);
-    r.pc += 2;
+u32 CPU::LD_A_nn() {
+    u16 address = fetchWord();
     runPartialInstruction(8);
     r.a = readByte(address);
     return 16;
 }
 
-u32 CPU::LD_BC_A(const u8& opcode) {
+u32 CPU::LD_BC_A() {
     writeByte(r.bc, r.a);
     return 8;
 }
 
-u32 CPU::LD_DE_A(const u8& opcode) {
+u32 CPU::LD_DE_A() {
     writeByte(r.de, r.a);
     return 8;
 }
 
-u32 CPU::LD_nn_A(const u8& opcode) {
-    u16 address = readWord(r.pc);
-    r.pc += 2;
+u32 CPU::LD_nn_A() {
+    u16 address = fetchWord();
     runPartialInstruction(8);
     writeByte(address, r.a);
     return 16;
 }
 
-u32 CPU::LD_A_Cff00(const u8& opcode) {
+u32 CPU::LD_A_Cff00() {
     r.a = readByte(0xFF00 + r.c);
     return 8;
 }
 
-u32 CPU::LD_Cff00_A(const u8& opcode) {
+u32 CPU::LD_Cff00_A() {
     writeByte(0xFF00 + r.c, r.a);
     return 8;
 }
 
-u32 CPU::LDD_A_HL(const u8& opcode) {
+u32 CPU::LDD_A_HL() {
     r.a = readByte(r.hl);
     r.hl--;
     return 8;
 }
 
-u32 CPU::LDD_HL_A(const u8& opcode) {
+u32 CPU::LDD_HL_A() {
     writeByte(r.hl, r.a);
     r.hl--;
     return 8;
 }
 
-u32 CPU::LDI_A_HL(const u8& opcode) {
+u32 CPU::LDI_A_HL() {
     r.a = readByte(r.hl);
     r.hl++;
     return 8;
 }
 
-u32 CPU::LDI_HL_A(const u8& opcode) {
+u32 CPU::LDI_HL_A() {
     writeByte(r.hl, r.a);
     r.hl++;
     return 8;
 }
 
-u32 CPU::LD_nff00_A(const u8& opcode) {
-    u16 address = (u16) 0xFF00 + readByte(r.pc++);
+u32 CPU::LD_nff00_A() {
+    u16 address = (u16) 0xFF00 + fetchByte();
     runPartialInstruction(4);
     writeByte(address, r.a);
     return 12;
 }
 
-u32 CPU::LD_A_nff00(const u8& opcode) {
-    u16 address = (u16) 0xFF00 + readByte(r.pc++);
+u32 CPU::LD_A_nff00() {
+    u16 address = (u16) 0xFF00 + fetchByte();
     runPartialInstruction(4);
     r.a = readByte(address);
     return 12;
 }
 
-u32 CPU::LD_r2_nn(const u8& opcode) {
-    u16 nn = readWord(r.pc);
-    r.pc += 2;
-    u16* reg = wordRegister(opcode >> 4);
-    *reg = nn;
+template<REG16 reg> u32 CPU::LD_r2_nn() {
+    u16 nn = fetchWord();
+    reg16<reg>() = nn;
     return 12;
 }
 
-u32 CPU::LD_SP_HL(const u8& opcode) {
+u32 CPU::LD_SP_HL() {
     r.sp = r.hl;
     return 8;
 }
 
-u32 CPU::LD_HL_SPn(const u8& opcode) {
-    u8 n = readByte(r.pc++);
+u32 CPU::LD_HL_SPn() {
+    u8 n = fetchByte();
     char sn = static_cast<char>(n);
     u16 result = r.sp + sn;
 
@@ -966,85 +1882,70 @@ u32 CPU::LD_HL_SPn(const u8& opcode) {
     return 12;
 }
 
-u32 CPU::LD_nn_SP(const u8& opcode) {
-    u16 address = readWord(r.pc);
-    r.pc += 2;
+u32 CPU::LD_nn_SP() {
+    u16 address = fetchWord();
     writeWord(address, r.sp);
     return 20;
 }
 
-u32 CPU::PUSH_r2(const u8& opcode) {
-    u8 opcodeIndex = (opcode >> 4) & 0x3;
-    u16 reg;
-    if (opcodeIndex == 0x3) reg = r.af;
-    else reg = *(wordRegister(opcodeIndex));
-
-    pushWord(reg);
+template<REG16 reg> u32 CPU::PUSH_r2() {
+    if constexpr (reg == REG_AF) materializeFlags();
+    pushWord(reg16<reg>());
     return 16;
 }
 
-u32 CPU::POP_r2(const u8& opcode) {
-    u8 opcodeIndex = (opcode >> 4) & 0x3;
-    u16* reg;
-    if (opcodeIndex == 0x3) reg = &r.af;
-    else reg = wordRegister(opcodeIndex);
-
-    (*reg) = popWord();
-    if (opcodeIndex == 0x3) *reg &= 0xFFF0;
+template<REG16 reg> u32 CPU::POP_r2() {
+    u16& value = reg16<reg>();
+    value = popWord();
+    if constexpr (reg == REG_AF) {
+        value &= 0xFFF0;
+        lazyFlags.op = FLAGS_NONE;
+    }
 
     return 12;
 }
 
-u32 CPU::ADD_A_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    u8 result = r.a + *reg;
+template<REG8 reg> u32 CPU::ADD_A_r() {
+    u8& value = reg8<reg>();
+    u8 result = r.a + value;
 
-    (result == 0) ? setFlag(ZERO) : clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    (((result ^ (*reg) ^ r.a) & 0x10) == 0x10) ? setFlag(HALF_CARRY) : clearFlag(HALF_CARRY);
-    (result < r.a) ? setFlag(CARRY) : clearFlag(CARRY);
+    setAddFlags(r.a, value, result);
 
     r.a = result;
     return 4;
 }
 
-u32 CPU::ADD_A_HL(const u8& opcode) {
+u32 CPU::ADD_A_HL() {
     u8 value = readByte(r.hl);
     u8 result = r.a + value;
 
-    (result == 0) ? setFlag(ZERO) : clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    (((result ^ value ^ r.a) & 0x10) == 0x10) ? setFlag(HALF_CARRY) : clearFlag(HALF_CARRY);
-    (result < r.a) ? setFlag(CARRY) : clearFlag(CARRY);
+    setAddFlags(r.a, value, result);
 
     r.a = result;
     return 8;
 }
 
-u32 CPU::ADD_A_n(const u8& opcode) {
-    u8 value = readByte(r.pc++);
+u32 CPU::ADD_A_n() {
+    u8 value = fetchByte();
     u8 result = r.a + value;
 
-    (result == 0) ? setFlag(ZERO) : clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    (((result ^ value ^ r.a) & 0x10) == 0x10) ? setFlag(HALF_CARRY) : clearFlag(HALF_CARRY);
-    (result < r.a) ? setFlag(CARRY) : clearFlag(CARRY);
+    setAddFlags(r.a, value, result);
 
     r.a = result;
     return 8;
 }
 
-u32 CPU::ADC_A_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
+template<REG8 reg> u32 CPU::ADC_A_r() {
+    u8& value = reg8<reg>();
     u8 carry = isFlagSet(CARRY) ? 1 : 0;
 
-    if (((int)(r.a & 0x0F) + (int)(*reg & 0x0F) + (int)carry) > 0x0F) setFlag(HALF_CARRY);
+    if (((int)(r.a & 0x0F) + (int)(value & 0x0F) + (int)carry) > 0x0F) setFlag(HALF_CARRY);
     else clearFlag(HALF_CARRY);
 
-    if (((int)(r.a & 0xFF) + (int)(*reg & 0xFF) + (int)carry) > 0xFF) setFlag(CARRY);
+    if (((int)(r.a & 0xFF) + (int)(value & 0xFF) + (int)carry) > 0xFF) setFlag(CARRY);
     else clearFlag(CARRY);
 
-    r.a = r.a + *reg + carry;
+    r.a = r.a + value + carry;
 
     (r.a == 0x00) ? setFlag(ZERO) : clearFlag(ZERO);
     clearFlag(ADD_SUB);
@@ -1052,7 +1953,7 @@ u32 CPU::ADC_A_r(const u8& opcode) {
     return 4;
 }
 
-u32 CPU::ADC_A_HL(const u8& opcode) {
+u32 CPU::ADC_A_HL() {
     u8 value = readByte(r.hl);
     u8 carry = isFlagSet(CARRY) ? 1 : 0;
 
@@ -1070,8 +1971,8 @@ u32 CPU::ADC_A_HL(const u8& opcode) {
     return 8;
 }
 
-u32 CPU::ADC_A_n(const u8& opcode) {
-    u8 n = readByte(r.pc++);
+u32 CPU::ADC_A_n() {
+    u8 n = fetchByte();
     u8 carry = isFlagSet(CARRY) ? 1 : 0;
 
     if (((int)(r.a & 0x0F) + (int)(n & 0x0F) + (int)carry) > 0x0F) setFlag(HALF_CARRY);
@@ -1088,45 +1989,36 @@ u32 CPU::ADC_A_n(const u8& opcode) {
     return 8;
 }
 
-u32 CPU::SUB_A_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    u8 result  = r.a - *reg;
-    (result == 0) ? setFlag(ZERO) : clearFlag(ZERO);
-    setFlag(ADD_SUB);
-    checkHalfCarry(*reg);
-    checkCarry(*reg);
+template<REG8 reg> u32 CPU::SUB_A_r() {
+    u8& value = reg8<reg>();
+    u8 result  = r.a - value;
+    setSubFlags(r.a, value, result);
     r.a = result;
     return 4;
 }
 
-u32 CPU::SUB_A_HL(const u8& opcode) {
+u32 CPU::SUB_A_HL() {
     u8 value = readByte(r.hl);
     u8 result = r.a - value;
-    (result == 0) ? setFlag(ZERO) : clearFlag(ZERO);
-    setFlag(ADD_SUB);
-    checkHalfCarry(value);
-    checkCarry(value);
+    setSubFlags(r.a, value, result);
     r.a = result;
     return 8;
 }
 
-u32 CPU::SUB_A_n(const u8& opcode) {
-    u8 value = readByte(r.pc++);
+u32 CPU::SUB_A_n() {
+    u8 value = fetchByte();
     u8 result = r.a - value;
 
-    (result == 0) ? setFlag(ZERO) : clearFlag(ZERO);
-    setFlag(ADD_SUB);
-    checkHalfCarry(value);
-    checkCarry(value);
+    setSubFlags(r.a, value, result);
 
     r.a = result;
 
     return 8;
 }
 
-u32 CPU::SBC_A_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    int un = *reg & 0xFF;
+template<REG8 reg> u32 CPU::SBC_A_r() {
+    u8& value = reg8<reg>();
+    int un = value & 0xFF;
     int tmpa = r.a & 0xFF;
     int ua = tmpa;
 
@@ -1149,7 +2041,7 @@ u32 CPU::SBC_A_r(const u8& opcode) {
     return 4;
 }
 
-u32 CPU::SBC_A_HL(const u8& opcode) {
+u32 CPU::SBC_A_HL() {
     int un = readByte(r.hl) & 0xFF;
     int tmpa = r.a & 0xFF;
     int ua = tmpa;
@@ -1173,8 +2065,8 @@ u32 CPU::SBC_A_HL(const u8& opcode) {
     return 8;
 }
 
-u32 CPU::SBC_A_n(const u8& opcode) {
-    int un = readByte(r.pc++) & 0xFF;
+u32 CPU::SBC_A_n() {
+    int un = fetchByte() & 0xFF;
     int tmpa = r.a & 0xFF;
     int ua = tmpa;
 
@@ -1197,219 +2089,156 @@ u32 CPU::SBC_A_n(const u8& opcode) {
     return 8;
 }
 
-u32 CPU::AND_A_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    r.a &= *reg;
-    if (r.a == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    setFlag(HALF_CARRY);
-    clearFlag(CARRY);
+template<REG8 reg> u32 CPU::AND_A_r() {
+    u8& value = reg8<reg>();
+    r.a &= value;
+    setLogicFlags(r.a, true);
 
     return 4;
 }
 
-u32 CPU::AND_A_HL(const u8& opcode) {
+u32 CPU::AND_A_HL() {
     u8 value = readByte(r.hl);
     r.a &= value;
-    if (r.a == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    setFlag(HALF_CARRY);
-    clearFlag(CARRY);
+    setLogicFlags(r.a, true);
 
     return 8;
 }
 
-u32 CPU::AND_A_n(const u8& opcode) {
-    u8 n = readByte(r.pc++);
+u32 CPU::AND_A_n() {
+    u8 n = fetchByte();
     r.a &= n;
-    (r.a == 0x0) ? setFlag(ZERO) : clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    setFlag(HALF_CARRY);
-    clearFlag(CARRY);
+    setLogicFlags(r.a, true);
     return 8;
 }
 
-u32 CPU::OR_A_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    r.a |= *reg;
-    if (r.a == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    clearFlag(HALF_CARRY);
-    clearFlag(CARRY);
+template<REG8 reg> u32 CPU::OR_A_r() {
+    u8& value = reg8<reg>();
+    r.a |= value;
+    setLogicFlags(r.a, false);
 
     return 4;
 }
 
-u32 CPU::OR_A_HL(const u8& opcode) {
+u32 CPU::OR_A_HL() {
     u8 value = readByte(r.hl);
     r.a |= value;
-    if (r.a == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    clearFlag(HALF_CARRY);
-    clearFlag(CARRY);
+    setLogicFlags(r.a, false);
 
     return 8;
 }
 
-u32 CPU::OR_A_n(const u8& opcode) {
-    u8 n = readByte(r.pc++);
+u32 CPU::OR_A_n() {
+    u8 n = fetchByte();
     r.a |= n;
-    if (r.a == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    clearFlag(HALF_CARRY);
-    clearFlag(CARRY);
+    setLogicFlags(r.a, false);
 
     return 8;
 }
 
-u32 CPU::XOR_A_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    r.a ^= *reg;
-    if (r.a == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    clearFlag(HALF_CARRY);
-    clearFlag(CARRY);
+template<REG8 reg> u32 CPU::XOR_A_r() {
+    u8& value = reg8<reg>();
+    r.a ^= value;
+    setLogicFlags(r.a, false);
 
     return 4;
 }
 
-u32 CPU::XOR_A_HL(const u8& opcode) {
+u32 CPU::XOR_A_HL() {
     u8 value = readByte(r.hl);
     r.a ^= value;
-    if (r.a == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    clearFlag(HALF_CARRY);
-    clearFlag(CARRY);
+    setLogicFlags(r.a, false);
 
     return 8;
 }
 
-u32 CPU::XOR_A_n(const u8& opcode) {
-    u8 n = readByte(r.pc++);
+u32 CPU::XOR_A_n() {
+    u8 n = fetchByte();
     r.a ^= n;
-    if (r.a == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    clearFlag(HALF_CARRY);
-    clearFlag(CARRY);
+    setLogicFlags(r.a, false);
 
     return 8;
 }
 
-u32 CPU::CP_A_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    u8 result = r.a - *reg;
-    if (result == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    setFlag(ADD_SUB);
-    if (r.a < *reg) setFlag(CARRY);
-    else clearFlag(CARRY);
-    if ((r.a & 0xF) < (*reg & 0xF)) setFlag(HALF_CARRY);
-    else clearFlag(HALF_CARRY);
+template<REG8 reg> u32 CPU::CP_A_r() {
+    u8& value = reg8<reg>();
+    u8 result = r.a - value;
+    setSubFlags(r.a, value, result);
 
     return 4;
 }
 
-u32 CPU::CP_A_HL(const u8& opcode) {
+u32 CPU::CP_A_HL() {
     u8 value = readByte(r.hl);
     u8 result = r.a - value;
-    if (result == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    setFlag(ADD_SUB);
-    if (r.a < value) setFlag(CARRY);
-    else clearFlag(CARRY);
-    if ((r.a & 0xF) < (value & 0xF)) setFlag(HALF_CARRY);
-    else clearFlag(HALF_CARRY);
+    setSubFlags(r.a, value, result);
 
     return 8;
 }
 
-u32 CPU::CP_A_n(const u8& opcode) {
-    u8 n = readByte(r.pc++);
+u32 CPU::CP_A_n() {
+    u8 n = fetchByte();
     u8 result = r.a - n;
-    if (result == 0x0) setFlag(ZERO);
-    else clearFlag(ZERO);
-    setFlag(ADD_SUB);
-    if (r.a < n) setFlag(CARRY);
-    else clearFlag(CARRY);
-    if ((r.a & 0xF) < (n & 0xF)) setFlag(HALF_CARRY);
-    else clearFlag(HALF_CARRY);
+    setSubFlags(r.a, n, result);
 
     return 8;
 }
 
-u32 CPU::INC_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode >> 3);
-    u8 result = *reg + 1;
+template<REG8 reg> u32 CPU::INC_r() {
+    u8& value = reg8<reg>();
+    u8 result = value + 1;
 
-    (result == 0) ? setFlag(ZERO) : clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    if ((*reg & 0xF) + 0x1 > 0xF) setFlag(HALF_CARRY);
-    else clearFlag(HALF_CARRY);
-    *reg = result;
+    setIncFlags(value, result);
+    value = result;
 
     return 4;
 }
 
-u32 CPU::INC_HL(const u8& opcode) {
-    u8 result = readByte(r.hl) + 1;
+u32 CPU::INC_HL() {
+    u8 value = readByte(r.hl);
+    u8 result = value + 1;
 
-    (result == 0) ? setFlag(ZERO) : clearFlag(ZERO);
-    clearFlag(ADD_SUB);
-    if ((readByte(r.hl) & 0xF) + 0x1 > 0xF) setFlag(HALF_CARRY);
-    else clearFlag(HALF_CARRY);
+    setIncFlags(value, result);
 
     runPartialInstruction(4);
     writeByte(r.hl, result);
     return 12;
 }
 
-u32 CPU::DEC_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode >> 3);
-    u8 result = *reg - 1;
-    (result == 0) ? setFlag(ZERO) : clearFlag(ZERO);
-    setFlag(ADD_SUB);
-    if ((*reg & 0xF) - 0x1 < 0) setFlag(HALF_CARRY);
-    else clearFlag(HALF_CARRY);
-    *reg = result;
+template<REG8 reg> u32 CPU::DEC_r() {
+    u8& value = reg8<reg>();
+    u8 result = value - 1;
+    setDecFlags(value, result);
+    value = result;
 
     return 4;
 }
 
-u32 CPU::DEC_HL(const u8& opcode) {
-    u8 result = readByte(r.hl) - 1;
+u32 CPU::DEC_HL() {
+    u8 value = readByte(r.hl);
+    u8 result = value - 1;
 
-    (result == 0) ? setFlag(ZERO) : clearFlag(ZERO);
-    setFlag(ADD_SUB);
-    if ((readByte(r.hl) & 0xF) - 0x1 < 0) setFlag(HALF_CARRY);
-    else clearFlag(HALF_CARRY);
+    setDecFlags(value, result);
 
     runPartialInstruction(4);
     writeByte(r.hl, result);
     return 12;
 }
 
-u32 CPU::ADD_HL_r2(const u8& opcode) {
-    u16* reg = wordRegister(opcode >> 4);
-    u16 result = r.hl + *reg;
+template<REG16 reg> u32 CPU::ADD_HL_r2() {
+    u16& value = reg16<reg>();
+    u16 result = r.hl + value;
 
     clearFlag(ADD_SUB);
     (result < r.hl) ? setFlag(CARRY) : clearFlag(CARRY);
-    ((result ^ r.hl ^ (*reg)) & 0x1000) ? setFlag(HALF_CARRY) : clearFlag(HALF_CARRY);
+    ((result ^ r.hl ^ value) & 0x1000) ? setFlag(HALF_CARRY) : clearFlag(HALF_CARRY);
 
     r.hl = result;
     return 8;
 }
 
-u32 CPU::ADD_SP_sn(const u8& opcode) {
-    char sn = static_cast<char>(readByte(r.pc++));
+u32 CPU::ADD_SP_sn() {
+    char sn = static_cast<char>(fetchByte());
     u16 result = r.sp + sn;
 
     clearFlag(ZERO);
@@ -1421,19 +2250,19 @@ u32 CPU::ADD_SP_sn(const u8& opcode) {
     return 16;
 }
 
-u32 CPU::INC_r2(const u8& opcode) {
-    u16* reg = wordRegister(opcode >> 4);
-    (*reg)++;
+template<REG16 reg> u32 CPU::INC_r2() {
+    u16& value = reg16<reg>();
+    value++;
     return 8;
 }
 
-u32 CPU::DEC_r2(const u8& opcode) {
-    u16* reg = wordRegister(opcode >> 4);
-    (*reg)--;
+template<REG16 reg> u32 CPU::DEC_r2() {
+    u16& value = reg16<reg>();
+    value--;
     return 8;
 }
 
-u32 CPU::DAA(const u8& opcode) {
+u32 CPU::DAA() {
     if (!isFlagSet(ADD_SUB)) {
         if (isFlagSet(CARRY) || r.a > 0x99) {
             r.a += 0x60;
@@ -1451,59 +2280,69 @@ u32 CPU::DAA(const u8& opcode) {
     return 4;
 }
 
-u32 CPU::CPL(const u8& opcode) {
+u32 CPU::CPL() {
     r.a ^= 0xFF;
     setFlag(ADD_SUB);
     setFlag(HALF_CARRY);
     return 4;
 }
 
-u32 CPU::CCF(const u8& opcode) {
+u32 CPU::CCF() {
     isFlagSet(CARRY) ? clearFlag(CARRY) : setFlag(CARRY);
     clearFlag(HALF_CARRY);
     clearFlag(ADD_SUB);
     return 4;
 }
 
-u32 CPU::SCF(const u8& opcode) {
+u32 CPU::SCF() {
     setFlag(CARRY);
     clearFlag(HALF_CARRY);
     clearFlag(ADD_SUB);
     return 4;
 }
 
-u32 CPU::NOP(const u8& opcode) {
+u32 CPU::NOP() {
     return 4;
 }
 
-u32 CPU::HALT(const u8& opcode) {
+u32 CPU::HALT() {
     halted = true;
+    fastBlock = false;
     return 4;
 }
 
-u32 CPU::STOP(const u8& opcode) {
+u32 CPU::STOP() {
     halted = true;
+    fastBlock = false;
     if (gbMode == CGB && isBitSet(mmu.IO[0x4D], 0)) {
+        gpu.changeSpeed(!isBitSet(mmu.IO[0x4D], 7));
         doubleSpeedMode = !isBitSet(mmu.IO[0x4D], 7);
+        gpu.scheduleNextEvent();
         mmu.IO[0x4D]--;
         mmu.IO[0x4D] = doubleSpeedMode ? setBit(mmu.IO[0x4D], 7) : clearBit(mmu.IO[0x4D], 7);
         ticksPerFrame = doubleSpeedMode ? (70224 * 2) : 70224;
+        if (apu.isRunning()) {
+            apu.catchUp(scheduler.now);
+            // the frame sequencer compares the other divider bit at the end of this instruction
+            scheduler.schedule(EVENT_APU_FRAME, scheduler.now + 4);
+        }
         apu.reset();
     }
     return 4;
 }
 
-u32 CPU::DI(const u8& opcode) {
+u32 CPU::DI() {
     r.ime = 0;
     return 4;
 }
 
-u32 CPU::EI(const u8& opcode) {
+u32 CPU::EI() {
     r.ime = 1;
+    fastBlock = false;
     return 4;
 }
 
-u32 CPU::RLCA(const u8& opcode) {
+u32 CPU::RLCA() {
     isBitSet(r.a, 7) ? setFlag(CARRY) : clearFlag(CARRY);
 
     r.a <<= 1;
@@ -1516,7 +2355,7 @@ u32 CPU::RLCA(const u8& opcode) {
     return 4;
 }
 
-u32 CPU::RLA(const u8& opcode) {
+u32 CPU::RLA() {
     bool oldCarry = isFlagSet(CARRY);
     isBitSet(r.a, 7) ? setFlag(CARRY) : clearFlag(CARRY);
 
@@ -1530,7 +2369,7 @@ u32 CPU::RLA(const u8& opcode) {
     return 4;
 }
 
-u32 CPU::RRCA(const u8& opcode) {
+u32 CPU::RRCA() {
     isBitSet(r.a, 0) ? setFlag(CARRY) : clearFlag(CARRY);
 
     r.a >>= 1;
@@ -1543,7 +2382,7 @@ u32 CPU::RRCA(const u8& opcode) {
     return 4;
 }
 
-u32 CPU::RRA(const u8& opcode) {
+u32 CPU::RRA() {
     bool oldCarry = isFlagSet(CARRY);
     isBitSet(r.a, 0) ? setFlag(CARRY) : clearFlag(CARRY);
 
@@ -1557,23 +2396,20 @@ u32 CPU::RRA(const u8& opcode) {
     return 4;
 }
 
-u32 CPU::JP_nn(const u8& opcode) {
-    r.pc = readWord(r.pc);
+u32 CPU::JP_nn() {
+    u16 nn = fetchWord();
+    if (nn < r.pc) setLoopHead(nn);
+    r.pc = nn;
     return 16;
 }
 
-u32 CPU::JP_cc_nn(const u8& opcode) {
-    u16 nn = readWord(r.pc);
-    r.pc += 2;
+template<CONDITION cond> u32 CPU::JP_cc_nn() {
+    u16 nn = fetchWord();
 
-    bool jump = false;
-    u8 condition = (opcode >> 3) & 0x3;
-    if (condition == 0x0) jump = !isFlagSet(ZERO);
-    else if (condition == 0x1) jump = isFlagSet(ZERO);
-    else if (condition == 0x2) jump = !isFlagSet(CARRY);
-    else if (condition == 0x3) jump = isFlagSet(CARRY);
+    bool jump = checkCondition<cond>();
 
     if (jump) {
+        if (nn < r.pc) setLoopHead(nn);
         r.pc = nn;
         return 16;
     } else {
@@ -1581,29 +2417,26 @@ u32 CPU::JP_cc_nn(const u8& opcode) {
     }
 }
 
-u32 CPU::JP_HL(const u8& opcode) {
+u32 CPU::JP_HL() {
     r.pc = r.hl;
     return 4;
 }
 
-u32 CPU::JR_sn(const u8& opcode) {
-    char sn = static_cast<char>(readByte(r.pc++));
+u32 CPU::JR_sn() {
+    char sn = static_cast<char>(fetchByte());
+    if (sn < 0) setLoopHead(r.pc + sn);
     r.pc += sn;
 
     return 12;
 }
 
-u32 CPU::JR_cc_sn(const u8& opcode) {
-    char sn = static_cast<char>(readByte(r.pc++));
+template<CONDITION cond> u32 CPU::JR_cc_sn() {
+    char sn = static_cast<char>(fetchByte());
 
-    bool jump = false;
-    u8 condition = (opcode >> 3) & 0x3;
-    if (condition == 0x00) jump = !isFlagSet(ZERO);
-    else if (condition == 0x01) jump = isFlagSet(ZERO);
-    else if (condition == 0x02) jump = !isFlagSet(CARRY);
-    else if (condition == 0x03) jump = isFlagSet(CARRY);
+    bool jump = checkCondition<cond>();
 
     if (jump) {
+        if (sn < 0) setLoopHead(r.pc + sn);
         r.pc += sn;
         return 12;
     } else {
@@ -1611,24 +2444,17 @@ u32 CPU::JR_cc_sn(const u8& opcode) {
     }
 }
 
-u32 CPU::CALL_nn(const u8& opcode) {
-    u16 jumpAddress = readWord(r.pc);
-    r.pc += 2;
+u32 CPU::CALL_nn() {
+    u16 jumpAddress = fetchWord();
     pushWord(r.pc);
     r.pc = jumpAddress;
     return 24;
 }
 
-u32 CPU::CALL_cc_nn(const u8& opcode) {
-    u16 nn = readWord(r.pc);
-    r.pc += 2;
+template<CONDITION cond> u32 CPU::CALL_cc_nn() {
+    u16 nn = fetchWord();
 
-    bool jump = false;
-    u8 condition = (opcode >> 3) & 0x3;
-    if (condition == 0x00) jump = !isFlagSet(ZERO);
-    else if (condition == 0x01) jump = isFlagSet(ZERO);
-    else if (condition == 0x02) jump = !isFlagSet(CARRY);
-    else if (condition == 0x03) jump = isFlagSet(CARRY);
+    bool jump = checkCondition<cond>();
 
     if (jump) {
         pushWord(r.pc);
@@ -1639,26 +2465,20 @@ u32 CPU::CALL_cc_nn(const u8& opcode) {
     }
 }
 
-u32 CPU::RST_n(const u8& opcode) {
-    u8 destination = ((opcode >> 3) & 0x07) * 0x08;
+template<u8 address> u32 CPU::RST_n() {
     pushWord(r.pc);
-    r.pc = destination;
+    r.pc = address;
 
     return 16;
 }
 
-u32 CPU::RET(const u8& opcode) {
+u32 CPU::RET() {
     r.pc = popWord();
     return 16;
 }
 
-u32 CPU::RET_cc(const u8& opcode) {
-    bool jump = false;
-    u8 condition = (opcode >> 3) & 0x03;
-    if (condition == 0x00) jump = !isFlagSet(ZERO);
-    else if (condition == 0x01) jump = isFlagSet(ZERO);
-    else if (condition == 0x02) jump = !isFlagSet(CARRY);
-    else if (condition == 0x03) jump = isFlagSet(CARRY);
+template<CONDITION cond> u32 CPU::RET_cc() {
+    bool jump = checkCondition<cond>();
 
     if (jump) {
         r.pc = popWord();
@@ -1668,29 +2488,30 @@ u32 CPU::RET_cc(const u8& opcode) {
     }
 }
 
-u32 CPU::RETI(const u8& opcode) {
+u32 CPU::RETI() {
     r.ime = 1;
+    fastBlock = false;
     r.pc = popWord();
     return 16;
 }
 
 // CB Instructions //
 
-u32 CPU::RLC_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    isBitSet(*reg, 7) ? setFlag(CARRY) : clearFlag(CARRY);
+template<REG8 reg> u32 CPU::RLC_r() {
+    u8& value = reg8<reg>();
+    isBitSet(value, 7) ? setFlag(CARRY) : clearFlag(CARRY);
 
-    (*reg) <<= 1;
-    (*reg) = isFlagSet(CARRY) ? setBit(*reg, 0) : clearBit(*reg, 0);
+    value <<= 1;
+    value = isFlagSet(CARRY) ? setBit(value, 0) : clearBit(value, 0);
 
-    (*reg == 0) ? setFlag(ZERO) : clearFlag(ZERO);
+    (value == 0) ? setFlag(ZERO) : clearFlag(ZERO);
     clearFlag(ADD_SUB);
     clearFlag(HALF_CARRY);
 
     return 8;
 }
 
-u32 CPU::RLC_HL(const u8& opcode) {
+u32 CPU::RLC_HL() {
     runPartialInstruction(4);
     u8 value = readByte(r.hl);
     isBitSet(value, 7) ? setFlag(CARRY) : clearFlag(CARRY);
@@ -1707,23 +2528,23 @@ u32 CPU::RLC_HL(const u8& opcode) {
     return 16;
 }
 
-u32 CPU::RL_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
+template<REG8 reg> u32 CPU::RL_r() {
+    u8& value = reg8<reg>();
 
     bool oldCarry = isFlagSet(CARRY);
-    isBitSet(*reg, 7) ? setFlag(CARRY) : clearFlag(CARRY);
+    isBitSet(value, 7) ? setFlag(CARRY) : clearFlag(CARRY);
 
-    (*reg) <<= 1;
-    (*reg) = oldCarry ? setBit(*reg, 0) : clearBit(*reg, 0);
+    value <<= 1;
+    value = oldCarry ? setBit(value, 0) : clearBit(value, 0);
 
-    (*reg == 0) ? setFlag(ZERO) : clearFlag(ZERO);
+    (value == 0) ? setFlag(ZERO) : clearFlag(ZERO);
     clearFlag(ADD_SUB);
     clearFlag(HALF_CARRY);
 
     return 8;
 }
 
-u32 CPU::RL_HL(const u8& opcode) {
+u32 CPU::RL_HL() {
     runPartialInstruction(4);
     u8 value = readByte(r.hl);
 
@@ -1742,21 +2563,21 @@ u32 CPU::RL_HL(const u8& opcode) {
     return 16;
 }
 
-u32 CPU::RRC_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
+template<REG8 reg> u32 CPU::RRC_r() {
+    u8& value = reg8<reg>();
 
-    isBitSet(*reg, 0) ? setFlag(CARRY) : clearFlag(CARRY);
-    *reg >>= 1;
-    *reg = isFlagSet(CARRY) ? setBit(*reg, 7) : clearBit(*reg, 7);
+    isBitSet(value, 0) ? setFlag(CARRY) : clearFlag(CARRY);
+    value >>= 1;
+    value = isFlagSet(CARRY) ? setBit(value, 7) : clearBit(value, 7);
 
-    (*reg == 0) ? setFlag(ZERO) : clearFlag(ZERO);
+    (value == 0) ? setFlag(ZERO) : clearFlag(ZERO);
     clearFlag(ADD_SUB);
     clearFlag(HALF_CARRY);
 
     return 8;
 }
 
-u32 CPU::RRC_HL(const u8& opcode) {
+u32 CPU::RRC_HL() {
     runPartialInstruction(4);
     u8 value = readByte(r.hl);
 
@@ -1773,23 +2594,23 @@ u32 CPU::RRC_HL(const u8& opcode) {
     return 16;
 }
 
-u32 CPU::RR_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
+template<REG8 reg> u32 CPU::RR_r() {
+    u8& value = reg8<reg>();
 
     bool oldCarry = isFlagSet(CARRY);
-    isBitSet(*reg, 0) ? setFlag(CARRY) : clearFlag(CARRY);
+    isBitSet(value, 0) ? setFlag(CARRY) : clearFlag(CARRY);
 
-    *reg >>= 1;
-    *reg = oldCarry ? setBit(*reg, 7) : clearBit(*reg, 7);
+    value >>= 1;
+    value = oldCarry ? setBit(value, 7) : clearBit(value, 7);
 
-    (*reg == 0) ? setFlag(ZERO) : clearFlag(ZERO);
+    (value == 0) ? setFlag(ZERO) : clearFlag(ZERO);
     clearFlag(ADD_SUB);
     clearFlag(HALF_CARRY);
 
     return 8;
 }
 
-u32 CPU::RR_HL(const u8& opcode) {
+u32 CPU::RR_HL() {
     runPartialInstruction(4);
     u8 value = readByte(r.hl);
 
@@ -1808,20 +2629,20 @@ u32 CPU::RR_HL(const u8& opcode) {
     return 16;
 }
 
-u32 CPU::SLA_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    isBitSet(*reg, 7) ? setFlag(CARRY) : clearFlag(CARRY);
+template<REG8 reg> u32 CPU::SLA_r() {
+    u8& value = reg8<reg>();
+    isBitSet(value, 7) ? setFlag(CARRY) : clearFlag(CARRY);
 
-    *reg <<= 1;
+    value <<= 1;
 
-    (*reg == 0) ? setFlag(ZERO) : clearFlag(ZERO);
+    (value == 0) ? setFlag(ZERO) : clearFlag(ZERO);
     clearFlag(ADD_SUB);
     clearFlag(HALF_CARRY);
 
     return 8;
 }
 
-u32 CPU::SLA_HL(const u8& opcode) {
+u32 CPU::SLA_HL() {
     runPartialInstruction(4);
     u8 value = readByte(r.hl);
     isBitSet(value, 7) ? setFlag(CARRY) : clearFlag(CARRY);
@@ -1837,23 +2658,23 @@ u32 CPU::SLA_HL(const u8& opcode) {
     return 16;
 }
 
-u32 CPU::SRA_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    isBitSet(*reg, 0) ? setFlag(CARRY) : clearFlag(CARRY);
+template<REG8 reg> u32 CPU::SRA_r() {
+    u8& value = reg8<reg>();
+    isBitSet(value, 0) ? setFlag(CARRY) : clearFlag(CARRY);
 
     // the value of bit 7 stays the same
-    u8 oldBit7 = *reg & 0x80;
-    *reg >>= 1;
-    *reg |= oldBit7;
+    u8 oldBit7 = value & 0x80;
+    value >>= 1;
+    value |= oldBit7;
 
-    (*reg == 0) ? setFlag(ZERO) : clearFlag(ZERO);
+    (value == 0) ? setFlag(ZERO) : clearFlag(ZERO);
     clearFlag(ADD_SUB);
     clearFlag(HALF_CARRY);
 
     return 8;
 }
 
-u32 CPU::SRA_HL(const u8& opcode) {
+u32 CPU::SRA_HL() {
     runPartialInstruction(4);
     u8 value = readByte(r.hl);
     isBitSet(value, 0) ? setFlag(CARRY) : clearFlag(CARRY);
@@ -1872,22 +2693,22 @@ u32 CPU::SRA_HL(const u8& opcode) {
     return 16;
 }
 
-u32 CPU::SRL_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    isBitSet(*reg, 0) ? setFlag(CARRY) : clearFlag(CARRY);
+template<REG8 reg> u32 CPU::SRL_r() {
+    u8& value = reg8<reg>();
+    isBitSet(value, 0) ? setFlag(CARRY) : clearFlag(CARRY);
 
     // the value of bit 7 is reset
-    (*reg) >>= 1;
-    (*reg) = clearBit(*reg, 7);
+    value >>= 1;
+    value = clearBit(value, 7);
 
-    (*reg == 0) ? setFlag(ZERO) : clearFlag(ZERO);
+    (value == 0) ? setFlag(ZERO) : clearFlag(ZERO);
     clearFlag(ADD_SUB);
     clearFlag(HALF_CARRY);
 
     return 8;
 }
 
-u32 CPU::SRL_HL(const u8& opcode) {
+u32 CPU::SRL_HL() {
     runPartialInstruction(4);
     u8 value = readByte(r.hl);
     isBitSet(value, 0) ? setFlag(CARRY) : clearFlag(CARRY);
@@ -1905,12 +2726,11 @@ u32 CPU::SRL_HL(const u8& opcode) {
     return 16;
 }
 
-u32 CPU::BIT_b_r(const u8& opcode) {
+template<u8 bit, REG8 reg> u32 CPU::BIT_b_r() {
     runPartialInstruction(4);
-    u8 bit = (opcode >> 3) & 0x07;
-    u8* reg = byteRegister(opcode);
+    u8& value = reg8<reg>();
 
-    if (!isBitSet(*reg, bit)) setFlag(ZERO);
+    if (!isBitSet(value, bit)) setFlag(ZERO);
     else clearFlag(ZERO);
     setFlag(HALF_CARRY);
     clearFlag(ADD_SUB);
@@ -1918,9 +2738,8 @@ u32 CPU::BIT_b_r(const u8& opcode) {
     return 8;
 }
 
-u32 CPU::BIT_b_HL(const u8& opcode) {
+template<u8 bit> u32 CPU::BIT_b_HL() {
     runPartialInstruction(4);
-    u8 bit = (opcode >> 3) & 0x07;
     u8 value = readByte(r.hl);
 
     (!isBitSet(value, bit)) ? setFlag(ZERO) : clearFlag(ZERO);
@@ -1930,55 +2749,51 @@ u32 CPU::BIT_b_HL(const u8& opcode) {
     return 12;
 }
 
-u32 CPU::SET_b_r(const u8& opcode) {
-    u8 bitPos = (opcode >> 3) & 0x07;
-    u8* reg = byteRegister(opcode);
+template<u8 bit, REG8 reg> u32 CPU::SET_b_r() {
+    u8& value = reg8<reg>();
 
-    *reg = setBit(*reg, bitPos);
+    value = setBit(value, bit);
 
     return 8;
 }
 
-u32 CPU::SET_b_HL(const u8& opcode) {
+template<u8 bit> u32 CPU::SET_b_HL() {
     runPartialInstruction(4);
-    u8 bitPos = (opcode >> 3) & 0x07;
     u8 value = readByte(r.hl);
 
-    value = setBit(value, bitPos);
+    value = setBit(value, bit);
 
     runPartialInstruction(4);
     writeByte(r.hl, value);
     return 16;
 }
 
-u32 CPU::RES_b_r(const u8& opcode) {
-    u8 bitPos = (opcode >> 3) & 0x7;
-    u8* reg = byteRegister(opcode);
+template<u8 bit, REG8 reg> u32 CPU::RES_b_r() {
+    u8& value = reg8<reg>();
 
-    *reg = clearBit(*reg, bitPos);
+    value = clearBit(value, bit);
 
     return 8;
 }
 
-u32 CPU::RES_b_HL(const u8& opcode) {
+template<u8 bit> u32 CPU::RES_b_HL() {
     runPartialInstruction(4);
-    u8 bitPos = (opcode >> 3) & 0x07;
     u8 value = readByte(r.hl);
 
-    value = clearBit(value, bitPos);
+    value = clearBit(value, bit);
 
     runPartialInstruction(4);
     writeByte(r.hl, value);
     return 16;
 }
 
-u32 CPU::SWAP_r(const u8& opcode) {
-    u8* reg = byteRegister(opcode);
-    u8 low = *reg & 0x0F;
-    u8 high = *reg & 0xF0;
-    *reg = (low << 4) | (high >> 4);
+template<REG8 reg> u32 CPU::SWAP_r() {
+    u8& value = reg8<reg>();
+    u8 low = value & 0x0F;
+    u8 high = value & 0xF0;
+    value = (low << 4) | (high >> 4);
 
-    (*reg == 0x0) ? setFlag(ZERO) : clearFlag(ZERO);
+    (value == 0x0) ? setFlag(ZERO) : clearFlag(ZERO);
     clearFlag(ADD_SUB);
     clearFlag(HALF_CARRY);
     clearFlag(CARRY);
@@ -1986,7 +2801,7 @@ u32 CPU::SWAP_r(const u8& opcode) {
     return 8;
 }
 
-u32 CPU::SWAP_HL(const u8& opcode) {
+u32 CPU::SWAP_HL() {
     runPartialInstruction(4);
     u8 value = readByte(r.hl);
     u8 low = value & 0x0F;
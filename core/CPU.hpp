@@ -1,11 +1,20 @@
 #ifndef PHOS_CPU_HPP
 #define PHOS_CPU_HPP
 
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
 #include "Common.hpp"
+#include "Scheduler.hpp"
+#include "Policy.hpp"
 #include "MMU.hpp"
 #include "GPU.hpp"
 #include "Joypad.hpp"
 #include "APU.hpp"
+#include "JIT.hpp"
+#include "Recomp.hpp"
 
 // addresses of interrupt service routines
 constexpr u16 INTERRUPT_VBLANK = 0x40;
@@ -14,11 +23,15 @@ constexpr u16 INTERRUPT_TIMER = 0x50;
 constexpr u16 INTERRUPT_SERIAL = 0x58;
 constexpr u16 INTERRUPT_JOYPAD = 0x60;
 
-enum GB_MODE { DMG, CGB };
-
 // bitmasks for flags stored in lower 8bit of AF register
 enum FLAG { ZERO = 0x80, ADD_SUB = 0x40, HALF_CARRY = 0x20, CARRY = 0x10 };
 
+// register and condition operands as they are encoded in the opcodes
+// (HL) has its own handlers so 8bit index 6 is left out, AF is only used by PUSH and POP
+enum REG8 { REG_B = 0, REG_C = 1, REG_D = 2, REG_E = 3, REG_H = 4, REG_L = 5, REG_A = 7 };
+enum REG16 { REG_BC, REG_DE, REG_HL, REG_SP, REG_AF };
+enum CONDITION { COND_NZ, COND_Z, COND_NC, COND_C };
+
 // first four registers can be accessed as one 16bit or two separate 8bit registers
 typedef struct Registers {
     union {
@@ -64,6 +77,9 @@ typedef struct Registers {
 class CPU {
 public:
     Registers r;
+    Scheduler scheduler;
+    // memory of the MMU and GPU, constructed before them
+    StateArena arena;
     MMU mmu;
     GPU gpu;
     Joypad joypad;
@@ -71,20 +87,33 @@ public:
 
     GB_MODE gbMode;
 
+    // length of the last tick, including interrupt dispatch
     u32 cycles;
     int ticksPerFrame;
     bool halted;
+    // cycles until TIMA increments while the timer is stopped
     int timerCounter;
-    int dividerCounter;
 
     bool headless;
     bool runCGBinDMGMode;
     bool doubleSpeedMode;
+    // run straight-line code a block at a time from pre-decoded instructions
+    bool cachedInterpreter;
+    // compile hot ROM blocks to native code, turn off for debugging
+    bool jitEnabled;
+    // run copy and fill loops as one memcpy or memset
+    bool memoryLoopDetection;
+    // skip iterations of loops that only poll memory while nothing can change it
+    bool idleLoopDetection;
+    // emulated cycles skipped by the idle loop detection since the last reset
+    size_t idleCyclesSkipped;
 public:
     CPU();
     bool init(std::string& romPath);
     void reset();
+    // runs Policy::NoAudio on headless instances and Policy::Accurate otherwise
     u32 tick();
+    template<class P> u32 tick();
     void requestInterrupt(u8 interrupt);
     void handleInputDown(u8 key);
     void handleInputUp(u8 key);
@@ -94,163 +123,325 @@ public:
     u16 readWord(u16 address);
     void writeWord(u16 address, u16 value);
 
+    void invalidateCode(u16 address);
+    void flushCodeCache();
+    bool loadRecompiledCode(std::string& path);
+    // writes pending lazy flags back into r.f, call before reading r.f or r.af directly
+    void materializeFlags();
+
     void serialize(hak::serializer& s);
+    // copies a snapshot of the arena back and drops everything cached from its old contents
+    void restoreState(const std::vector<u8>& buffer);
 private:
     bool isExecutingInstruction;
     u32 partialTicks;
+    // master clock before the last advance, the APU catches up to it before a frame sequencer step
+    u64 stepStart;
+    // TIMA overflowed right before the timer was stopped, the reload follows when it starts again
+    bool delayedOverflow;
+    // DIV counts the master clock in steps of 0xFF cycles, resetting it moves this offset
+    u8 dividerOffset;
+    // TIMA was timerValue at timerBase and increments every period after it while the timer runs
+    u64 timerBase;
+    u8 timerValue;
+
+    typedef u32 (CPU::*Instruction)();
+    typedef std::array<Instruction, 256> InstructionTable;
+    static const InstructionTable instructions;
+    static const InstructionTable instructionsCB;
+
+    // the operands are copied out of memory when the block is decoded
+    struct DecodedInstruction {
+        Instruction instruction;
+        u16 address;
+        u8 opcode;
+        u8 opcodeLength;
+        u8 operands[2];
+    };
+    // straight-line run of instructions that ends at the first unconditional jump
+    struct CodeBlock {
+        u16 start;
+        u16 end;
+        // length of the block if every instruction in it runs and every branch is taken
+        u32 cycles;
+        std::vector<DecodedInstruction> instructions;
+        // compiled with and without sub-instruction timing
+        JIT::Block native[2];
+        u32 executions;
+    };
+    // ROM blocks are keyed by bank and address, RAM blocks by their offset into WRAM and HRAM
+    std::unordered_map<u32, CodeBlock> romBlocks;
+    std::unordered_map<u32, CodeBlock> ramBlocks;
+    // number of RAM blocks touching each 256 byte page, used to filter writes
+    std::vector<u16> ramCodePages;
+    CodeBlock* currentBlock;
+    const u8* operands;
+
+    JIT jit;
+    u32 blockCycles;
+    bool blockVBlank;
+    // no event is due before the running block ends and no interrupt is waiting, its steps only
+    // move the clock until an IO write or an instruction that changes IME or halts clears this
+    bool fastBlock;
+    typedef std::array<JIT::Step, 256> StepTable;
+    // indexed with Policy::subInstructionTiming first
+    static const std::array<StepTable, 2> steps;
+    static const std::array<StepTable, 2> stepsCB;
+
+    // operands and result of the last ALU operation, Z/N/H/C are computed from them only when read
+    enum FLAG_OP : u8 { FLAGS_NONE, FLAGS_ADD, FLAGS_SUB, FLAGS_AND, FLAGS_LOGIC, FLAGS_INC, FLAGS_DEC };
+    struct LazyFlags {
+        FLAG_OP op;
+        u8 lhs;
+        u8 rhs;
+        u8 result;
+    };
+    LazyFlags lazyFlags;
+
+    // target and end of the last backward jump, the loop detection looks at it when it is reached
+    u16 loopHead;
+    u16 loopEnd;
+    // bank and address of the loop like the keys of romBlocks
+    u32 loopKey;
+    // loop visits to let pass before the next try after failed ones
+    u32 idleLoopBackoff;
+    u32 idleLoopCooldown;
+    // ROM loops that do more than poll memory
+    std::unordered_set<u32> busyLoops;
+
+    // copy and fill loops ending in JR NZ with an 8bit counter or BC tested with LD A,B / OR C
+    enum MEMORY_LOOP : u8 {
+        MEMORY_LOOP_NONE,
+        MEMORY_LOOP_FILL,       // LD (HL+/-),A
+        MEMORY_LOOP_COPY_TO_HL, // LD A,(DE); LD (HL+/-),A; INC DE
+        MEMORY_LOOP_COPY_TO_DE  // LD A,(HL+); LD (DE),A; INC DE
+    };
+    struct MemoryLoop {
+        MEMORY_LOOP kind;
+        // HL moves by this after every byte
+        int step;
+        bool wideCounter;
+        u8 counter;
+        u32 ticks;
+    };
+    std::unordered_map<u32, MemoryLoop> memoryLoops;
 
-    u8*  byteRegisterMap[8]  = {nullptr};
-    u16* shortRegisterMap[4] = {nullptr};
-
-    typedef u32 (CPU::*Instruction)(const u8& opcode);
-    Instruction instructions[256]   = {nullptr};
-    Instruction instructionsCB[256] = {nullptr};
+    RecompiledCode recompiled;
+    // stands in for the running recompiled block so bank switches can leave it
+    CodeBlock recompiledBlock;
+    // indexed with Policy::subInstructionTiming like the step tables
+    static const std::array<RecompHost, 2> recompHosts;
 private:
+    static constexpr InstructionTable buildInstructionTable();
+    static constexpr InstructionTable buildInstructionTableCB();
+
+    u32 execute(u8 opcode);
+    u32 executeCB(u8 opcode);
+    template<u8 opcode> u32 executeOpcode();
+    template<u8 opcode> u32 executeOpcodeCB();
+    u32 finishInstruction(u32 ticks);
+
     void setFlag(FLAG flag);
     void clearFlag(FLAG flag);
     bool isFlagSet(FLAG flag);
+    u8 computeFlags();
+    void setAddFlags(u8 lhs, u8 rhs, u8 result);
+    void setSubFlags(u8 lhs, u8 rhs, u8 result);
+    void setLogicFlags(u8 result, bool isAnd);
+    void setIncFlags(u8 value, u8 result);
+    void setDecFlags(u8 value, u8 result);
 
     void checkInterrupts();
-    void updateTimer(u32 ticks);
+    void advance(u32 ticks);
+    void runEvents();
+    u8 divider(u64 timestamp);
+    u8 timer();
+    void writeTimer(u8 value);
+    void reloadTimer(u64 timestamp);
+    void rebaseTimer(u64 timestamp);
+    void scheduleTimerOverflow();
+    void stopTimer();
+    void startTimer();
     void setTimerFreq();
+    int timerPeriod();
+    u32 ticksUntilTimerChange(u16 address);
+    void scheduleFrameSequencer(u64 timestamp);
+    void startAudio();
+    void stopAudio();
+    u32 ticksUntilNextEvent();
+    void skipTicks(u32 ticks);
+    u32 fastForwardHalt();
+    void setLoopHead(u16 head);
+    u32 runLoop();
+    MemoryLoop matchMemoryLoop(u16 head, u16 end);
+    u8& counterRegister(u8 reg);
+    u32 runMemoryLoop();
+    int memoryOperand(u8 opcode, bool isCB);
+    u32 runIdleIteration(u32& window);
+    u32 skipIdleLoop();
 
     void runPartialInstruction(u32 ticks);
 
+    u8 fetchCode(u16 address);
+    u8 fetchByte();
+    u16 fetchWord();
+
+    CodeBlock* findCodeBlock(u16 address);
+    CodeBlock decodeBlock(u16 address, u16 end);
+    int codeRAMOffset(u16 address);
+    void updateCodePages(u32 offset, const CodeBlock& block, int delta);
+
+    template<class P> u32 runBlock();
+    template<class P> u32 runRecompiledBlock();
+    bool canRunFast(u32 ticks);
+    static void enterBlock(CPU* cpu, u32 cycles);
+    bool finishBlockStep(u32 ticks, u16 nextPc);
+    static bool enterRecompiledBlock(CPU* cpu, u32 cycles);
+    void syncRecompiledBlock(u32 elapsed);
+    static u8 readInBlock(CPU* cpu, u16 address, u32 elapsed);
+    static u16 readWordInBlock(CPU* cpu, u16 address, u32 elapsed);
+    static bool writeInBlock(CPU* cpu, u16 address, u8 value, u32 elapsed);
+    static bool writeWordInBlock(CPU* cpu, u16 address, u16 value, u32 elapsed);
+    static void loopInBlock(CPU* cpu, u16 head, u16 end);
+    static void leaveRecompiledBlock(CPU* cpu, u32 ticks, u32 last);
+    template<bool timing, size_t... opcodes> static constexpr StepTable buildStepTable(std::index_sequence<opcodes...>);
+    template<bool timing, size_t... opcodes> static constexpr StepTable buildStepTableCB(std::index_sequence<opcodes...>);
+    template<u8 opcode, bool timing> static bool step(CPU* cpu, const u8* operands, u16 nextPc);
+    template<u8 opcode, bool timing> static bool stepCB(CPU* cpu, const u8* operands, u16 nextPc);
+
     void pushByte(u8 value);
     void pushWord(u16 value);
     u8 popByte();
     u16 popWord();
-    u8* byteRegister(u8 opcode);
-    u16* wordRegister(u8 opcode);
-
-    void checkHalfCarry(u8 reg);
-    void checkCarry(u8 reg);
+    template<REG8 reg> u8& reg8();
+    template<REG16 reg> u16& reg16();
+    template<CONDITION cond> bool checkCondition();
 
     // Z80 Instructions //
 
-    u32 LD_r_n(const u8& opcode);       // 0x06, 0x0E, 0x16, 0x1E, 0x26, 0x2E, 0x3E
-    u32 LD_r_r(const u8& opcode);       // 0x7F, 0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7D
-                                        // 0x40, 0x41, 0x42, 0x43, 0x44, 0x45
-                                        // 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D
-                                        // 0x50, 0x51, 0x52, 0x53, 0x54, 0x55
-                                        // 0x58, 0x59, 0x5A, 0x5B, 0x5C, 0x5D
-                                        // 0x60, 0x61, 0x62, 0x63, 0x64, 0x65
-                                        // 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D
-                                        // 0x47, 0x4F, 0x57, 0x5F, 0x67, 0x6F
-    u32 LD_r_HL(const u8& opcode);      // 0x7E, 0x46, 0x4E, 0x56, 0x5E, 0x66, 0x6E
-    u32 LD_HL_r(const u8& opcode);      // 0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x77
-    u32 LD_HL_n(const u8& opcode);      // 0x36
-    u32 LD_A_BC(const u8& opcode);      // 0x0A
-    u32 LD_A_DE(const u8& opcode);      // 0x1A
-    u32 LD_A_nn(const u8& opcode);      // 0xFA
-    u32 LD_BC_A(const u8& opcode);      // 0x02
-    u32 LD_DE_A(const u8& opcode);      // 0x12
-    u32 LD_nn_A(const u8& opcode);      // 0xEA
-    u32 LD_A_Cff00(const u8& opcode);   // 0xF2
-    u32 LD_Cff00_A(const u8& opcode);   // 0xE2
-    u32 LDD_A_HL(const u8& opcode);     // 0x3A
-    u32 LDD_HL_A(const u8& opcode);     // 0x32
-    u32 LDI_A_HL(const u8& opcode);     // 0x2A
-    u32 LDI_HL_A(const u8& opcode);     // 0x22
-    u32 LD_nff00_A(const u8& opcode);   // 0xE0
-    u32 LD_A_nff00(const u8& opcode);   // 0xF0
-
-    u32 LD_r2_nn(const u8& opcode);     // 0x01, 0x11, 0x21, 0x31
-    u32 LD_SP_HL(const u8& opcode);     // 0xF9
-    u32 LD_HL_SPn(const u8& opcode);    // 0xF8
-    u32 LD_nn_SP(const u8& opcode);     // 0x08
-    u32 PUSH_r2(const u8& opcode);      // 0xF5, 0xC5, 0xD5, 0xE5
-    u32 POP_r2(const u8& opcode);       // 0xF1, 0xC1, 0xD1, 0xE1
-
-    u32 ADD_A_r(const u8& opcode);      // 0x87, 0x80, 0x81, 0x82, 0x83, 0x84, 0x85
-    u32 ADD_A_HL(const u8& opcode);     // 0x86
-    u32 ADD_A_n(const u8& opcode);      // 0xC6
-    u32 ADC_A_r(const u8& opcode);      // 0x8F, 0x88, 0x89, 0x8A, 0x8B, 0x8C, 0x8D
-    u32 ADC_A_HL(const u8& opcode);     // 0x8E
-    u32 ADC_A_n(const u8& opcode);      // 0xCE
-    u32 SUB_A_r(const u8& opcode);      // 0x97, 0x90, 0x91, 0x92, 0x93, 0x94, 0x95
-    u32 SUB_A_HL(const u8& opcode);     // 0x96
-    u32 SUB_A_n(const u8& opcode);      // 0xD6
-    u32 SBC_A_r(const u8& opcode);      // 0x9F, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D
-    u32 SBC_A_HL(const u8& opcode);     // 0x9E
-    u32 SBC_A_n(const u8& opcode);      // 0xDE
-    u32 AND_A_r(const u8& opcode);      // 0xA7, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5
-    u32 AND_A_HL(const u8& opcode);     // 0xA6
-    u32 AND_A_n(const u8& opcode);      // 0xE6
-    u32 OR_A_r(const u8& opcode);       // 0xB7, 0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5
-    u32 OR_A_HL(const u8& opcode);      // 0xB6
-    u32 OR_A_n(const u8& opcode);       // 0xF6
-    u32 XOR_A_r(const u8& opcode);      // 0xAF, 0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD
-    u32 XOR_A_HL(const u8& opcode);     // 0xAE
-    u32 XOR_A_n(const u8& opcode);      // 0xEE
-    u32 CP_A_r(const u8& opcode);       // 0xBF, 0xB8, 0xB9, 0xBA, 0xBB, 0xBC, 0xBD
-    u32 CP_A_HL(const u8& opcode);      // 0xBE
-    u32 CP_A_n(const u8& opcode);       // 0xFE
-    u32 INC_r(const u8& opcode);        // 0x3C, 0x04, 0x0C, 0x14, 0x1C, 0x24, 0x2C
-    u32 INC_HL(const u8& opcode);       // 0x34
-    u32 DEC_r(const u8& opcode);        // 0x3D, 0x05, 0x0D, 0x15, 0x1D, 0x25, 0x2D
-    u32 DEC_HL(const u8& opcode);       // 0x35
-
-    u32 ADD_HL_r2(const u8& opcode);    // 0x09, 0x19, 0x29, 0x39
-    u32 ADD_SP_sn(const u8& opcode);    // 0xE8
-    u32 INC_r2(const u8& opcode);       // 0x03, 0x13, 0x23, 0x33
-    u32 DEC_r2(const u8& opcode);       // 0x0B, 0x1B, 0x2B, 0x3B
-
-    u32 DAA(const u8& opcode);          // 0x27
-    u32 CPL(const u8& opcode);          // 0x2F
-    u32 CCF(const u8& opcode);          // 0x3F
-    u32 SCF(const u8& opcode);          // 0x37
-    u32 NOP(const u8& opcode);          // 0x00
-    u32 HALT(const u8& opcode);         // 0x76
-    u32 STOP(const u8& opcode);         // 0x10 0x00
-    u32 DI(const u8& opcode);           // 0xF3
-    u32 EI(const u8& opcode);           // 0xFB
-
-    u32 RLCA(const u8& opcode);         // 0x07
-    u32 RLA(const u8& opcode);          // 0x17
-    u32 RRCA(const u8& opcode);         // 0x0F;
-    u32 RRA(const u8& opcode);          // 0x1F
-
-    u32 JP_nn(const u8& opcode);        // 0xC3
-    u32 JP_cc_nn(const u8& opcode);     // 0xC2, 0xCA, 0xD2, 0xDA
-    u32 JP_HL(const u8& opcode);        // 0xE9
-    u32 JR_sn(const u8& opcode);        // 0x18
-    u32 JR_cc_sn(const u8& opcode);     // 0x20, 0x28, 0x30, 0x38
-
-    u32 CALL_nn(const u8& opcode);      // 0xCD
-    u32 CALL_cc_nn(const u8& opcode);   // 0xC4, 0xCC, 0xD4, 0xDC
-
-    u32 RST_n(const u8& opcode);        // 0xC7, 0xCF, 0xD7, 0xDF, 0xE7, 0xEF, 0xF7, 0xFF
-    u32 RET(const u8& opcode);          // 0xC9
-    u32 RET_cc(const u8& opcode);       // 0xC0, 0xC8, 0xD0, 0xD8
-    u32 RETI(const u8& opcode);         // 0xD9
+    template<REG8 reg> u32 LD_r_n();            // 0x06, 0x0E, 0x16, 0x1E, 0x26, 0x2E, 0x3E
+    template<REG8 dst, REG8 src> u32 LD_r_r();  // 0x7F, 0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7D
+                                                // 0x40, 0x41, 0x42, 0x43, 0x44, 0x45
+                                                // 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D
+                                                // 0x50, 0x51, 0x52, 0x53, 0x54, 0x55
+                                                // 0x58, 0x59, 0x5A, 0x5B, 0x5C, 0x5D
+                                                // 0x60, 0x61, 0x62, 0x63, 0x64, 0x65
+                                                // 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D
+                                                // 0x47, 0x4F, 0x57, 0x5F, 0x67, 0x6F
+    template<REG8 reg> u32 LD_r_HL();           // 0x7E, 0x46, 0x4E, 0x56, 0x5E, 0x66, 0x6E
+    template<REG8 reg> u32 LD_HL_r();           // 0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x77
+    u32 LD_HL_n();                              // 0x36
+    u32 LD_A_BC();                              // 0x0A
+    u32 LD_A_DE();                              // 0x1A
+    u32 LD_A_nn();                              // 0xFA
+    u32 LD_BC_A();                              // 0x02
+    u32 LD_DE_A();                              // 0x12
+    u32 LD_nn_A();                              // 0xEA
+    u32 LD_A_Cff00();                           // 0xF2
+    u32 LD_Cff00_A();                           // 0xE2
+    u32 LDD_A_HL();                             // 0x3A
+    u32 LDD_HL_A();                             // 0x32
+    u32 LDI_A_HL();                             // 0x2A
+    u32 LDI_HL_A();                             // 0x22
+    u32 LD_nff00_A();                           // 0xE0
+    u32 LD_A_nff00();                           // 0xF0
+
+    template<REG16 reg> u32 LD_r2_nn();         // 0x01, 0x11, 0x21, 0x31
+    u32 LD_SP_HL();                             // 0xF9
+    u32 LD_HL_SPn();                            // 0xF8
+    u32 LD_nn_SP();                             // 0x08
+    template<REG16 reg> u32 PUSH_r2();          // 0xF5, 0xC5, 0xD5, 0xE5
+    template<REG16 reg> u32 POP_r2();           // 0xF1, 0xC1, 0xD1, 0xE1
+
+    template<REG8 reg> u32 ADD_A_r();           // 0x87, 0x80, 0x81, 0x82, 0x83, 0x84, 0x85
+    u32 ADD_A_HL();                             // 0x86
+    u32 ADD_A_n();                              // 0xC6
+    template<REG8 reg> u32 ADC_A_r();           // 0x8F, 0x88, 0x89, 0x8A, 0x8B, 0x8C, 0x8D
+    u32 ADC_A_HL();                             // 0x8E
+    u32 ADC_A_n();                              // 0xCE
+    template<REG8 reg> u32 SUB_A_r();           // 0x97, 0x90, 0x91, 0x92, 0x93, 0x94, 0x95
+    u32 SUB_A_HL();                             // 0x96
+    u32 SUB_A_n();                              // 0xD6
+    template<REG8 reg> u32 SBC_A_r();           // 0x9F, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D
+    u32 SBC_A_HL();                             // 0x9E
+    u32 SBC_A_n();                              // 0xDE
+    template<REG8 reg> u32 AND_A_r();           // 0xA7, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5
+    u32 AND_A_HL();                             // 0xA6
+    u32 AND_A_n();                              // 0xE6
+    template<REG8 reg> u32 OR_A_r();            // 0xB7, 0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5
+    u32 OR_A_HL();                              // 0xB6
+    u32 OR_A_n();                               // 0xF6
+    template<REG8 reg> u32 XOR_A_r();           // 0xAF, 0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD
+    u32 XOR_A_HL();                             // 0xAE
+    u32 XOR_A_n();                              // 0xEE
+    template<REG8 reg> u32 CP_A_r();            // 0xBF, 0xB8, 0xB9, 0xBA, 0xBB, 0xBC, 0xBD
+    u32 CP_A_HL();                              // 0xBE
+    u32 CP_A_n();                               // 0xFE
+    template<REG8 reg> u32 INC_r();             // 0x3C, 0x04, 0x0C, 0x14, 0x1C, 0x24, 0x2C
+    u32 INC_HL();                               // 0x34
+    template<REG8 reg> u32 DEC_r();             // 0x3D, 0x05, 0x0D, 0x15, 0x1D, 0x25, 0x2D
+    u32 DEC_HL();                               // 0x35
+
+    template<REG16 reg> u32 ADD_HL_r2();        // 0x09, 0x19, 0x29, 0x39
+    u32 ADD_SP_sn();                            // 0xE8
+    template<REG16 reg> u32 INC_r2();           // 0x03, 0x13, 0x23, 0x33
+    template<REG16 reg> u32 DEC_r2();           // 0x0B, 0x1B, 0x2B, 0x3B
+
+    u32 DAA();                                  // 0x27
+    u32 CPL();                                  // 0x2F
+    u32 CCF();                                  // 0x3F
+    u32 SCF();                                  // 0x37
+    u32 NOP();                                  // 0x00
+    u32 HALT();                                 // 0x76
+    u32 STOP();                                 // 0x10 0x00
+    u32 DI();                                   // 0xF3
+    u32 EI();                                   // 0xFB
+
+    u32 RLCA();                                 // 0x07
+    u32 RLA();                                  // 0x17
+    u32 RRCA();                                 // 0x0F;
+    u32 RRA();                                  // 0x1F
+
+    u32 JP_nn();                                // 0xC3
+    template<CONDITION cond> u32 JP_cc_nn();    // 0xC2, 0xCA, 0xD2, 0xDA
+    u32 JP_HL();                                // 0xE9
+    u32 JR_sn();                                // 0x18
+    template<CONDITION cond> u32 JR_cc_sn();    // 0x20, 0x28, 0x30, 0x38
+
+    u32 CALL_nn();                              // 0xCD
+    template<CONDITION cond> u32 CALL_cc_nn();  // 0xC4, 0xCC, 0xD4, 0xDC
+
+    template<u8 address> u32 RST_n();           // 0xC7, 0xCF, 0xD7, 0xDF, 0xE7, 0xEF, 0xF7, 0xFF
+    u32 RET();                                  // 0xC9
+    template<CONDITION cond> u32 RET_cc();      // 0xC0, 0xC8, 0xD0, 0xD8
+    u32 RETI();                                 // 0xD9
 
     // CB Instructions //
 
-    u32 RLC_r(const u8& opcode);        // CB: 0x07, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05
-    u32 RLC_HL(const u8& opcode);       // CB: 0x06
-    u32 RL_r(const u8& opcode);         // CB: 0x17, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15
-    u32 RL_HL(const u8& opcode);        // CB: 0x16
-    u32 RRC_r(const u8& opcode);        // CB: 0x0F, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D
-    u32 RRC_HL(const u8& opcode);       // CB: 0x0E
-    u32 RR_r(const u8& opcode);         // CB: 0x1F, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D
-    u32 RR_HL(const u8& opcode);        // CB: 0x1E
-    u32 SLA_r(const u8& opcode);        // CB: 0x27, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25
-    u32 SLA_HL(const u8& opcode);       // CB: 0x26
-    u32 SRA_r(const u8& opcode);        // CB: 0x2F, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D
-    u32 SRA_HL(const u8& opcode);       // CB: 0x2E
-    u32 SRL_r(const u8& opcode);        // CB: 0x3F, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D
-    u32 SRL_HL(const u8& opcode);       // CB: 0x3E
-
-    u32 BIT_b_r(const u8& opcode);      // CB: 0x40 --> 0x7F
-    u32 BIT_b_HL(const u8& opcode);     // CB: 0x46
-    u32 SET_b_r(const u8& opcode);      // CB: 0xC0 --> 0xFF
-    u32 SET_b_HL(const u8& opcode);     // CB: 0xC6
-    u32 RES_b_r(const u8& opcode);      // CB: 0x80 --> 0xBF
-    u32 RES_b_HL(const u8& opcode);     // CB: 0x86
-
-    u32 SWAP_r(const u8& opcode);       // CB: 0x37, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35
-    u32 SWAP_HL(const u8& opcode);      // CB: 0x36
+    template<REG8 reg> u32 RLC_r();             // CB: 0x07, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05
+    u32 RLC_HL();                               // CB: 0x06
+    template<REG8 reg> u32 RL_r();              // CB: 0x17, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15
+    u32 RL_HL();                                // CB: 0x16
+    template<REG8 reg> u32 RRC_r();             // CB: 0x0F, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D
+    u32 RRC_HL();                               // CB: 0x0E
+    template<REG8 reg> u32 RR_r();              // CB: 0x1F, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D
+    u32 RR_HL();                                // CB: 0x1E
+    template<REG8 reg> u32 SLA_r();             // CB: 0x27, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25
+    u32 SLA_HL();                               // CB: 0x26
+    template<REG8 reg> u32 SRA_r();             // CB: 0x2F, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D
+    u32 SRA_HL();                               // CB: 0x2E
+    template<REG8 reg> u32 SRL_r();             // CB: 0x3F, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D
+    u32 SRL_HL();                               // CB: 0x3E
+
+    template<u8 bit, REG8 reg> u32 BIT_b_r();   // CB: 0x40 --> 0x7F
+    template<u8 bit> u32 BIT_b_HL();            // CB: 0x46
+    template<u8 bit, REG8 reg> u32 SET_b_r();   // CB: 0xC0 --> 0xFF
+    template<u8 bit> u32 SET_b_HL();            // CB: 0xC6
+    template<u8 bit, REG8 reg> u32 RES_b_r();   // CB: 0x80 --> 0xBF
+    template<u8 bit> u32 RES_b_HL();            // CB: 0x86
+
+    template<REG8 reg> u32 SWAP_r();            // CB: 0x37, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35
+    u32 SWAP_HL();                              // CB: 0x36
 
 };
 
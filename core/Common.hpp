@@ -20,6 +20,9 @@ using namespace hak;
 #define LogRaw(S, ...) __android_log_print(ANDROID_LOG_INFO, "PhosGB", __VA_ARGS__)
 #endif
 
+// the hardware model, picked from the cartridge header when a ROM is loaded
+enum GB_MODE { DMG, CGB };
+
 constexpr u32 WIDTH = 160;
 constexpr u32 HEIGHT = 144;
 constexpr u32 DISPLAY_TEXTURE_SIZE = WIDTH * HEIGHT * 4;
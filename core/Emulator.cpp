@@ -34,6 +34,7 @@ void Emulator::pause() {
 }
 
 void Emulator::shutdown() {
+    if (cpu.mmu.ROM_0.empty()) return;
     u8 cartridgeType = cpu.mmu.ROM_0[0x147];
     // TODO: move this somewhere else
     if (cpu.mmu.cartridgeTypes[cartridgeType].find("RAM+BATTERY") != std::string::npos) {
@@ -82,6 +83,8 @@ void Emulator::saveState() {
 
     char header[11] = "PHOS-STATE";
     s.array(header);
+    u32 version = STATE_VERSION;
+    s.integer(version);
 
     serializeAll(s);
 
@@ -114,20 +117,35 @@ bool Emulator::loadState(std::string& path) {
     u8* buf = new u8[length];
     file.read((char *) buf, length);
 
-    u32 serializerSize = serializeInit();
-    if (serializerSize != length) {
-        Log(W, "Size of save state file does not match serializer size\n");
-        return false;
-    }
     serializer s(buf, length);
     delete[] buf;
 
     char header[11] = {0};
-    s.array(header);
+    u32 version = 0;
+    if (length >= (long) (sizeof(header) + sizeof(version))) {
+        s.array(header);
+        s.integer(version);
+    }
+    header[sizeof(header) - 1] = 0;
     if (std::string(header) != "PHOS-STATE") {
         Log(W, "Save state file has invalid header\n");
         return false;
     }
+    // states from before the version field have AF here, its low nibble is always zero
+    if (version != STATE_VERSION) {
+        if ((version & 0x0F) == 0) {
+            Log(W, "Save state file was written by an older version without a format version\n");
+        } else {
+            Log(W, "Save state file has format version %u, this version only loads %u\n", version, STATE_VERSION);
+        }
+        return false;
+    }
+
+    u32 serializerSize = serializeInit();
+    if (serializerSize != length) {
+        Log(W, "Size of save state file does not match serializer size\n");
+        return false;
+    }
 
     serializeAll(s);
 
@@ -141,6 +159,8 @@ u32 Emulator::serializeInit() {
     char header[11] = {0};
     // TODO: add some sort of checksum
     s.array(header);
+    u32 version = 0;
+    s.integer(version);
 
     serializeAll(s);
     return s.size();
@@ -6,6 +6,9 @@
 #include "Common.hpp"
 #include "CPU.hpp"
 
+// bump when the serialized fields change, states of other versions are refused
+constexpr u32 STATE_VERSION = 1;
+
 class Emulator {
 public:
     Emulator();
@@ -13,6 +16,7 @@ public:
     void pause();
     void shutdown();
     u32 tick();
+    template<class P> u32 tick() { return cpu.tick<P>(); }
     u8* getDisplayState();
     bool hitVBlank();
     void handleInputDown(u8 key);
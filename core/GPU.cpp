@@ -1,38 +1,59 @@
+#include <cmath>
+#include <cstring>
+
 #include "GPU.hpp"
 #include "CPU.hpp"
 
+#if defined(PHOS_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define PHOS_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
 GPU::GPU(CPU* c, MMU* m) :
     hitVBlank(false),
-    modeclock(0),
+    lineStart(0),
     DMATicks(0),
+    coincidenceInterrupt(false),
     useCustomPalette(false),
     showViewportBorder(true),
+    customPalette(defaultCustomPalette),
     cpu(c),
     mmu(m),
     mode(VBLANK),
     wyc(0),
-    pixelLine(160),
-    displayState(DISPLAY_TEXTURE_SIZE, 255),
-    backgroundState(262144, 255),
-    background(256, std::vector<u8>(256, 255)),
-    tileData(64 * 4) {
-    // map customizable RGB values to each palette value
-    customPalette[colors[0]] = {224, 248, 208};
-    customPalette[colors[1]] = {136, 192, 112};
-    customPalette[colors[2]] = { 52, 104,  86};
-    customPalette[colors[3]] = {  8,  24,  32};
+    lineRendered(true),
+    renderLine(&GPU::renderScanline<DMG>),
+    lineIndex(),
+    lineFlags(),
+    lineColor(),
+    spriteColor(),
+    displayState(c->arena.block(STATE_DISPLAY)),
+    tileCache(TILE_COUNT * 2 * 64),
+    lineSprites(),
+    lineSpriteCount(),
+    spriteListSize(0),
+    spritesDirty(true) {
+    setColorCorrection(CORRECTION_LCD);
+    std::fill(displayState.begin(), displayState.end(), 255);
+    tileDirty.fill(true);
 }
 
 void GPU::reset() {
+    selectModel();
     hitVBlank = false;
+    // line 153 starts now
     setMode(VBLANK);
-    modeclock = 0;
+    lineStart = cpu->scheduler.now;
+    lineRendered = true;
     DMATicks = 0;
+    coincidenceInterrupt = false;
     wyc = 0;
     std::fill(displayState.begin(), displayState.end(), 255);
-    std::fill(backgroundState.begin(), backgroundState.end(), 255);
-    for (std::vector<u8>& v : background) std::fill(v.begin(), v.end(), 255);
-    std::fill(tileData.begin(), tileData.end(), 255);
+    invalidateTileCache();
+    invalidateSprites();
+    // the debug views allocate their buffers on first use
+    backgroundState = std::vector<u8>();
+    tileData = std::vector<u8>();
 
     setReg(LCDC_Y_COORDINATE, 153);
     setReg(SCROLL_Y, 0x00);
@@ -43,276 +64,280 @@ void GPU::reset() {
     setReg(SPRITE_PALETTE_1_DATA, 0xFF);
     setReg(WINDOW_Y, 0x00);
     setReg(WINDOW_X_minus7, 0x00);
+    cpu->scheduler.schedule(EVENT_PPU_COINCIDENCE, cpu->scheduler.now);
+    scheduleNextEvent();
 }
 
-void GPU::tick(u32 ticks) {
-    if (cpu->doubleSpeedMode) ticks /= 2;
-    modeclock += ticks;
-    u8 line = getReg(LCDC_Y_COORDINATE);
-    switch (mode) {
-        case READ_OAM:
-            if (modeclock >= 80) {
-                // enter scanline mode 3 (READ_BOTH)
-                modeclock = 0;
-                setMode(READ_BOTH);
-            }
-            break;
-        case READ_BOTH:
-            if (modeclock >= 172) {
-                // beginning of HBLANK
-                modeclock = 0;
-                setMode(HBLANK);
-
-                renderScanline();
-                if (isBitSet(getReg(LCDC_STATUS), MODE_0_HBLANK_INTERRUPT)) {
-                    cpu->requestInterrupt(INTERRUPT_LCD_STAT);
-                }
-            }
-            break;
-        case HBLANK:
-            if (modeclock >= 204) {
-                modeclock = 0;
-                line++;
-                if (line == 144) {
-                    // beginning of VBLANK
-                    setMode(VBLANK);
-                    hitVBlank = true;
-
-                     cpu->requestInterrupt(INTERRUPT_VBLANK);
-                     if (isBitSet(getReg(LCDC_STATUS), MODE_1_VBLANK_INTERRUPT)) {
-                         cpu->requestInterrupt(INTERRUPT_LCD_STAT);
-                     }
-                } else {
-                    if (cpu->gbMode == CGB && mmu->VramDma.enabled)
-                        mmu->performHDMA();
-
-                    setMode(READ_OAM);
-                    if (isBitSet(getReg(LCDC_STATUS), MODE_2_OAM_INTERRUPT)) {
-                        cpu->requestInterrupt(INTERRUPT_LCD_STAT);
-                    }
-                }
-            }
-            break;
-        case VBLANK:
-            if (modeclock >= 456) {
-                modeclock = 0; wyc = 0;
-                line++;
-                if (line > 153) {
-                    setMode(READ_OAM);
-                    line = 0;
-                    if (isBitSet(getReg(LCDC_STATUS), MODE_2_OAM_INTERRUPT)) {
-                        cpu->requestInterrupt(INTERRUPT_LCD_STAT);
-                    }
-                }
+// the PPU runs lazily: it catches up with the master clock when the CPU reads LY or STAT, before the CPU
+// changes something it draws from and when one of its interrupts is due
+// a line takes 456 PPU cycles, 80 in mode 2 (READ_OAM), 172 in mode 3 (READ_BOTH) and 204 in HBLANK
+void GPU::sync() {
+    u64 now = cpu->scheduler.now;
+    u32 speed = cpu->doubleSpeedMode ? 2 : 1;
+    while (true) {
+        if (getReg(LCDC_Y_COORDINATE) < 144 && !lineRendered) {
+            if (lineStart + 252 * speed > now) break;
+            // beginning of HBLANK
+            setMode(HBLANK);
+            (this->*renderLine)();
+            lineRendered = true;
+            if (isBitSet(getReg(LCDC_STATUS), MODE_0_HBLANK_INTERRUPT)) {
+                cpu->requestInterrupt(INTERRUPT_LCD_STAT);
             }
-            break;
+        }
+        if (lineStart + 456 * speed > now) break;
+        lineStart += 456 * speed;
+        startLine(getReg(LCDC_Y_COORDINATE) + 1);
     }
 
-    if (getReg(LY_COMPARE) == line) {
-        setReg(LCDC_STATUS, setBit(getReg(LCDC_STATUS), COINCIDENCE_FLAG));
-        if (isBitSet(getReg(LCDC_STATUS), LYC_LY_COINCIDENCE_INTERRUPT)) {
+    u32 dot = (now - lineStart) / speed;
+    if (getReg(LCDC_Y_COORDINATE) >= 144) setMode(VBLANK);
+    else if (dot < 80) setMode(READ_OAM);
+    else if (dot < 252) setMode(READ_BOTH);
+    else setMode(HBLANK);
+}
+
+void GPU::startLine(u8 line) {
+    if (getReg(LCDC_Y_COORDINATE) >= 144) wyc = 0;
+    if (line == 144) {
+        // beginning of VBLANK
+        setMode(VBLANK);
+        hitVBlank = true;
+
+        cpu->requestInterrupt(INTERRUPT_VBLANK);
+        if (isBitSet(getReg(LCDC_STATUS), MODE_1_VBLANK_INTERRUPT)) {
+            cpu->requestInterrupt(INTERRUPT_LCD_STAT);
+        }
+    } else if (line < 144 || line > 153) {
+        if (line > 153) {
+            line = 0;
+        } else if (cpu->gbMode == CGB && mmu->VramDma.enabled) {
+            mmu->performHDMA();
+        }
+
+        setMode(READ_OAM);
+        if (isBitSet(getReg(LCDC_STATUS), MODE_2_OAM_INTERRUPT)) {
             cpu->requestInterrupt(INTERRUPT_LCD_STAT);
         }
-    } else {
-        setReg(LCDC_STATUS, clearBit(getReg(LCDC_STATUS), COINCIDENCE_FLAG));
     }
 
+    lineRendered = false;
     setReg(LCDC_Y_COORDINATE, line);
+    checkCoincidence();
+}
+
+// start of the next line with a number in [first, last]
+u64 GPU::nextLineStart(u8 first, u8 last) {
+    u8 next = (getReg(LCDC_Y_COORDINATE) + 1) % 154;
+    u32 lines = (next >= first && next <= last) ? 1 : 1 + (first + 154 - next) % 154;
+    return lineStart + lines * 456 * (cpu->doubleSpeedMode ? 2 : 1);
+}
+
+// wakes the PPU up for the next thing the CPU could notice without reading LY or STAT,
+// VBLANK always ends the frame
+void GPU::scheduleNextEvent() {
+    u8 stat = getReg(LCDC_STATUS);
+    u64 next = nextLineStart(144, 144);
+    if (isBitSet(stat, MODE_0_HBLANK_INTERRUPT)) {
+        u64 hblank = (getReg(LCDC_Y_COORDINATE) < 144 && !lineRendered) ? lineStart : nextLineStart(0, 143);
+        next = std::min(next, hblank + 252 * (cpu->doubleSpeedMode ? 2 : 1));
+    }
+    if (isBitSet(stat, MODE_2_OAM_INTERRUPT)) next = std::min(next, nextLineStart(0, 143));
+    if (cpu->gbMode == CGB && mmu->VramDma.enabled) next = std::min(next, nextLineStart(1, 143));
+    if (isBitSet(stat, LYC_LY_COINCIDENCE_INTERRUPT) && getReg(LY_COMPARE) <= 153) {
+        // LY reaches LYC and leaves it again
+        u8 lyc = getReg(LY_COMPARE);
+        next = std::min(next, nextLineStart(lyc, lyc));
+        next = std::min(next, nextLineStart((lyc + 1) % 154, (lyc + 1) % 154));
+    }
+    cpu->scheduler.schedule(EVENT_PPU, next);
 }
 
-void GPU::renderScanline() {
-    for (int p=0; p<160; p++) pixelLine[p].clear();
+// turning the display off restarts the frame, line 0 begins at the next step
+void GPU::endFrame() {
+    setReg(LCDC_Y_COORDINATE, 153);
+    setMode(VBLANK);
+    lineStart = cpu->scheduler.now - 456 * (cpu->doubleSpeedMode ? 2 : 1);
+    cpu->scheduler.schedule(EVENT_PPU, cpu->scheduler.now);
+}
 
-    // white background
-    if (!isBitSet(getReg(LCD_CONTROL), BG_DISPLAY) && cpu->gbMode == DMG) {
-        setBGColor(0xFF);
+void GPU::checkCoincidence() {
+    if (getReg(LY_COMPARE) == getReg(LCDC_Y_COORDINATE)) {
+        setReg(LCDC_STATUS, setBit(getReg(LCDC_STATUS), COINCIDENCE_FLAG));
+        // requested by the CPU after every step while this is set
+        coincidenceInterrupt = isBitSet(getReg(LCDC_STATUS), LYC_LY_COINCIDENCE_INTERRUPT);
     } else {
-        renderBGScanline();
+        setReg(LCDC_STATUS, clearBit(getReg(LCDC_STATUS), COINCIDENCE_FLAG));
+        coincidenceInterrupt = false;
     }
+}
 
-    if (isBitSet(getReg(LCD_CONTROL), WINDOW_DISPLAY_ENABLE)) {
-        renderWindowScanline();
+// the PPU runs at the same speed in double speed mode, keep the PPU cycles already spent on this line
+void GPU::changeSpeed(bool doubleSpeed) {
+    sync();
+    u64 now = cpu->scheduler.now;
+    u64 elapsed = (now - lineStart) / (cpu->doubleSpeedMode ? 2 : 1);
+    lineStart = now - elapsed * (doubleSpeed ? 2 : 1);
+}
+
+// CPU cycles until LY or the STAT mode change next
+u32 GPU::ticksUntilModeChange() {
+    sync();
+    u32 speed = cpu->doubleSpeedMode ? 2 : 1;
+    u32 elapsed = cpu->scheduler.now - lineStart;
+    u32 dot = elapsed / speed;
+    u32 end = 456;
+    if (getReg(LCDC_Y_COORDINATE) < 144) end = (dot < 80) ? 80 : (dot < 252) ? 252 : 456;
+    return end * speed - elapsed;
+}
+
+void GPU::selectModel() {
+    renderLine = (cpu->gbMode == CGB) ? &GPU::renderScanline<CGB> : &GPU::renderScanline<DMG>;
+}
+
+template<GB_MODE MODE> void GPU::renderScanline() {
+    // a disabled DMG background leaves the cleared (white) line
+    std::fill_n(&lineIndex[LINE_PADDING], 160, 0);
+    std::fill_n(&lineFlags[LINE_PADDING], 160, 0);
+    std::fill_n(&lineColor[LINE_PADDING], 160, (MODE == DMG) ? 0 : 0x7FFF);
+
+    if (isBitSet(getReg(LCD_CONTROL), BG_DISPLAY) || MODE == CGB) {
+        renderBGScanline<MODE>();
     }
 
-    int y = getReg(LCDC_Y_COORDINATE);
-    int index = y * 160 * 4;
-    for (int x=0; x<160; x++) {
-        if (cpu->gbMode == DMG) {
-            if (useCustomPalette) {
-                displayState[index] = customPalette[pixelLine[x].r][0];
-                displayState[index + 1] = customPalette[pixelLine[x].g][1];
-                displayState[index + 2] = customPalette[pixelLine[x].b][2];
-                index += 4;
-            } else {
-                displayState[index] = pixelLine[x].r;
-                displayState[index + 1] = pixelLine[x].g;
-                displayState[index + 2] = pixelLine[x].b;
-                index += 4;
-            }
-        } else {
-            u8 r, g, b;
-            colorCorrect(pixelLine[x].color, r, g, b);
-            displayState[index    ] = r;
-            displayState[index + 1] = g;
-            displayState[index + 2] = b;
-            index += 4;
-        }
+    if (isBitSet(getReg(LCD_CONTROL), WINDOW_DISPLAY_ENABLE)) {
+        renderWindowScanline<MODE>();
     }
 
     if (isBitSet(getReg(LCD_CONTROL), SPRITE_DISPLAY_ENABLE)) {
-        renderSpriteScanline();
+        renderSpriteScanline<MODE>();
+    }
+
+    // every pixel is resolved and converted once, a sprite loses against a BG pixel with priority and,
+    // unless one of the sprites under it is drawn above the background, against BG colors 1-3
+    bool bgPriority = isBitSet(getReg(LCD_CONTROL), BG_DISPLAY);
+    // RGBA of the 4 DMG shades
+    u32 shades[4];
+    if (MODE == DMG) {
+        for (int i=0; i<4; i++) {
+            u8 rgba[4] { colors[i], colors[i], colors[i], 255 };
+            if (useCustomPalette) std::memcpy(rgba, customPalette[i].data(), 3);
+            std::memcpy(&shades[i], rgba, 4);
+        }
+    }
+    const u32* lut = (MODE == DMG) ? shades : colorTable;
+    u8* out = &displayState[getReg(LCDC_Y_COORDINATE) * 160 * 4];
+    for (int x=LINE_PADDING; x<LINE_PADDING+160; x++) {
+        u8 flags = lineFlags[x];
+        bool bgWins = (flags & PIXEL_BG_PRIORITY) || (lineIndex[x] && !(flags & PIXEL_SPRITE_ABOVE_BG));
+        bool showSprite = (flags & PIXEL_SPRITE) && !(bgPriority && bgWins);
+        u16 color = showSprite ? spriteColor[x] : lineColor[x];
+        std::memcpy(out, &lut[color], 4);
+        out += 4;
     }
 }
 
-void GPU::fetchTileData(bool mapSelect, u8 posY, u8 posX, u16& tile, u16& attribute, u16& data) {
+// the decoded row of the tile at (posX, posY) of the selected map
+template<GB_MODE MODE> const u8* GPU::fetchTileRow(bool mapSelect, u8 posY, u8 posX, u16& attribute) {
     // get the start of the selected map and add the offset to the selected tile
     u16 tileAddress = mapSelect ? 0x1C00u : 0x1800u;
     tileAddress += (((posY / 8) * 32) + (posX / 8)) % 1024;
 
-    u16 tileData = 0x0000;
+    u32 tileIndex = 0;
     u8 yOffset = posY & 0x07;
+    bool flipX = false;
 
-    tile = mmu->VRAM[tileAddress];
-    if (cpu->gbMode == CGB) {
+    u8 tile = mmu->VRAM[tileAddress];
+    if (MODE == CGB) {
         attribute = mmu->VRAM[VRAM_BANK_SIZE + tileAddress];
         // select correct bank
-        if (attribute & 0x08) tileData += VRAM_BANK_SIZE;
-        // check for up/down flip
+        if (attribute & 0x08) tileIndex += TILES_PER_BANK;
+        // check for up/down and left/right flip
         if (attribute & 0x40) yOffset ^= 7;
+        flipX = attribute & 0x20;
     }
 
     if (isBitSet(getReg(LCD_CONTROL), BG_AND_WINDOW_TILE_SELECT)) {
-        tileData += tile * 0x10;
+        tileIndex += tile;
     } else {
-        tileData += 0x1000 + static_cast<char>(tile) * 0x10;
+        tileIndex += 0x100 + static_cast<char>(tile);
     }
-    tileData += yOffset * 2;
-
-    data = mmu->VRAM[tileData++];
-    data |= mmu->VRAM[tileData] << 8;
-
-    // check for left/right flip
-    if (cpu->gbMode == CGB && attribute & 0x20) data = hflip(data);
+    return tileRow(tileIndex, yOffset, flipX);
 }
 
-void GPU::renderBGScanline(bool fullLine, u8 yCoord) {
-    // DMG palette (should probably move this somewhere else)
+// draws count pixels of the map row at posY into the line buffers, map column posX goes to line position x,
+// whole tile rows are written at once, the part of the first tile left of x ends up in the padding
+template<GB_MODE MODE> void GPU::renderTiles(bool mapSelect, u8 posY, u8 posX, int x, int count) {
+    // DMG shade numbers, CGB colors are picked per tile
     int paletteData = getReg(BG_PALETTE_DATA);
-    const u8 palette[4] {
-            colors[paletteData & 0x03],
-            colors[(paletteData >> 2) & 0x03],
-            colors[(paletteData >> 4) & 0x03],
-            colors[(paletteData >> 6) & 0x03],
+    u16 palette[4] {
+            (u16) (paletteData & 0x03),
+            (u16) ((paletteData >> 2) & 0x03),
+            (u16) ((paletteData >> 4) & 0x03),
+            (u16) ((paletteData >> 6) & 0x03),
     };
 
+    int position = LINE_PADDING + x - (posX & 0x07);
+    int end = LINE_PADDING + x + count;
+    posX &= ~0x07;
+    while (position < end) {
+        u16 attribute = 0;
+        const u8* row = fetchTileRow<MODE>(mapSelect, posY, posX, attribute);
+        if (MODE == CGB) {
+            for (int i=0; i<4; i++) palette[i] = getColor(0, attribute, i);
+        }
+        u8 flags = (attribute & 0x80) ? PIXEL_BG_PRIORITY : 0;
+
+        if (end - position >= 8) {
+            std::memcpy(&lineIndex[position], row, 8);
+            std::memset(&lineFlags[position], flags, 8);
+            mapTileRow(row, palette, &lineColor[position]);
+        } else {
+            // the window can end inside a tile
+            for (int i=0; i<end-position; i++) {
+                lineIndex[position + i] = row[i];
+                lineFlags[position + i] = flags;
+                lineColor[position + i] = palette[row[i]];
+            }
+        }
+        position += 8;
+        posX += 8;
+    }
+}
+
+template<GB_MODE MODE> void GPU::renderBGScanline(bool fullLine, u8 yCoord) {
     u8 posY = getReg(LCDC_Y_COORDINATE) + getReg(SCROLL_Y);
     u8 posX = getReg(SCROLL_X);
-    unsigned lineWidth = 160;
+    int lineWidth = 160;
     if (fullLine) {
         posY = yCoord;
         posX = 0;
         lineWidth = 256;
     }
 
-    u16 tile = 0, attribute = 0, data = 0;
     bool mapSelect = isBitSet(getReg(LCD_CONTROL), BG_TILE_MAP_SELECT);
-    fetchTileData(mapSelect, posY, posX, tile, attribute, data);
-
-    // draw one line
-    u8 bit = posX % 8;
-    for (unsigned x=0; x<lineWidth; x++) {
-        u8 pLo = ((data & (0x0080 >> bit)) ? 1 : 0);
-        u8 pHi = ((data & (0x8000 >> bit)) ? 2 : 0);
-        u8 paletteIndex = pLo + pHi;
-
-        pixelLine[x].type = (attribute & 0x80) ? 3 : 1;
-        pixelLine[x].palette = paletteIndex;
-        if (cpu->gbMode == DMG) {
-            u8 color = palette[paletteIndex];
-            pixelLine[x].setColor(color, color, color);
-        } else {
-            u16 color = getColor(0, attribute, paletteIndex);
-            pixelLine[x].color = color;
-            pixelLine[x].setColor(color & 0x001F, (color & 0x03E0) >> 5, (color & 0x7C00) >> 10);
-        }
-
-        posX++;
-        bit = (bit + 1) % 8;
-        if (bit == 0) fetchTileData(mapSelect, posY, posX, tile, attribute, data);
-    }
+    renderTiles<MODE>(mapSelect, posY, posX, 0, lineWidth);
 }
 
-void GPU::renderWindowScanline() {
-    // DMG palette (should probably move this somewhere else)
-    int paletteData = getReg(BG_PALETTE_DATA);
-    const u8 palette[4] {
-            colors[paletteData & 0x03],
-            colors[(paletteData >> 2) & 0x03],
-            colors[(paletteData >> 4) & 0x03],
-            colors[(paletteData >> 6) & 0x03],
-    };
-
+template<GB_MODE MODE> void GPU::renderWindowScanline() {
     if (getReg(WINDOW_X_minus7) >= 167u) return;
     if ((unsigned)(getReg(LCDC_Y_COORDINATE) - getReg(WINDOW_Y)) >= 144u) return;
-    u8 posX = (7 - getReg(WINDOW_X_minus7)) & 0xFF;
     u8 posY = wyc++;
 
-    u16 tile = 0, attribute = 0, data = 0;
-    bool mapSelect = isBitSet(getReg(LCD_CONTROL), WINDOW_TILE_MAP_SELECT);
-    fetchTileData(mapSelect, posY, posX, tile, attribute, data);
-
-    // draw one line
-    u8 bit = posX % 8;
-    for (unsigned x=0; x<160; x++) {
-        u8 pLo = ((data & (0x0080 >> bit)) ? 1 : 0);
-        u8 pHi = ((data & (0x8000 >> bit)) ? 2 : 0);
-        u8 paletteIndex = pLo + pHi;
-
-        if (x - (getReg(WINDOW_X_minus7) - 7) <= 160u) {
-            pixelLine[x].type = (attribute & 0x80) ? 3 : 1;
-            pixelLine[x].palette = paletteIndex;
-            if (cpu->gbMode == DMG) {
-                u8 color = palette[paletteIndex];
-                pixelLine[x].setColor(color, color, color);
-            } else {
-                u16 color = getColor(0, attribute, paletteIndex);
-                pixelLine[x].color = color;
-                pixelLine[x].setColor(color & 0x001F, (color & 0x03E0) >> 5, (color & 0x7C00) >> 10);
-            }
-        }
+    // the window covers the 161 pixels from WX-7 on, a window that starts left of the screen ends early
+    int start = getReg(WINDOW_X_minus7) - 7;
+    int first = std::max(start, 0);
+    int last = std::min(159, start + 160);
 
-        posX++;
-        bit = (bit + 1) % 8;
-        if (bit == 0) fetchTileData(mapSelect, posY, posX, tile, attribute, data);
-    }
+    bool mapSelect = isBitSet(getReg(LCD_CONTROL), WINDOW_TILE_MAP_SELECT);
+    renderTiles<MODE>(mapSelect, posY, first - start, first, last - first + 1);
 }
 
-void GPU::renderSpriteScanline() {
+template<GB_MODE MODE> void GPU::renderSpriteScanline() {
     const u8 spriteSize = isBitSet(getReg(LCD_CONTROL), SPRITE_SIZE) ? 16 : 8;
-    unsigned sprites[10] = {};
-    unsigned spriteCount = 0;
-
-    for (unsigned s=0; s<40; s++) {
-        unsigned sy = mmu->OAM[s * 4] - 16;
-
-        sy = getReg(LCDC_Y_COORDINATE) - sy;
-        if (sy >= spriteSize) continue;
-        sprites[spriteCount++] = s;
-        if (spriteCount == 10) break;
-    }
-
-    // sort sprites by x-coordinate
-    for (unsigned s1=0; s1<spriteCount; s1++) {
-        for (unsigned s2=s1+1; s2<spriteCount; s2++) {
-            int sx1 = mmu->OAM[sprites[s1] * 4 + 1] - 8;
-            int sx2 = mmu->OAM[sprites[s2] * 4 + 1] - 8;
-            if (sx2 < sx1) {
-                unsigned tmp = sprites[s1];
-                sprites[s1] = sprites[s2];
-                sprites[s2] = tmp;
-            }
-        }
-    }
+    if (spritesDirty || spriteSize != spriteListSize) buildSpriteLists(spriteSize);
+    const u8* sprites = lineSprites[getReg(LCDC_Y_COORDINATE)].data();
+    int spriteCount = lineSpriteCount[getReg(LCDC_Y_COORDINATE)];
 
     // render backwards
     for (int s=spriteCount-1; s>=0; s--) {
@@ -331,72 +356,93 @@ void GPU::renderSpriteScanline() {
         u8 dmgPaletteNumber = isBitSet(spriteAttr, 4);
         const u8 dmgPalette[4] {
             0x00,
-            colors[dmgPaletteNumber ? (getReg(SPRITE_PALETTE_1_DATA) >> 2 & 0x03) : (getReg(SPRITE_PALETTE_0_DATA) >> 2 & 0x03)],
-            colors[dmgPaletteNumber ? (getReg(SPRITE_PALETTE_1_DATA) >> 4 & 0x03) : (getReg(SPRITE_PALETTE_0_DATA) >> 4 & 0x03)],
-            colors[dmgPaletteNumber ? (getReg(SPRITE_PALETTE_1_DATA) >> 6 & 0x03) : (getReg(SPRITE_PALETTE_0_DATA) >> 6 & 0x03)],
+            (u8) (dmgPaletteNumber ? (getReg(SPRITE_PALETTE_1_DATA) >> 2 & 0x03) : (getReg(SPRITE_PALETTE_0_DATA) >> 2 & 0x03)),
+            (u8) (dmgPaletteNumber ? (getReg(SPRITE_PALETTE_1_DATA) >> 4 & 0x03) : (getReg(SPRITE_PALETTE_0_DATA) >> 4 & 0x03)),
+            (u8) (dmgPaletteNumber ? (getReg(SPRITE_PALETTE_1_DATA) >> 6 & 0x03) : (getReg(SPRITE_PALETTE_0_DATA) >> 6 & 0x03)),
         };
 
-        unsigned tileData;
-        if (cpu->gbMode == DMG) tileData = spriteTile * 16 + relY * 2;
-        else tileData = (spriteAttr & 0x08 ? VRAM_BANK_SIZE : 0x0000) + spriteTile * 16 + relY * 2;
-        unsigned data = mmu->VRAM[tileData++];
-        data |= mmu->VRAM[tileData] << 8;
-        if (spriteAttr & 0x20) data = hflip(data);
+        // the lower half of a 8x16 sprite is the next tile
+        u32 tileIndex = spriteTile + relY / 8;
+        if (MODE == CGB && (spriteAttr & 0x08)) tileIndex += TILES_PER_BANK;
+        const u8* row = tileRow(tileIndex, relY % 8, spriteAttr & 0x20);
 
+        // sprites with a lower priority come first, the last one drawn on a pixel is what the compositor shows
+        u8 flags = isBitSet(spriteAttr, 7) ? PIXEL_SPRITE : PIXEL_SPRITE | PIXEL_SPRITE_ABOVE_BG;
         for (unsigned bit=0; bit<8; bit++) {
-            u8 pLo = ((data & (0x0080 >> bit)) ? 1 : 0);
-            u8 pHi = ((data & (0x8000 >> bit)) ? 2 : 0);
-            u8 paletteIndex = pLo + pHi;
+            u8 paletteIndex = row[bit];
             // transparent
             if (paletteIndex == 0) continue;
 
             unsigned x = spriteX + bit;
             if (x < 160) {
-                unsigned index = ((getReg(LCDC_Y_COORDINATE) * 160) + x) * 4;
-                if (isBitSet(getReg(LCD_CONTROL), BG_DISPLAY)) {
-                    if (pixelLine[x].type == 3) continue;
-                    if (isBitSet(spriteAttr, 7)) {
-                        if (pixelLine[x].type == 1 && pixelLine[x].palette > 0) continue;
-                    }
-                }
-
-                pixelLine[x].palette = paletteIndex;
-                pixelLine[x].type = 2;
-
-                if (cpu->gbMode == DMG) {
-                    u8 color = dmgPalette[paletteIndex];
-                    if (useCustomPalette) {
-                        displayState[index] = customPalette[color][0];
-                        displayState[index + 1] = customPalette[color][1];
-                        displayState[index + 2] = customPalette[color][2];
-                    } else {
-                        displayState[index] = color;
-                        displayState[index + 1] = color;
-                        displayState[index + 2] = color;
-                    }
-                } else {
-                    u16 color = getColor(1, spriteAttr, paletteIndex);
-                    u8 r, g, b;
-                    colorCorrect(color, r, g, b);
-                    displayState[index    ] = r;
-                    displayState[index + 1] = g;
-                    displayState[index + 2] = b;
-                }
+                lineFlags[LINE_PADDING + x] |= flags;
+                if (MODE == DMG) spriteColor[LINE_PADDING + x] = dmgPalette[paletteIndex];
+                else spriteColor[LINE_PADDING + x] = getColor(1, spriteAttr, paletteIndex);
             }
         }
     }
 }
 
+// RGBA of every RGB555 color, each table is built the first time its curve is selected
+static std::array<u32, 32768> buildColorTable(COLOR_CORRECTION correction) {
+    std::array<u32, 32768> table {};
+    for (u32 color=0; color<32768; color++) {
+        u16 rOld =  color & 0x001F;
+        u16 gOld = (color & 0x03E0) >> 5;
+        u16 bOld = (color & 0x7C00) >> 10;
+        u8 rgba[4] { 0, 0, 0, 255 };
+        if (correction == CORRECTION_NONE) {
+            rgba[0] = (rOld << 3) | (rOld >> 2);
+            rgba[1] = (gOld << 3) | (gOld >> 2);
+            rgba[2] = (bOld << 3) | (bOld >> 2);
+        } else if (correction == CORRECTION_LCD) {
+            u16 rNew = rOld * 26 + gOld *  4 + bOld * 2;
+            u16 gNew =             gOld * 24 + bOld * 8;
+            u16 bNew = rOld *  6 + gOld *  4 + bOld * 22;
+            rgba[0] = static_cast<u8>((rNew / 1024.f) * 255);
+            rgba[1] = static_cast<u8>((gNew / 1024.f) * 255);
+            rgba[2] = static_cast<u8>((bNew / 1024.f) * 255);
+        } else {
+            // same mix as the LCD curve but in linear light
+            float r = std::pow(rOld / 31.f, 2.2f);
+            float g = std::pow(gOld / 31.f, 2.2f);
+            float b = std::pow(bOld / 31.f, 2.2f);
+            rgba[0] = static_cast<u8>(std::pow((r * 26 + g *  4 + b *  2) / 32.f, 1 / 2.2f) * 255 + 0.5f);
+            rgba[1] = static_cast<u8>(std::pow((         g * 24 + b *  8) / 32.f, 1 / 2.2f) * 255 + 0.5f);
+            rgba[2] = static_cast<u8>(std::pow((r *  6 + g *  4 + b * 22) / 32.f, 1 / 2.2f) * 255 + 0.5f);
+        }
+        std::memcpy(&table[color], rgba, 4);
+    }
+    return table;
+}
+
+void GPU::setColorCorrection(COLOR_CORRECTION correction) {
+    colorCorrection = correction;
+    switch (correction) {
+        case CORRECTION_NONE: {
+            static const std::array<u32, 32768> table = buildColorTable(CORRECTION_NONE);
+            colorTable = table.data();
+            break;
+        }
+        case CORRECTION_LCD: {
+            static const std::array<u32, 32768> table = buildColorTable(CORRECTION_LCD);
+            colorTable = table.data();
+            break;
+        }
+        case CORRECTION_GAMMA: {
+            static const std::array<u32, 32768> table = buildColorTable(CORRECTION_GAMMA);
+            colorTable = table.data();
+            break;
+        }
+    }
+}
+
 void GPU::colorCorrect(u16 original, u8 &r, u8 &g, u8 &b) {
-    u16 rOld =  original & 0x001F;
-    u16 gOld = (original & 0x03E0) >> 5;
-    u16 bOld = (original & 0x7C00) >> 10;
-    u16 rNew = rOld * 26 + gOld *  4 + bOld * 2;
-    u16 gNew =             gOld * 24 + bOld * 8;
-    u16 bNew = rOld *  6 + gOld *  4 + bOld * 22;
-    r = static_cast<u8>((rNew / 1024.f) * 255);
-    g = static_cast<u8>((gNew / 1024.f) * 255);
-    b = static_cast<u8>((bNew / 1024.f) * 255);
+    u8 rgba[4];
+    std::memcpy(rgba, &colorTable[original & 0x7FFF], 4);
+    r = rgba[0];
+    g = rgba[1];
+    b = rgba[2];
 }
 
 u16 GPU::getColor(u8 type, u16 attribute, u16 paletteIndex) {
@@ -407,15 +453,93 @@ u16 GPU::getColor(u8 type, u16 attribute, u16 paletteIndex) {
     u8 offset = type ? 0x40 : 0x00;
     paletteAddress += offset;
     assert(paletteAddress + 1 <= 0x7F);
-    return mmu->PaletteMemory[paletteAddress] | (mmu->PaletteMemory[paletteAddress + 1] << 8);
+    // the unused top bit would index past the color table
+    return (mmu->PaletteMemory[paletteAddress] | (mmu->PaletteMemory[paletteAddress + 1] << 8)) & 0x7FFF;
 }
 
-unsigned GPU::hflip(unsigned data) {
-    // Hacker's Delight [p. 129]
-    unsigned x = (data & 0x5555) << 1 | ((data >> 1) & 0x5555);
-    x = (x & 0x3333) << 2 | ((x >> 2) & 0x3333);
-    x = (x & 0x0F0F) << 4 | ((x >> 4) & 0x0F0F);
-    return x;
+// colors of the 8 palette indices of a tile row, the scalar version is the reference for the SIMD one
+void GPU::mapTileRow(const u8* row, const u16* colors, u16* out) {
+#ifdef PHOS_SIMD_SSE2
+    // widen the indices to 16 bits and select each color where the index matches
+    __m128i indices = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) row), _mm_setzero_si128());
+    __m128i result = _mm_set1_epi16((short) colors[0]);
+    for (int i=1; i<4; i++) {
+        __m128i mask = _mm_cmpeq_epi16(indices, _mm_set1_epi16((short) i));
+        result = _mm_or_si128(_mm_andnot_si128(mask, result), _mm_and_si128(mask, _mm_set1_epi16((short) colors[i])));
+    }
+    _mm_storeu_si128((__m128i*) out, result);
+#else
+    mapTileRowScalar(row, colors, out);
+#endif
+}
+
+void GPU::mapTileRowScalar(const u8* row, const u16* colors, u16* out) {
+    for (int i=0; i<8; i++) out[i] = colors[row[i]];
+}
+
+// one row of a decoded tile, tiles of the second VRAM bank start at TILES_PER_BANK
+const u8* GPU::tileRow(u32 tileIndex, u8 y, bool flipX) {
+    if (tileDirty[tileIndex]) decodeTile(tileIndex);
+    return &tileCache[((tileIndex * 2 + flipX) * 8 + y) * 8];
+}
+
+void GPU::decodeTile(u32 tileIndex) {
+    u32 address = (tileIndex / TILES_PER_BANK) * VRAM_BANK_SIZE + (tileIndex % TILES_PER_BANK) * 16;
+    u8* plain = &tileCache[tileIndex * 2 * 64];
+    u8* flipped = plain + 64;
+    for (int y=0; y<8; y++) {
+        u8 lowByte = mmu->VRAM[address + y * 2];
+        u8 highByte = mmu->VRAM[address + y * 2 + 1];
+        for (int x=0; x<8; x++) {
+            u8 index = ((lowByte >> (7 - x)) & 0x01) | (((highByte >> (7 - x)) & 0x01) << 1);
+            plain[y * 8 + x] = index;
+            flipped[y * 8 + 7 - x] = index;
+        }
+    }
+    tileDirty[tileIndex] = false;
+}
+
+// called for every change to VRAM, offset counts from the start of the first bank
+void GPU::invalidateTiles(u32 offset, u32 length) {
+    for (u32 address = offset & ~15u; address < offset + length; address += 16) {
+        u32 relAddress = address % VRAM_BANK_SIZE;
+        // the tile maps don't hold any tiles
+        if (relAddress < TILES_PER_BANK * 16) tileDirty[(address / VRAM_BANK_SIZE) * TILES_PER_BANK + relAddress / 16] = true;
+    }
+}
+
+void GPU::invalidateTileCache() {
+    tileDirty.fill(true);
+}
+
+// called for every change to OAM
+void GPU::invalidateSprites() {
+    spritesDirty = true;
+}
+
+// the first 10 sprites in OAM order that cover each line, sorted by x-coordinate
+void GPU::buildSpriteLists(u8 spriteSize) {
+    lineSpriteCount.fill(0);
+    for (unsigned s=0; s<40; s++) {
+        int top = mmu->OAM[s * 4] - 16;
+        for (int line=std::max(top, 0); line<std::min(top + spriteSize, 144); line++) {
+            if (lineSpriteCount[line] < 10) lineSprites[line][lineSpriteCount[line]++] = s;
+        }
+    }
+
+    for (int line=0; line<144; line++) {
+        u8* sprites = lineSprites[line].data();
+        unsigned spriteCount = lineSpriteCount[line];
+        for (unsigned s1=0; s1<spriteCount; s1++) {
+            for (unsigned s2=s1+1; s2<spriteCount; s2++) {
+                int sx1 = mmu->OAM[sprites[s1] * 4 + 1] - 8;
+                int sx2 = mmu->OAM[sprites[s2] * 4 + 1] - 8;
+                if (sx2 < sx1) std::swap(sprites[s1], sprites[s2]);
+            }
+        }
+    }
+    spriteListSize = spriteSize;
+    spritesDirty = false;
 }
 
 u8 GPU::getReg(u16 regAddress) {
@@ -444,16 +568,17 @@ u8* GPU::getDisplayState() {
 }
 
 u8* GPU::getBackgroundState() {
-    pixelLine.resize(256);
+    if (backgroundState.empty()) backgroundState.assign(256 * 256 * 4, 255);
     int counter = 0;
     for (int i=0; i<256; i++) {
-        renderBGScanline(true, i);
+        if (cpu->gbMode == CGB) renderBGScanline<CGB>(true, i);
+        else renderBGScanline<DMG>(true, i);
         u8 r, g, b;
-        for (int x=0; x<256; x++) {
+        for (int x=LINE_PADDING; x<LINE_PADDING+256; x++) {
             if (cpu->gbMode == CGB) {
-                colorCorrect(pixelLine[x].color, r, g, b);
+                colorCorrect(lineColor[x], r, g, b);
             } else {
-                r = pixelLine[x].r, g = pixelLine[x].g, b = pixelLine[x].b;
+                r = g = b = colors[lineColor[x]];
             }
             backgroundState[counter++] = r;
             backgroundState[counter++] = g;
@@ -461,7 +586,6 @@ u8* GPU::getBackgroundState() {
             counter++;
         }
     }
-    pixelLine.resize(160);
     if (!showViewportBorder) return backgroundState.data();
 
     // render viewport borders
@@ -489,18 +613,13 @@ u8* GPU::getBackgroundState() {
 }
 
 u8* GPU::getTileData(int offset) {
-    // build one tile
-    u8 tile[64] = {};
+    u32 relAddress = offset % VRAM_BANK_SIZE;
+    assert(relAddress < TILES_PER_BANK * 16);
+    const u8* tile = tileRow((offset / VRAM_BANK_SIZE) * TILES_PER_BANK + relAddress / 16, 0, false);
+    tileData.resize(64 * 4);
     int counter = 0;
-    for (int i=0; i<16; i+=2) {
-        u8 lowByte = mmu->VRAM[i+offset];
-        u8 highByte = mmu->VRAM[i+1+offset];
-        for (int j = 7; j >= 0; j--) {
-            tile[counter++] = ((lowByte & (0x01 << j)) >> j) | (((highByte & (0x01 << j)) >> j) << 1);
-        }
-    }
-    counter = 0;
-    for (u8 t : tile) {
+    for (int i=0; i<64; i++) {
+        u8 t = tile[i];
         assert(t < 4);
         tileData[counter++] = colors[t];
         tileData[counter++] = colors[t];
@@ -510,18 +629,14 @@ u8* GPU::getTileData(int offset) {
     return tileData.data();
 }
 
-void GPU::setBGColor(u8 color) {
-    for (int y=0; y<256; y++) {
-        for (int x=0; x<256; x++) {
-            background[y][x] = color;
-        }
-    }
-}
-
 void GPU::serialize(serializer &s) {
     s.integer(hitVBlank);
-    s.integer(modeclock);
+    s.integer(lineStart);
     s.integer(DMATicks);
+    s.integer(coincidenceInterrupt);
     s.enumeration(mode);
     s.integer(wyc);
+    s.integer(lineRendered);
+    // the model is restored with the CPU state
+    if (s.mode() == serializer::Load) selectModel();
 }
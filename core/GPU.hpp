@@ -12,6 +12,34 @@ enum GPU_MODE { HBLANK, VBLANK, READ_OAM, READ_BOTH };
 
 const u8 colors[] { 255, 192, 96, 0 };
 
+// RGB values the DMG shades are replaced with when useCustomPalette is set
+const std::array<std::array<u8, 3>, 4> defaultCustomPalette {{
+    {224, 248, 208},
+    {136, 192, 112},
+    { 52, 104,  86},
+    {  8,  24,  32},
+}};
+
+// how CGB colors are mapped to RGB
+enum COLOR_CORRECTION : u8 {
+    CORRECTION_NONE,    // plain scaling of the 5 bit channels
+    CORRECTION_LCD,     // mixes the channels like the CGB screen
+    CORRECTION_GAMMA,   // the LCD mix done in linear light
+};
+
+// what lies on a pixel of the line buffers
+constexpr u8 PIXEL_BG_PRIORITY      = 0x01;     // the CGB BG attribute puts the tile above sprites
+constexpr u8 PIXEL_SPRITE           = 0x02;
+constexpr u8 PIXEL_SPRITE_ABOVE_BG  = 0x04;     // one of the sprites doesn't hide behind BG colors 1-3
+
+// the line buffers have room for a whole tile row on both sides of a 256 pixel line
+constexpr int LINE_PADDING = 8;
+constexpr int LINE_BUFFER_SIZE = LINE_PADDING + 256 + 8;
+
+// tiles in the first 6KB of each VRAM bank
+constexpr u32 TILES_PER_BANK = 384;
+constexpr u32 TILE_COUNT = TILES_PER_BANK * 2;
+
 // GPU Registers
 constexpr u16 LCD_CONTROL           = 0xFF40;
 constexpr u16 LCDC_STATUS           = 0xFF41;
@@ -43,39 +71,52 @@ constexpr u8 MODE_1_VBLANK_INTERRUPT        = 4;
 constexpr u8 MODE_0_HBLANK_INTERRUPT        = 3;
 constexpr u8 COINCIDENCE_FLAG               = 2;
 
-struct Pixel {
-    u8 type;
-    u8 palette;
-    u16 color;
-    u8 r, g, b;
-    Pixel() : type(0), palette(0), color(0x7FFF), r(0xFF), g(0xFF), b(0xFF) {};
-    void setColor(u8 red, u8 green, u8 blue) { r = red, g = green, b = blue; }
-    void clear() { type = 0, palette = 0, color = 0x7FFF; setColor(0xFF, 0xFF, 0xFF); }
-};
+// VRAM, OAM and the registers the PPU reads while it draws a line
+inline bool isPPUAddress(u16 address) {
+    if (address >= 0x8000 && address < 0xA000) return true;
+    if (address >= 0xFE00 && address < 0xFEA0) return true;
+    return (address >= 0xFF40 && address <= 0xFF4F) || (address >= 0xFF51 && address <= 0xFF55) ||
+           (address >= 0xFF68 && address <= 0xFF6B);
+}
 
 class GPU {
 public:
     bool hitVBlank;
-    int modeclock;
+    // master clock at the start of the line in LY
+    u64 lineStart;
     int DMATicks;
+    // LY matches LYC and STAT enables the interrupt for it
+    bool coincidenceInterrupt;
 
     bool useCustomPalette;
     bool showViewportBorder;
 
-    std::map<u8, std::array<u8, 3>> customPalette;
+    // indexed by DMG shade number
+    std::array<std::array<u8, 3>, 4> customPalette;
 public:
     GPU(CPU* cpu, MMU* mmu);
     void reset();
-    void tick(u32 ticks);
+    void sync();
+    void scheduleNextEvent();
+    void endFrame();
+    void checkCoincidence();
+    void changeSpeed(bool doubleSpeed);
+    u32 ticksUntilModeChange();
     u8* getDisplayState();
     u8* getBackgroundState();
     u8* getTileData(int offset);
+    void invalidateTiles(u32 offset, u32 length);
+    void invalidateTileCache();
+    void invalidateSprites();
 
     u8 getMode();
     void setMode(GPU_MODE mode);
 
-    void setBGColor(u8 color);
+    void setColorCorrection(COLOR_CORRECTION correction);
+    COLOR_CORRECTION getColorCorrection() const { return colorCorrection; }
     void colorCorrect(u16 original, u8& r, u8& g, u8& b);
+    static void mapTileRow(const u8* row, const u16* colors, u16* out);
+    static void mapTileRowScalar(const u8* row, const u16* colors, u16* out);
 
     void serialize(serializer& s);
 private:
@@ -84,22 +125,50 @@ private:
 
     GPU_MODE mode;
     u32 wyc;
-
-    std::vector<Pixel> pixelLine;
-    std::vector<u8> displayState;
+    // the current line was drawn at the start of its HBLANK
+    bool lineRendered;
+    COLOR_CORRECTION colorCorrection;
+    // RGBA of every CGB color for the selected correction
+    const u32* colorTable;
+    void (GPU::*renderLine)();
+
+    // the line being drawn from LINE_PADDING on: BG palette index, PIXEL_ flags, the BG and the sprite
+    // DMG shade number or CGB color of every pixel
+    std::array<u8, LINE_BUFFER_SIZE> lineIndex;
+    std::array<u8, LINE_BUFFER_SIZE> lineFlags;
+    std::array<u16, LINE_BUFFER_SIZE> lineColor;
+    std::array<u16, LINE_BUFFER_SIZE> spriteColor;
+    StateSpan displayState;
+    // every tile as one palette index per pixel, the plain rows followed by the horizontally flipped ones,
+    // a tile is decoded again on its first use after a VRAM write
+    std::vector<u8> tileCache;
+    std::array<bool, TILE_COUNT> tileDirty;
+    // OAM indices of the sprites drawn on each line, rebuilt after OAM or the sprite size changed
+    std::array<std::array<u8, 10>, 144> lineSprites;
+    std::array<u8, 144> lineSpriteCount;
+    u8 spriteListSize;
+    bool spritesDirty;
+    // only used by the debugger, empty until it asks for them
     std::vector<u8> backgroundState;
-    std::vector<std::vector<u8>> background;
     std::vector<u8> tileData;
 private:
     u8 getReg(u16 regAddress);
     void setReg(u16 regAddress, u8 value);
 
-    void renderScanline();
-    void fetchTileData(bool mapSelect, u8 posY, u8 posX, u16& tile, u16& attribute, u16& data);
-    void renderBGScanline(bool fullLine = false, u8 yCoord = 0);
-    void renderWindowScanline();
-    void renderSpriteScanline();
-    unsigned hflip(unsigned data);
+    void startLine(u8 line);
+    u64 nextLineStart(u8 first, u8 last);
+
+    // the renderers are instantiated once per model, the right one is picked on reset
+    void selectModel();
+    template<GB_MODE MODE> void renderScanline();
+    template<GB_MODE MODE> const u8* fetchTileRow(bool mapSelect, u8 posY, u8 posX, u16& attribute);
+    template<GB_MODE MODE> void renderTiles(bool mapSelect, u8 posY, u8 posX, int x, int count);
+    template<GB_MODE MODE> void renderBGScanline(bool fullLine = false, u8 yCoord = 0);
+    template<GB_MODE MODE> void renderWindowScanline();
+    template<GB_MODE MODE> void renderSpriteScanline();
+    const u8* tileRow(u32 tileIndex, u8 y, bool flipX);
+    void decodeTile(u32 tileIndex);
+    void buildSpriteLists(u8 spriteSize);
     u16 getColor(u8 type, u16 attribute, u16 paletteIndex);
 };
 
@@ -0,0 +1,132 @@
+#include <cstring>
+
+#include "JIT.hpp"
+
+#if defined(PHOS_JIT) && defined(__x86_64__) && defined(__linux__)
+#define PHOS_JIT_X64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+constexpr size_t JIT_BUFFER_SIZE = 4 * 1024 * 1024;
+// upper bounds for the emitted code, see compile()
+constexpr size_t JIT_FRAME_SIZE = 32;
+constexpr size_t JIT_CALL_SIZE = 40;
+
+JIT::JIT(): buffer(nullptr), used(0), allocationFailed(false) {}
+
+JIT::~JIT() {
+#ifdef PHOS_JIT_X64
+    if (buffer) munmap(buffer, JIT_BUFFER_SIZE);
+#endif
+}
+
+bool JIT::isSupported() {
+#ifdef PHOS_JIT_X64
+    return !allocationFailed;
+#else
+    return false;
+#endif
+}
+
+bool JIT::allocate() {
+#ifdef PHOS_JIT_X64
+    void* memory = mmap(nullptr, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+        buffer = (u8*) memory;
+        return true;
+    }
+#endif
+    Log(W, "Failed to allocate JIT code buffer, falling back to the interpreter\n");
+    allocationFailed = true;
+    return false;
+}
+
+JIT::Block JIT::compile(Enter enter, u32 cycles, const std::vector<Call>& calls) {
+#ifdef PHOS_JIT_X64
+    if (calls.empty()) return nullptr;
+    if (!buffer && (allocationFailed || !allocate())) return nullptr;
+    // a full buffer has to be flushed by the caller together with all blocks pointing into it
+    size_t length = JIT_FRAME_SIZE + calls.size() * JIT_CALL_SIZE;
+    if (used + length > JIT_BUFFER_SIZE) return nullptr;
+
+    // the pages written to are never writable and executable at the same time
+    size_t offset = used;
+    if (!protect(offset, length, PROT_READ | PROT_WRITE)) return nullptr;
+
+    u8* start = buffer + used;
+    std::vector<size_t> exits;
+
+    // rbx holds the CPU pointer, pushing it also aligns the stack for the calls
+    emit(0x53);                                 // push rbx
+    emit(0x48); emit(0x89); emit(0xFB);         // mov rbx, rdi
+    emit(0xBE);                                 // mov esi, cycles
+    emit32(cycles);
+    emit(0x48); emit(0xB8);                     // mov rax, enter
+    emit64((u64) enter);
+    emit(0xFF); emit(0xD0);                     // call rax
+
+    for (size_t i=0; i<calls.size(); i++) {
+        emit(0x48); emit(0x89); emit(0xDF);     // mov rdi, rbx
+        emit(0x48); emit(0xBE);                 // mov rsi, operands
+        emit64((u64) calls[i].operands);
+        emit(0xBA);                             // mov edx, nextPc
+        emit32(calls[i].nextPc);
+        emit(0x48); emit(0xB8);                 // mov rax, step
+        emit64((u64) calls[i].step);
+        emit(0xFF); emit(0xD0);                 // call rax
+
+        if (i + 1 == calls.size()) break;
+        emit(0x84); emit(0xC0);                 // test al, al
+        emit(0x0F); emit(0x84);                 // jz exit
+        exits.push_back(used);
+        emit32(0);
+    }
+
+    size_t exit = used;
+    emit(0x5B);                                 // pop rbx
+    emit(0xC3);                                 // ret
+
+    for (size_t offset : exits) {
+        u32 displacement = exit - (offset + 4);
+        std::memcpy(buffer + offset, &displacement, 4);
+    }
+
+    if (!protect(offset, length, PROT_READ | PROT_EXEC)) {
+        Log(W, "Failed to make JIT code buffer executable, falling back to the interpreter\n");
+        allocationFailed = true;
+        return nullptr;
+    }
+    return (Block) start;
+#else
+    return nullptr;
+#endif
+}
+
+#ifdef PHOS_JIT_X64
+// changes the protection of the pages overlapping the given range of the buffer
+bool JIT::protect(size_t offset, size_t length, int protection) {
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t first = offset & ~(pageSize - 1);
+    size_t last = std::min(offset + length, JIT_BUFFER_SIZE);
+    return mprotect(buffer + first, last - first, protection) == 0;
+}
+#endif
+
+void JIT::flush() {
+    used = 0;
+}
+
+void JIT::emit(u8 byte) {
+    buffer[used++] = byte;
+}
+
+void JIT::emit32(u32 value) {
+    std::memcpy(buffer + used, &value, 4);
+    used += 4;
+}
+
+void JIT::emit64(u64 value) {
+    std::memcpy(buffer + used, &value, 8);
+    used += 8;
+}
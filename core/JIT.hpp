@@ -0,0 +1,41 @@
+#ifndef PHOS_JIT_HPP
+#define PHOS_JIT_HPP
+
+#include "Common.hpp"
+
+class CPU;
+
+// x86-64 code generator for decoded ROM blocks
+// the emitted code first hands the cycle total of the block to the CPU, which checks it against
+// the next scheduler event once, then calls one specialized step function per instruction and
+// leaves the block as soon as a step returns false
+class JIT {
+public:
+    typedef bool (*Step)(CPU* cpu, const u8* operands, u16 nextPc);
+    typedef void (*Block)(CPU* cpu);
+    typedef void (*Enter)(CPU* cpu, u32 cycles);
+
+    struct Call {
+        Step step;
+        const u8* operands;
+        u16 nextPc;
+    };
+public:
+    JIT();
+    ~JIT();
+    bool isSupported();
+    Block compile(Enter enter, u32 cycles, const std::vector<Call>& calls);
+    void flush();
+private:
+    bool allocate();
+    bool protect(size_t offset, size_t length, int protection);
+    void emit(u8 byte);
+    void emit32(u32 value);
+    void emit64(u64 value);
+private:
+    u8* buffer;
+    size_t used;
+    bool allocationFailed;
+};
+
+#endif //PHOS_JIT_HPP
@@ -3,6 +3,26 @@
 
 MBC::MBC(MMU *mmu) : mmu(mmu), ROMBankPtr(0), RAMBankPtr(0) {}
 
+const u8* MBC::ROMBank() {
+    return ROMBankAt(ROMBankPtr);
+}
+
+// cartridge RAM has to be enabled first, every MBC does that differently
+u8* MBC::RAMBank() {
+    return nullptr;
+}
+
+// banks that don't exist in the cartridge are left to the read and write functions
+const u8* MBC::ROMBankAt(size_t index) {
+    if ((index + 1) * ROM_BANK_SIZE > mmu->ROM.size()) return nullptr;
+    return &mmu->ROM[index * ROM_BANK_SIZE];
+}
+
+u8* MBC::RAMBankAt(size_t index) {
+    if ((index + 1) * RAM_BANK_SIZE > mmu->RAM.size()) return nullptr;
+    return &mmu->RAM[index * RAM_BANK_SIZE];
+}
+
 // NO_MBC
 
 NO_MBC::NO_MBC(MMU *mmu) : MBC(mmu) {
@@ -31,6 +51,10 @@ void NO_MBC::serialize(serializer &s) {
     s.integer(RAMBankPtr);
 }
 
+u8* NO_MBC::RAMBank() {
+    return RAMBankAt(0);
+}
+
 // MBC1
 
 MBC1::MBC1(MMU *mmu) : MBC(mmu), RAMEnable(false), ROM_RAM_ModeSelect(0) {}
@@ -93,6 +117,10 @@ void MBC1::serialize(serializer &s) {
     s.integer(ROM_RAM_ModeSelect);
 }
 
+u8* MBC1::RAMBank() {
+    return RAMEnable ? RAMBankAt(RAMBankPtr) : nullptr;
+}
+
 // MBC2
 
 MBC2::MBC2(MMU *mmu) : MBC(mmu), RAMEnable(false) {}
@@ -236,6 +264,11 @@ void MBC3::serialize(serializer &s) {
     s.array(RTCRegisters);
 }
 
+// the RTC registers are mapped to the same range
+u8* MBC3::RAMBank() {
+    return (RAM_RTC_Enable && RAM_RTC_ModeSelect == 0) ? RAMBankAt(RAMBankPtr) : nullptr;
+}
+
 // MBC 5
 
 MBC5::MBC5(MMU* mmu, bool hasRumble) : MBC(mmu), RAMEnable(false), hasRumble(hasRumble) {
@@ -291,3 +324,13 @@ void MBC5::serialize(serializer &s) {
     s.integer(RAMEnable);
     s.integer(hasRumble);
 }
+
+// bank 0 can be mapped here as well
+const u8* MBC5::ROMBank() {
+    if (ROMBankPtr == 0) return mmu->ROM_0.data();
+    return ROMBankAt(ROMBankPtr - 1);
+}
+
+u8* MBC5::RAMBank() {
+    return RAMEnable ? RAMBankAt(RAMBankPtr) : nullptr;
+}
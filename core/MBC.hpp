@@ -16,10 +16,17 @@ public:
     virtual u8 readRAMByte(u16 address) = 0;
     virtual void writeRAMByte(u16 address, u8 value) = 0;
     virtual void serialize(serializer& s) = 0;
+    // host memory behind 0x4000-0x7FFF and 0xA000-0xBFFF,
+    // nullptr if the whole bank isn't plain memory and accesses have to go through the functions above
+    virtual const u8* ROMBank();
+    virtual u8* RAMBank();
 public:
     MMU* mmu;
     u16 ROMBankPtr;
     u16 RAMBankPtr;
+protected:
+    const u8* ROMBankAt(size_t index);
+    u8* RAMBankAt(size_t index);
 };
 
 class NO_MBC : public MBC {
@@ -30,6 +37,7 @@ public:
     u8 readRAMByte(u16 address) override;
     void writeRAMByte(u16 address, u8 value) override;
     void serialize(serializer& s) override;
+    u8* RAMBank() override;
 };
 
 class MBC1 : public MBC {
@@ -40,6 +48,7 @@ public:
     u8 readRAMByte(u16 address) override;
     void writeRAMByte(u16 address, u8 value) override;
     void serialize(serializer& s) override;
+    u8* RAMBank() override;
 private:
     bool RAMEnable;
     u8 ROM_RAM_ModeSelect;
@@ -65,6 +74,7 @@ public:
     u8 readRAMByte(u16 address) override;
     void writeRAMByte(u16 address, u8 value) override;
     void serialize(serializer& s) override;
+    u8* RAMBank() override;
     void latchClockData();
 public:
     long latchedTime;
@@ -84,6 +94,8 @@ public:
     u8 readRAMByte(u16 address) override;
     void writeRAMByte(u16 address, u8 value) override;
     void serialize(serializer& s) override;
+    const u8* ROMBank() override;
+    u8* RAMBank() override;
 private:
     bool RAMEnable;
     bool hasRumble;
@@ -1,8 +1,10 @@
+#include <cstring>
+
 #include "MMU.hpp"
 #include "CPU.hpp"
 #include "GPU.hpp"
 
-MMU::MMU() :
+MMU::MMU(StateArena& arena) :
     cpu(nullptr),
     gpu(nullptr),
     inBIOS(true),
@@ -10,28 +12,37 @@ MMU::MMU() :
     WRAMBankPtr(1),
     VRAMBankPtr(0),
     BIOS(BIOS_SIZE_DMG, 0),
-    ROM_0(ROM_BANK_SIZE, 0),
-    // init ROM and RAM with capacity of NO_MBC cartridge
-    ROM(ROM_BANK_SIZE, 0),
+    // init RAM with capacity of NO_MBC cartridge
     RAM(RAM_BANK_SIZE, 0),
-    WRAM(WRAM_SIZE, 0),
-    IO(IO_SIZE, 0),
-    ZRAM(ZRAM_SIZE, 0),
-    VRAM(VRAM_SIZE, 0),
-    OAM(OAM_SIZE, 0),
-    PaletteMemory(128, 0xFF),
+    WRAM(arena.block(STATE_WRAM)),
+    IO(arena.block(STATE_IO)),
+    ZRAM(arena.block(STATE_ZRAM)),
+    VRAM(arena.block(STATE_VRAM)),
+    OAM(arena.block(STATE_OAM)),
+    PaletteMemory(arena.block(STATE_PALETTE)),
     mbc(nullptr),
     DMACounter(0),
     GDMACounter(0),
     HDMACounter(0)
     {
+    WRAM.resize(WRAM_SIZE);
+    VRAM.resize(VRAM_SIZE);
+    std::fill(PaletteMemory.begin(), PaletteMemory.end(), 0xFF);
     VramDma.reset();
+    readPages.fill(nullptr);
+    writePages.fill(nullptr);
     initTables();
 }
 
 bool MMU::init(std::string& romPath, std::string& biosPath) {
-    std::vector<u8> buffer;
-    if (!loadFile(romPath, FileType::ROM, buffer)) return false;
+    std::shared_ptr<const RomImage> image = RomImage::open(romPath);
+    if (!image) return false;
+    RomSpan buffer = image->span(0, image->size());
+    // check type id and underlying value
+    if (buffer.size() < 0x150 || !ROMSizeTypes.count(buffer[0x148]) || ROMSizeTypes[buffer[0x148]] != (long) buffer.size()) {
+        Log(W, "Cartridge type %d with size %li is invalid\n", buffer.size() < 0x150 ? -1 : buffer[0x148], buffer.size());
+        return false;
+    }
 
     u8 cartridgeType = buffer[0x147];
     u8 RAMType = buffer[0x149];
@@ -125,9 +136,10 @@ bool MMU::init(std::string& romPath, std::string& biosPath) {
         Log(W, "Cartridge type and RAM size type don't match\n");
     }
 
-    std::copy_n(buffer.begin(), ROM_BANK_SIZE, ROM_0.begin());
-    ROM.resize(buffer.size() - ROM_BANK_SIZE);
-    std::copy(buffer.begin() + ROM_BANK_SIZE, buffer.end(), ROM.begin());
+    // both ROM regions point into the shared image
+    romImage = image;
+    ROM_0 = image->span(0, ROM_BANK_SIZE);
+    ROM = image->span(ROM_BANK_SIZE, image->size() - ROM_BANK_SIZE);
 
     if (cartridgeType == 0x05 || cartridgeType == 0x06) {
         RAM.resize(512, 0);
@@ -167,6 +179,7 @@ bool MMU::init(std::string& romPath, std::string& biosPath) {
 
     VramDma.reset();
     DMACounter = 0, GDMACounter = 0, HDMACounter = 0;
+    mapMemory();
     printCartridgeInfo(buffer);
     return true;
 }
@@ -195,11 +208,6 @@ bool MMU::loadFile(std::string& path, FileType fileType, std::vector<u8>& buffer
                 return true;
             Log(W, "Invalid BootROM size: %li. Starting ROM without BIOS.\n", length);
             return false;
-        case FileType::ROM:
-            // check type id and underlying value
-            if (ROMSizeTypes.count(buffer[0x148]) && ROMSizeTypes[buffer[0x148]] == length) return true;
-            Log(W, "Cartridge type %d with size %li is invalid\n", buffer[0x148], length);
-            return false;
         case FileType::SRAM:
             if (buffer.size() < 517) {
                 Log(W, "File %s is too small to be a valid .sav file\n", path.c_str());
@@ -236,13 +244,19 @@ bool MMU::loadFile(std::string& path, FileType fileType, std::vector<u8>& buffer
 }
 
 u8 MMU::readByte(u16 address) {
+    const u8* page = readPages[address >> PAGE_SHIFT];
+    if (page) return page[address & (PAGE_SIZE - 1)];
+
     switch (address & 0xF000) {
         case 0x0000:
         case 0x1000:
         case 0x2000:
         case 0x3000:
             if (inBIOS && address < 0x0100) return BIOS[address];
-            else if (inBIOS && address == 0x0100) inBIOS = false;
+            else if (inBIOS && address == 0x0100) {
+                inBIOS = false;
+                mapMemory();
+            }
             return ROM_0[address];
         case 0x4000:
         case 0x5000:
@@ -295,12 +309,80 @@ u8 MMU::readByte(u16 address) {
     }
 }
 
+// length bytes of VRAM, WRAM or HRAM, nullptr if the range leaves the region or could have side effects
+u8* MMU::plainMemory(u16 address, u32 length) {
+    u32 end = address + length;
+    if (address >= 0x8000 && end <= 0xA000) {
+        u32 offset = address - 0x8000;
+        if (cpu->gbMode == CGB) offset += VRAMBankPtr * VRAM_BANK_SIZE;
+        return &VRAM[offset];
+    }
+    if (address >= 0xC000 && end <= 0xD000) return &WRAM[address - 0xC000];
+    if (address >= 0xD000 && end <= 0xE000) {
+        u32 offset = address - 0xC000;
+        if (cpu->gbMode == CGB) offset += WRAMBankPtr * WRAM_BANK_SIZE;
+        return &WRAM[offset];
+    }
+    if (address >= 0xFF80 && end <= 0xFFFF) return &ZRAM[address - 0xFF80];
+    return nullptr;
+}
+
+// points the page table at the current banks, called whenever a bank or the BIOS mapping changes
+void MMU::mapMemory() {
+    // the BIOS covers the first page and leaving it is detected on the second
+    mapPages(0x00, 0x40, ROM_0.data(), nullptr);
+    if (inBIOS) {
+        mapPages(0x00, 0x01, BIOS.data(), nullptr);
+        mapPages(0x01, 0x01, nullptr, nullptr);
+    }
+    mapCartridge();
+    mapVRAM();
+    mapWRAM();
+    // echo RAM always mirrors the first 8KB and ignores writes
+    mapPages(0xE0, 0x1E, &WRAM[0], nullptr);
+}
+
+// most writes to the MBC select the bank that is already mapped
+void MMU::mapCartridge() {
+    const u8* ROMBank = mbc->ROMBank();
+    u8* RAMBank = RAM.empty() ? nullptr : mbc->RAMBank();
+    if (ROMBank != readPages[0x40]) mapPages(0x40, 0x40, ROMBank, nullptr);
+    if (RAMBank != writePages[0xA0]) mapPages(0xA0, 0x20, RAMBank, RAMBank);
+}
+
+void MMU::mapVRAM() {
+    u32 offset = (cpu->gbMode == CGB) ? VRAMBankPtr * VRAM_BANK_SIZE : 0;
+    // writes go through writeByte so the GPU hears about changed tiles
+    mapPages(0x80, 0x20, &VRAM[offset], nullptr);
+}
+
+void MMU::mapWRAM() {
+    u32 offset = 0x1000 + ((cpu->gbMode == CGB) ? WRAMBankPtr * WRAM_BANK_SIZE : 0);
+    mapPages(0xC0, 0x10, &WRAM[0], &WRAM[0]);
+    mapPages(0xD0, 0x10, &WRAM[offset], &WRAM[offset]);
+}
+
+void MMU::mapPages(u8 first, u8 count, const u8* read, u8* write) {
+    for (u32 i=0; i<count; i++) {
+        readPages[first + i] = read ? read + i * PAGE_SIZE : nullptr;
+        writePages[first + i] = write ? write + i * PAGE_SIZE : nullptr;
+    }
+}
+
 u16 MMU::readWord(u16 address) {
     assert(address + 1 <= 0xFFFF);
     return readByte(address) | (readByte(address + 1) << 8);
 }
 
 void MMU::writeByte(u16 address, u8 value) {
+    if (cpu->cachedInterpreter || cpu->jitEnabled) cpu->invalidateCode(address);
+
+    u8* page = writePages[address >> PAGE_SHIFT];
+    if (page) {
+        page[address & (PAGE_SIZE - 1)] = value;
+        return;
+    }
+
     switch (address & 0xF000) {
         case 0x0000:
         case 0x1000:
@@ -311,12 +393,14 @@ void MMU::writeByte(u16 address, u8 value) {
         case 0x6000:
         case 0x7000:
             mbc->writeROMByte(address, value);
+            mapCartridge();
             return;
         case 0x8000:
-        case 0x9000:
-            if (cpu->gbMode == DMG) VRAM[address - 0x8000] = value;
-            else if (cpu->gbMode == CGB) VRAM[(address - 0x8000) + VRAMBankPtr * VRAM_BANK_SIZE] = value;
-            return;
+        case 0x9000: {
+            u32 offset = (address - 0x8000) + ((cpu->gbMode == CGB) ? VRAMBankPtr * VRAM_BANK_SIZE : 0);
+            VRAM[offset] = value;
+            gpu->invalidateTiles(offset, 1);
+            return; }
         case 0xA000:
         case 0xB000:
             if (RAM.empty()) return;
@@ -336,6 +420,7 @@ void MMU::writeByte(u16 address, u8 value) {
             if (address <= 0xFDFF) return;
             if (address <= 0xFE9F) {
                 OAM[address - 0xFE00] = value;
+                gpu->invalidateSprites();
                 return;
             }
             if (address <= 0xFEFF) {
@@ -354,13 +439,10 @@ void MMU::writeByte(u16 address, u8 value) {
                         IO[0x40] = value;
                         if (wasLCDEnabled && !(value & LCD_DISPLAY_ENABLE)) {
                             //assert(gpu->getMode() == VBLANK && "Tried to disable display outside of VBLANK period\n");
-                            gpu->setBGColor(0xFF);      // set display to all white
                             // reset some STAT values
                             // TODO: see if this is right
                             // i.e. compare with "https://www.reddit.com/r/EmuDev/comments/6r6gf3/gb_pokemon_gold_spews_unexpected_values_at_mbc/dl5c0ub"
-                            IO[LCDC_Y_COORDINATE - 0xFF00] = 153;
-                            gpu->modeclock = 456;
-                            gpu->setMode(VBLANK);
+                            gpu->endFrame();
                         }
                         break; }
                     case 0x41:      // LCDC Stat
@@ -369,9 +451,18 @@ void MMU::writeByte(u16 address, u8 value) {
                     case 0x44:      // LY (line) (Read-only)
                         return;
                     case 0x46: {    // Start DMA transfer
-                        u16 source = value << (u16) 8;
-                        for (int i=0; i<0xA0; i++) {
-                            writeByte(0xFE00 + i, readByte(source + i));
+                        // the source never leaves its page
+                        const u8* source = readPages[value];
+                        if (source) {
+                            std::memcpy(OAM.data(), source, OAM_SIZE);
+                            gpu->invalidateSprites();
+                            if (cpu->cachedInterpreter || cpu->jitEnabled) {
+                                for (int i=0; i<OAM_SIZE; i++) cpu->invalidateCode(0xFE00 + i);
+                            }
+                        } else {
+                            for (int i=0; i<OAM_SIZE; i++) {
+                                writeByte(0xFE00 + i, readByte((value << 8) + i));
+                            }
                         }
                         IO[relAddress] = value;
                         cpu->gpu.DMATicks = 648;
@@ -385,6 +476,7 @@ void MMU::writeByte(u16 address, u8 value) {
                         if (cpu->gbMode != CGB) return;
                         VRAMBankPtr = value & 0x01;
                         IO[relAddress] = VRAMBankPtr;
+                        mapVRAM();
                         break;
                     case 0x55: {    // VRAM DMA Transfer (CGB Mode Only)
                         if (cpu->gbMode != CGB) return;
@@ -396,6 +488,7 @@ void MMU::writeByte(u16 address, u8 value) {
                             if (!VramDma.enabled) {
                                 VramDma.enabled = true;
                                 HDMACounter++;
+                                gpu->scheduleNextEvent();
                             }
                         } else {
                             if (VramDma.enabled) {
@@ -429,6 +522,7 @@ void MMU::writeByte(u16 address, u8 value) {
                         IO[relAddress] = WRAMBankPtr;
                         if (WRAMBankPtr == 0x00) WRAMBankPtr = 1;
                         WRAMBankPtr--;
+                        mapWRAM();
                         break;
                     case 0x74:
                         if (cpu->gbMode != CGB) return;
@@ -459,9 +553,7 @@ void MMU::performHDMA() {
     assert(dest >= 0x8000 && dest <= 0x9FFF);
 
     // copy 16 bytes into VRAM
-    for (unsigned i=0; i<16; i++) {
-        writeByte(dest + i, readByte(source + i));
-    }
+    copyDMA(source, dest, 16);
 
     // update the remaining transfer length
     VramDma.transferLength -= 16;
@@ -502,9 +594,7 @@ void MMU::performGDMA() {
     assert((source <= 0x7FFF) || (source >= 0xA000 && source <= 0xDFFF));
     assert(dest >= 0x8000 && dest <= 0x9FFF);
 
-    for (unsigned i=0; i<VramDma.transferLength; i++) {
-        writeByte(dest+i, readByte(source+i));
-    }
+    copyDMA(source, dest, VramDma.transferLength);
 
     for (unsigned r=0; r<5; r++) {
         IO[0x51+r] = 0xFF;
@@ -518,6 +608,33 @@ void MMU::performGDMA() {
     cpu->cycles += transferCycles;
 }
 
+// copies length bytes from source to VRAM a page at a time, both wrap around like the HDMA registers
+void MMU::copyDMA(u16 source, u16 dest, u16 length) {
+    while (length > 0) {
+        u16 chunk = std::min<u16>(length, PAGE_SIZE - std::max(source & (PAGE_SIZE - 1), dest & (PAGE_SIZE - 1)));
+        const u8* from = readPages[source >> PAGE_SHIFT];
+        u8* to = writePages[dest >> PAGE_SHIFT];
+        if (to) to += dest & (PAGE_SIZE - 1);
+        // VRAM is only mapped for reads
+        bool toVRAM = dest >= 0x8000 && dest < 0xA000;
+        if (toVRAM) to = plainMemory(dest, chunk);
+        if (from && to) {
+            std::memcpy(to, from + (source & (PAGE_SIZE - 1)), chunk);
+            if (toVRAM) gpu->invalidateTiles(to - VRAM.data(), chunk);
+            if (cpu->cachedInterpreter || cpu->jitEnabled) {
+                for (u16 i=0; i<chunk; i++) cpu->invalidateCode(dest + i);
+            }
+        } else {
+            for (u16 i=0; i<chunk; i++) writeByte(dest + i, readByte(source + i));
+        }
+        length -= chunk;
+        source += chunk;
+        dest += chunk;
+        if (source == 0x8000) source = 0xA000;
+        if (dest == 0xA000) dest = 0x8000;
+    }
+}
+
 void MMU::writeWord(u16 address, u16 value) {
     assert(address + 1 <= 0xFFFF);
     u8 low = value & 0xFF;
@@ -546,6 +663,11 @@ void MMU::serialize(serializer &s) {
     if (!RAM.empty())
         s.array(RAM.data(), RAM.size());
     mbc->serialize(s);
+    if (s.mode() == serializer::Load) {
+        mapMemory();
+        gpu->invalidateTileCache();
+        gpu->invalidateSprites();
+    }
 }
 
 void MMU::initTables() {
@@ -608,7 +730,7 @@ void MMU::initTables() {
     RAMSizeTypes[0x05] = 65536;
 }
 
-void MMU::printCartridgeInfo(std::vector<u8>& buffer) {
+void MMU::printCartridgeInfo(RomSpan buffer) {
     cartridgeTitle = std::string(&buffer[0x134], &buffer[0x134] + 0xF);
     u8 cartridgeType = buffer[0x147];
 
@@ -3,11 +3,14 @@
 
 #include <fstream>
 #include <algorithm>
+#include <array>
 #include <map>
 #include <memory>
 
 #include "Common.hpp"
 #include "MBC.hpp"
+#include "RomImage.hpp"
+#include "StateArena.hpp"
 
 constexpr int BIOS_SIZE_DMG = 256;
 constexpr int BIOS_SIZE_CGB = 2048;
@@ -18,12 +21,18 @@ constexpr int VRAM_SIZE     = 8192;
 constexpr int OAM_SIZE      = 160;
 constexpr int IO_SIZE       = 128;
 constexpr int ZRAM_SIZE     = 128;
+constexpr int PALETTE_MEMORY_SIZE = 128;
 
 // CGB Mode Only
 constexpr int WRAM_BANK_SIZE = 4096;
 constexpr int VRAM_BANK_SIZE = 8192;
 
-enum FileType { BIOS, ROM, SRAM };
+// the memory map is split into pages of 256 bytes
+constexpr int PAGE_SHIFT = 8;
+constexpr int PAGE_SIZE  = 1 << PAGE_SHIFT;
+constexpr int PAGE_COUNT = 0x10000 >> PAGE_SHIFT;
+
+enum FileType { BIOS, SRAM };
 enum VramDmaMode { GENERAL_PURPOSE, DURING_HBLANK };
 
 class CPU;
@@ -38,15 +47,19 @@ struct VRAM_DMA {
 
 class MMU {
 public:
-    MMU();
+    MMU(StateArena& arena);
     bool init(std::string& romPath, std::string& biosPath);
 
     u8 readByte(u16 address);
     u16 readWord(u16 address);
     void writeByte(u16 address, u8 value);
     void writeWord(u16 address, u16 value);
+    u8* plainMemory(u16 address, u32 length);
+    // the mapped page holding address, nullptr if reading it needs readByte
+    const u8* readPage(u16 address) const { return readPages[address >> PAGE_SHIFT]; }
+    void mapMemory();
 
-    void printCartridgeInfo(std::vector<u8>& buffer);
+    void printCartridgeInfo(RomSpan buffer);
 
     void performHDMA();
     void performGDMA();
@@ -64,15 +77,18 @@ public:
     VRAM_DMA VramDma;
 
     std::vector<u8> BIOS;
-    std::vector<u8> ROM_0;
-    std::vector<u8> ROM;
+    // the first ROM bank and everything after it, both read-only views into romImage
+    std::shared_ptr<const RomImage> romImage;
+    RomSpan ROM_0;
+    RomSpan ROM;
     std::vector<u8> RAM;
-    std::vector<u8> WRAM;
-    std::vector<u8> IO;
-    std::vector<u8> ZRAM;
-    std::vector<u8> VRAM;
-    std::vector<u8> OAM;
-    std::vector<u8> PaletteMemory;
+    // everything with a fixed size lives in the CPU's state arena
+    StateSpan WRAM;
+    StateSpan IO;
+    StateSpan ZRAM;
+    StateSpan VRAM;
+    StateSpan OAM;
+    StateSpan PaletteMemory;
 
     std::string cartridgeTitle;
     std::map<u8, std::string> cartridgeTypes;
@@ -85,9 +101,19 @@ public:
     size_t DMACounter;
     size_t GDMACounter;
     size_t HDMACounter;
+private:
+    // host memory of every page that can be accessed without side effects,
+    // nullptr sends the access through the switch in readByte and writeByte
+    std::array<const u8*, PAGE_COUNT> readPages;
+    std::array<u8*, PAGE_COUNT> writePages;
 private:
     bool loadFile(std::string& path, FileType fileType, std::vector<u8>& buffer);
     void initTables();
+    void mapCartridge();
+    void mapVRAM();
+    void mapWRAM();
+    void mapPages(u8 first, u8 count, const u8* read, u8* write);
+    void copyDMA(u16 source, u16 dest, u16 length);
 };
 
 #endif //PHOS_MMU_HPP
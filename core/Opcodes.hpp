@@ -0,0 +1,111 @@
+#ifndef PHOS_OPCODES_HPP
+#define PHOS_OPCODES_HPP
+
+#include "Common.hpp"
+
+// decoding rules shared by the block cache, the JIT, the idle loop detection and phos-recomp
+
+// number of immediate bytes following each opcode
+constexpr u8 operandLengths[256] = {
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    0, 2, 0, 0, 0, 0, 1, 0, 2, 0, 0, 0, 0, 0, 1, 0,     // 0x00
+    0, 2, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 1, 0,     // 0x10
+    1, 2, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 1, 0,     // 0x20
+    1, 2, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 1, 0,     // 0x30
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x40
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x50
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x60
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x70
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x80
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x90
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0xA0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0xB0
+    0, 0, 2, 2, 2, 0, 1, 0, 0, 0, 2, 0, 2, 2, 1, 0,     // 0xC0
+    0, 0, 2, 0, 2, 0, 1, 0, 0, 0, 2, 0, 2, 0, 1, 0,     // 0xD0
+    1, 0, 0, 0, 0, 0, 1, 0, 1, 0, 2, 0, 0, 0, 1, 0,     // 0xE0
+    1, 0, 0, 0, 0, 0, 1, 0, 1, 0, 2, 0, 0, 0, 1, 0,     // 0xF0
+};
+
+// conditional jumps stay inside the block, a taken branch simply leaves it
+constexpr bool endsBlock(u8 opcode) {
+    switch (opcode) {
+        case 0x10: case 0x18: case 0x76: case 0xC3:
+        case 0xC9: case 0xCD: case 0xD9: case 0xE9:
+            return true;
+        default:
+            // RST
+            return (opcode & 0xC7) == 0xC7;
+    }
+}
+
+// opcodes that are not defined on the SM83
+constexpr bool isInvalidOpcode(u8 opcode) {
+    switch (opcode) {
+        case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB:
+        case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// instructions that change nothing but registers, the idle loop detection may repeat them at will
+constexpr bool isSideEffectFree(u8 opcode) {
+    // LD r,r' and LD r,(HL) but not LD (HL),r or HALT
+    if (opcode >= 0x40 && opcode < 0x80) return opcode < 0x70 || opcode > 0x77;
+    // ALU operations on A
+    if (opcode >= 0x80 && opcode < 0xC0) return true;
+    switch (opcode) {
+        case 0x00: case 0x01: case 0x11: case 0x21: case 0x31: case 0x03: case 0x13: case 0x23: case 0x33:
+        case 0x0B: case 0x1B: case 0x2B: case 0x3B: case 0x09: case 0x19: case 0x29: case 0x39:
+        case 0x04: case 0x05: case 0x06: case 0x0C: case 0x0D: case 0x0E: case 0x14: case 0x15:
+        case 0x16: case 0x1C: case 0x1D: case 0x1E: case 0x24: case 0x25: case 0x26: case 0x2C:
+        case 0x2D: case 0x2E: case 0x3C: case 0x3D: case 0x3E: case 0x07: case 0x0F: case 0x17:
+        case 0x1F: case 0x27: case 0x2F: case 0x37: case 0x3F: case 0x0A: case 0x1A: case 0x2A:
+        case 0x3A: case 0xF0: case 0xF2: case 0xFA: case 0xC6: case 0xCE: case 0xD6: case 0xDE:
+        case 0xE6: case 0xEE: case 0xF6: case 0xFE: case 0xE8: case 0xF8: case 0xF9:
+        // jumps, but no calls or returns
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// all CB instructions on registers, BIT is the only one that leaves (HL) alone
+constexpr bool isSideEffectFreeCB(u8 opcode) {
+    return (opcode & 0x07) != 6 || (opcode >= 0x40 && opcode < 0x80);
+}
+
+// cycles each opcode takes, conditional jumps, calls and returns counted as taken
+constexpr u8 maxCycles[256] = {
+//   0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F
+     4, 12,  8,  8,  4,  4,  8,  4, 20,  8,  8,  8,  4,  4,  8,  4,     // 0x00
+     4, 12,  8,  8,  4,  4,  8,  4, 12,  8,  8,  8,  4,  4,  8,  4,     // 0x10
+    12, 12,  8,  8,  4,  4,  8,  4, 12,  8,  8,  8,  4,  4,  8,  4,     // 0x20
+    12, 12,  8,  8, 12, 12, 12,  4, 12,  8,  8,  8,  4,  4,  8,  4,     // 0x30
+     4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,     // 0x40
+     4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,     // 0x50
+     4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,     // 0x60
+     8,  8,  8,  8,  8,  8,  4,  8,  4,  4,  4,  4,  4,  4,  8,  4,     // 0x70
+     4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,     // 0x80
+     4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,     // 0x90
+     4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,     // 0xA0
+     4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,     // 0xB0
+    20, 12, 16, 16, 24, 16,  8, 16, 20, 16, 16,  0, 24, 24,  8, 16,     // 0xC0
+    20, 12, 16,  0, 24, 16,  8, 16, 20, 16, 16,  0, 24,  0,  8, 16,     // 0xD0
+    12, 12,  8,  0,  0, 16,  8, 16, 16,  4, 16,  0,  0,  0,  8, 16,     // 0xE0
+    12, 12,  8,  4,  0, 16,  8, 16, 12,  8, 16,  4,  0,  0,  8, 16,     // 0xF0
+};
+
+// CB instructions on (HL) take longer, BIT only reads it
+constexpr u8 maxCyclesCB(u8 opcode) {
+    if ((opcode & 0x07) != 6) return 8;
+    return (opcode >= 0x40 && opcode < 0x80) ? 12 : 16;
+}
+
+// maximum number of instructions in a decoded block
+constexpr size_t MAX_BLOCK_LENGTH = 64;
+
+#endif //PHOS_OPCODES_HPP
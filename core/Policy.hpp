@@ -0,0 +1,29 @@
+#ifndef PHOS_POLICY_HPP
+#define PHOS_POLICY_HPP
+
+// feature sets a core can be built with, pick one with CPU::tick<P>() or Emulator::tick<P>()
+// every policy is instantiated in CPU.cpp, so any mix of them can run in the same binary
+namespace Policy {
+    // everything the hardware does, what the frontends and the regression tests run
+    struct Accurate {
+        // the APU frame sequencer runs and the APU produces samples
+        static constexpr bool audio = true;
+        // memory accesses inside an instruction see the clock at their own cycle
+        static constexpr bool subInstructionTiming = true;
+    };
+
+    // same timing, but nothing keeps the APU going
+    struct NoAudio {
+        static constexpr bool audio = false;
+        static constexpr bool subInstructionTiming = true;
+    };
+
+    // for bulk runs that only look at the game state, every access of an instruction
+    // happens at its first cycle
+    struct Fast {
+        static constexpr bool audio = false;
+        static constexpr bool subInstructionTiming = false;
+    };
+}
+
+#endif //PHOS_POLICY_HPP
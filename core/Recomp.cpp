@@ -0,0 +1,70 @@
+#include "Recomp.hpp"
+#include "MMU.hpp"
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define PHOS_RECOMP_DL
+#include <dlfcn.h>
+#endif
+
+RecompiledCode::RecompiledCode(): handle(nullptr) {}
+
+RecompiledCode::~RecompiledCode() {
+    unload();
+}
+
+bool RecompiledCode::load(std::string& path, const RomSpan& ROM_0, const RomSpan& ROM) {
+    unload();
+#ifdef PHOS_RECOMP_DL
+    handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        Log(W, "Failed to open recompiled code %s: %s\n", path.c_str(), dlerror());
+        return false;
+    }
+
+    auto pluginFunction = (RecompPluginFunction) dlsym(handle, RECOMP_PLUGIN_SYMBOL);
+    const RecompPlugin* plugin = pluginFunction ? pluginFunction() : nullptr;
+    if (!plugin || plugin->version != RECOMP_VERSION) {
+        Log(W, "File %s is not a compatible recompiled code plugin\n", path.c_str());
+        unload();
+        return false;
+    }
+
+    // only the fixed banks are recompiled, bank 1 only for cartridges without MBC
+    u32 checksum = recompChecksum(ROM_0.data(), std::min<size_t>(ROM_0.size(), plugin->end));
+    if (plugin->end > ROM_BANK_SIZE) {
+        checksum = recompChecksum(ROM.data(), std::min<size_t>(ROM.size(), plugin->end - ROM_BANK_SIZE), checksum);
+    }
+    if (plugin->end > 2 * ROM_BANK_SIZE || checksum != plugin->checksum) {
+        Log(W, "Recompiled code %s was built for a different ROM\n", path.c_str());
+        unload();
+        return false;
+    }
+
+    blocks.assign(plugin->end, nullptr);
+    for (u32 i=0; i<plugin->blockCount; i++) {
+        const RecompEntry& entry = plugin->blocks[i];
+        if (entry.address < plugin->end) blocks[entry.address] = &entry;
+    }
+    Log(I, "Loaded %u recompiled blocks from %s\n", plugin->blockCount, path.c_str());
+    return true;
+#else
+    Log(W, "Recompiled code is not supported on this platform\n");
+    return false;
+#endif
+}
+
+void RecompiledCode::unload() {
+    blocks.clear();
+#ifdef PHOS_RECOMP_DL
+    if (handle) dlclose(handle);
+#endif
+    handle = nullptr;
+}
+
+bool RecompiledCode::isLoaded() {
+    return handle != nullptr;
+}
+
+const RecompEntry* RecompiledCode::find(u16 address) {
+    return address < blocks.size() ? blocks[address] : nullptr;
+}
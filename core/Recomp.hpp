@@ -0,0 +1,77 @@
+#ifndef PHOS_RECOMP_HPP
+#define PHOS_RECOMP_HPP
+
+#include "Common.hpp"
+#include "RomImage.hpp"
+
+class CPU;
+
+// interface between the emulator and the plugins built from the output of phos-recomp
+// a plugin only contains fixed ROM banks, its blocks run their instructions inline and only call
+// back into the CPU for memory accesses, they fall back to the JIT steps if the block may see an event
+
+constexpr u32 RECOMP_VERSION = 2;
+#define RECOMP_PLUGIN_SYMBOL "phosRecompPlugin"
+
+typedef bool (*RecompStep)(CPU* cpu, const u8* operands, u16 nextPc);
+
+// what the generated code calls, elapsed is the number of cycles since the start of the block
+struct RecompHost {
+    // true if every cycle of the block fits before the next event, the flags are in r.f afterwards
+    bool (*enter)(CPU* cpu, u32 cycles);
+    u8 (*read)(CPU* cpu, u16 address, u32 elapsed);
+    u16 (*readWord)(CPU* cpu, u16 address, u32 elapsed);
+    // false if the block has to be left after the current instruction
+    bool (*write)(CPU* cpu, u16 address, u8 value, u32 elapsed);
+    bool (*writeWord)(CPU* cpu, u16 address, u16 value, u32 elapsed);
+    // backward jump from end to head
+    void (*loop)(CPU* cpu, u16 head, u16 end);
+    // the block ran for ticks cycles, last is the length of its last instruction
+    void (*leave)(CPU* cpu, u32 ticks, u32 last);
+    const RecompStep* steps;
+    const RecompStep* stepsCB;
+};
+
+typedef void (*RecompBlock)(CPU* cpu, const RecompHost& host);
+
+struct RecompEntry {
+    u16 address;
+    // built with and without sub-instruction timing
+    RecompBlock block[2];
+};
+
+struct RecompPlugin {
+    u32 version;
+    // checksum of the recompiled address range [0, end)
+    u32 checksum;
+    u32 end;
+    u32 blockCount;
+    const RecompEntry* blocks;
+};
+
+typedef const RecompPlugin* (*RecompPluginFunction)();
+
+// FNV-1a, can be chained over the separate ROM buffers
+inline u32 recompChecksum(const u8* data, size_t size, u32 hash = 0x811C9DC5) {
+    for (size_t i=0; i<size; i++) {
+        hash ^= data[i];
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+class RecompiledCode {
+public:
+    RecompiledCode();
+    ~RecompiledCode();
+    bool load(std::string& path, const RomSpan& ROM_0, const RomSpan& ROM);
+    void unload();
+    bool isLoaded();
+    const RecompEntry* find(u16 address);
+private:
+    void* handle;
+    // indexed by address, nullptr if no block starts there
+    std::vector<const RecompEntry*> blocks;
+};
+
+#endif //PHOS_RECOMP_HPP
@@ -0,0 +1,79 @@
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
+
+#include "RomImage.hpp"
+
+#if !defined(_WIN32)
+#define PHOS_ROM_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+RomImage::RomImage() : memory(nullptr), length(0), mapped(false), fileSize(-1), modificationTime(-1) {}
+
+RomImage::~RomImage() {
+#ifdef PHOS_ROM_MMAP
+    if (mapped) munmap((void*) memory, length);
+#endif
+}
+
+std::shared_ptr<const RomImage> RomImage::open(const std::string& path) {
+    // emulator instances can load ROMs from several threads
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<const RomImage>> images;
+
+    struct stat info {};
+    if (stat(path.c_str(), &info) != 0) {
+        Log(W, "Failed to open file %s\n", path.c_str());
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const RomImage> image = images[path].lock();
+    if (image && image->fileSize == info.st_size && image->modificationTime == info.st_mtime) return image;
+
+    std::shared_ptr<RomImage> newImage(new RomImage());
+    newImage->fileSize = info.st_size;
+    newImage->modificationTime = info.st_mtime;
+    if (!newImage->load(path)) return nullptr;
+    images[path] = newImage;
+    return newImage;
+}
+
+bool RomImage::load(const std::string& path) {
+    if (fileSize <= 0) {
+        Log(W, "Failed to load file %s\n", path.c_str());
+        return false;
+    }
+    length = fileSize;
+
+#ifdef PHOS_ROM_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        void* file = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (file != MAP_FAILED) {
+            memory = (const u8*) file;
+            mapped = true;
+            return true;
+        }
+    }
+    Log(I, "Could not map file %s, reading it instead\n", path.c_str());
+#endif
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        Log(W, "Failed to open file %s\n", path.c_str());
+        return false;
+    }
+    buffer.resize(length);
+    if (!file.read((char*) buffer.data(), length)) {
+        Log(W, "Failed to load file %s\n", path.c_str());
+        return false;
+    }
+    memory = buffer.data();
+    return true;
+}
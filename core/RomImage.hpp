@@ -0,0 +1,51 @@
+#ifndef PHOS_ROMIMAGE_HPP
+#define PHOS_ROMIMAGE_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Common.hpp"
+
+// read-only view into a cartridge image
+class RomSpan {
+public:
+    RomSpan() : ptr(nullptr), length(0) {}
+    RomSpan(const u8* ptr, size_t length) : ptr(ptr), length(length) {}
+
+    const u8& operator[](size_t index) const { return ptr[index]; }
+    const u8* data() const { return ptr; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    const u8* begin() const { return ptr; }
+    const u8* end() const { return ptr + length; }
+private:
+    const u8* ptr;
+    size_t length;
+};
+
+// cartridge contents, mapped straight from the file where the host supports it
+// MMUs that load the same unchanged file share one image
+class RomImage {
+public:
+    ~RomImage();
+    static std::shared_ptr<const RomImage> open(const std::string& path);
+
+    RomSpan span(size_t offset, size_t length) const { return RomSpan(memory + offset, length); }
+    const u8* data() const { return memory; }
+    size_t size() const { return length; }
+private:
+    RomImage();
+    bool load(const std::string& path);
+private:
+    const u8* memory;
+    size_t length;
+    bool mapped;
+    // holds the file on hosts without mmap
+    std::vector<u8> buffer;
+    // identifies the file version the image was made from
+    long long fileSize;
+    long long modificationTime;
+};
+
+#endif //PHOS_ROMIMAGE_HPP
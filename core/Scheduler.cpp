@@ -0,0 +1,99 @@
+#include "Scheduler.hpp"
+
+Scheduler::Scheduler() {
+    reset();
+}
+
+void Scheduler::reset() {
+    now = 0;
+    timestamps.fill(NEVER);
+    size = 0;
+    next = NEVER;
+}
+
+void Scheduler::schedule(EVENT_TYPE type, u64 timestamp) {
+    if (isScheduled(type)) {
+        u64 old = timestamps[type];
+        timestamps[type] = timestamp;
+        if (timestamp < old) siftUp(position[type]);
+        else siftDown(position[type]);
+    } else {
+        timestamps[type] = timestamp;
+        place(size++, type);
+        siftUp(size - 1);
+    }
+    next = timestamps[heap[0]];
+}
+
+void Scheduler::cancel(EVENT_TYPE type) {
+    if (!isScheduled(type)) return;
+    remove(position[type]);
+}
+
+EVENT_TYPE Scheduler::popDue(u64& timestamp) {
+    if (next > now) return EVENT_COUNT;
+    EVENT_TYPE type = heap[0];
+    timestamp = timestamps[type];
+    remove(0);
+    return type;
+}
+
+bool Scheduler::before(EVENT_TYPE a, EVENT_TYPE b) const {
+    if (timestamps[a] != timestamps[b]) return timestamps[a] < timestamps[b];
+    return a < b;
+}
+
+void Scheduler::place(u8 index, EVENT_TYPE type) {
+    heap[index] = type;
+    position[type] = index;
+}
+
+void Scheduler::siftUp(u8 index) {
+    EVENT_TYPE type = heap[index];
+    while (index > 0) {
+        u8 parent = (index - 1) / 2;
+        if (!before(type, heap[parent])) break;
+        place(index, heap[parent]);
+        index = parent;
+    }
+    place(index, type);
+}
+
+void Scheduler::siftDown(u8 index) {
+    EVENT_TYPE type = heap[index];
+    while (true) {
+        u8 child = index * 2 + 1;
+        if (child >= size) break;
+        if (child + 1 < size && before(heap[child + 1], heap[child])) child++;
+        if (!before(heap[child], type)) break;
+        place(index, heap[child]);
+        index = child;
+    }
+    place(index, type);
+}
+
+void Scheduler::remove(u8 index) {
+    EVENT_TYPE type = heap[index];
+    timestamps[type] = NEVER;
+    size--;
+    if (index != size) {
+        // move the last event into the gap, it can belong above or below it
+        EVENT_TYPE moved = heap[size];
+        place(index, moved);
+        siftUp(index);
+        siftDown(position[moved]);
+    }
+    next = size ? timestamps[heap[0]] : NEVER;
+}
+
+void Scheduler::serialize(serializer& s) {
+    s.integer(now);
+    for (u8 type=0; type<EVENT_COUNT; type++) {
+        u64 timestamp = timestamps[type];
+        s.integer(timestamp);
+        if (s.mode() == serializer::Load) {
+            cancel((EVENT_TYPE) type);
+            if (timestamp != NEVER) schedule((EVENT_TYPE) type, timestamp);
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef PHOS_SCHEDULER_HPP
+#define PHOS_SCHEDULER_HPP
+
+#include <array>
+
+#include "Common.hpp"
+
+// things that happen at a known point of the master clock
+// events due at the same time run in this order
+enum EVENT_TYPE : u8 {
+    EVENT_PPU,              // the PPU reaches a line or mode that raises an interrupt or starts HDMA
+    EVENT_PPU_COINCIDENCE,  // LY, LYC or STAT changed, compare LY with LYC again
+    EVENT_TIMER,            // TIMA overflowed a cycle ago and is reloaded with TMA
+    EVENT_APU_FRAME,        // the divider bit clocking the APU frame sequencer changes
+    EVENT_COUNT
+};
+
+constexpr u64 NEVER = ~(u64) 0;
+
+// binary min heap with at most one pending event per type
+class Scheduler {
+public:
+    // cycles since the last reset, everything but interrupt dispatch moves it
+    u64 now;
+public:
+    Scheduler();
+    void reset();
+    void schedule(EVENT_TYPE type, u64 timestamp);
+    void cancel(EVENT_TYPE type);
+    // removes the earliest event if it is due, returns EVENT_COUNT otherwise
+    EVENT_TYPE popDue(u64& timestamp);
+
+    bool isScheduled(EVENT_TYPE type) const { return timestamps[type] != NEVER; }
+    u64 timestamp(EVENT_TYPE type) const { return timestamps[type]; }
+    u64 nextEvent() const { return next; }
+
+    void serialize(serializer& s);
+private:
+    std::array<u64, EVENT_COUNT> timestamps;
+    std::array<EVENT_TYPE, EVENT_COUNT> heap;
+    // index of each scheduled type in the heap
+    std::array<u8, EVENT_COUNT> position;
+    u8 size;
+    // timestamp at the top of the heap, checked after every instruction
+    u64 next;
+private:
+    bool before(EVENT_TYPE a, EVENT_TYPE b) const;
+    void place(u8 index, EVENT_TYPE type);
+    void siftUp(u8 index);
+    void siftDown(u8 index);
+    void remove(u8 index);
+};
+
+#endif //PHOS_SCHEDULER_HPP
@@ -0,0 +1,59 @@
+#include <cstring>
+#include <new>
+
+#include "StateArena.hpp"
+#include "MMU.hpp"
+
+StateArena::StateArena() :
+    memory(static_cast<u8*>(::operator new(size(), std::align_val_t(STATE_ALIGNMENT)))) {
+    std::memset(memory.get(), 0, size());
+}
+
+void StateArena::AlignedDelete::operator()(u8* memory) const {
+    ::operator delete(memory, std::align_val_t(STATE_ALIGNMENT));
+}
+
+StateSpan StateArena::block(STATE_BLOCK type) {
+    const StateBlockLayout& block = layout()[type];
+    return StateSpan(memory.get() + block.offset, block.size);
+}
+
+void StateArena::snapshot(std::vector<u8>& buffer) const {
+    buffer.resize(size());
+    std::memcpy(buffer.data(), memory.get(), size());
+}
+
+void StateArena::restore(const std::vector<u8>& buffer) {
+    assert(buffer.size() == size());
+    std::memcpy(memory.get(), buffer.data(), size());
+}
+
+// a buffer belongs in the arena if its size is fixed and it can't be rebuilt from the other blocks,
+// so the display output is in it while cartridge RAM and the audio samples (their sizes vary)
+// and the tile cache and debug views (rebuilt from VRAM) are not
+// the layout only depends on the block sizes, it is the same for every instance and build
+const std::array<StateBlockLayout, STATE_BLOCK_COUNT>& StateArena::layout() {
+    static const std::array<StateBlockLayout, STATE_BLOCK_COUNT> blocks = [] {
+        std::array<StateBlockLayout, STATE_BLOCK_COUNT> table = {{
+            {"IO", 0, IO_SIZE},
+            {"ZRAM", 0, ZRAM_SIZE},
+            {"OAM", 0, OAM_SIZE},
+            {"Palette", 0, PALETTE_MEMORY_SIZE},
+            {"WRAM", 0, WRAM_BANK_SIZE * 8},
+            {"VRAM", 0, VRAM_BANK_SIZE * 2},
+            {"Display", 0, DISPLAY_TEXTURE_SIZE},
+        }};
+        size_t offset = 0;
+        for (StateBlockLayout& block : table) {
+            block.offset = offset;
+            offset += (block.size + STATE_ALIGNMENT - 1) & ~(STATE_ALIGNMENT - 1);
+        }
+        return table;
+    }();
+    return blocks;
+}
+
+size_t StateArena::size() {
+    const StateBlockLayout& last = layout().back();
+    return (last.offset + last.size + STATE_ALIGNMENT - 1) & ~(STATE_ALIGNMENT - 1);
+}
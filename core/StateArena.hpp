@@ -0,0 +1,70 @@
+#ifndef PHOS_STATEARENA_HPP
+#define PHOS_STATEARENA_HPP
+
+#include <array>
+#include <memory>
+
+#include "Common.hpp"
+
+// blocks of fixed size emulator state, in the order they are laid out in the arena
+enum STATE_BLOCK : u8 {
+    STATE_IO,
+    STATE_ZRAM,
+    STATE_OAM,
+    STATE_PALETTE,
+    STATE_WRAM,
+    STATE_VRAM,
+    STATE_DISPLAY,
+    STATE_BLOCK_COUNT
+};
+
+struct StateBlockLayout {
+    const char* name;
+    size_t offset;
+    size_t size;
+};
+
+// every block starts on its own cache line
+constexpr size_t STATE_ALIGNMENT = 64;
+
+// view into a block of the arena, DMG mode only uses the start of the CGB sized WRAM and VRAM blocks
+class StateSpan {
+public:
+    StateSpan() : ptr(nullptr), length(0), capacity(0) {}
+    StateSpan(u8* ptr, size_t capacity) : ptr(ptr), length(capacity), capacity(capacity) {}
+
+    u8& operator[](size_t index) { return ptr[index]; }
+    const u8& operator[](size_t index) const { return ptr[index]; }
+    u8* data() { return ptr; }
+    const u8* data() const { return ptr; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    u8* begin() { return ptr; }
+    u8* end() { return ptr + length; }
+    void resize(size_t size) { assert(size <= capacity); length = size; }
+private:
+    u8* ptr;
+    size_t length;
+    size_t capacity;
+};
+
+// all fixed size state of an emulator instance in a single aligned allocation,
+// taking a snapshot of it is one copy
+class StateArena {
+public:
+    StateArena();
+    StateSpan block(STATE_BLOCK type);
+    u8* data() { return memory.get(); }
+    void snapshot(std::vector<u8>& buffer) const;
+    void restore(const std::vector<u8>& buffer);
+
+    static const std::array<StateBlockLayout, STATE_BLOCK_COUNT>& layout();
+    static size_t size();
+private:
+    struct AlignedDelete {
+        void operator()(u8* memory) const;
+    };
+    std::unique_ptr<u8[], AlignedDelete> memory;
+};
+
+#endif //PHOS_STATEARENA_HPP
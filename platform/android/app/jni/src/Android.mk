@@ -17,9 +17,14 @@ CORE_FILES :=   $(CORE_PATH)/sound/blip_buf.c \
                 $(CORE_PATH)/CPU.cpp \
                 $(CORE_PATH)/Emulator.cpp \
                 $(CORE_PATH)/GPU.cpp \
+                $(CORE_PATH)/JIT.cpp \
                 $(CORE_PATH)/Joypad.cpp \
                 $(CORE_PATH)/MBC.cpp \
-                $(CORE_PATH)/MMU.cpp
+                $(CORE_PATH)/MMU.cpp \
+                $(CORE_PATH)/Recomp.cpp \
+                $(CORE_PATH)/RomImage.cpp \
+                $(CORE_PATH)/Scheduler.cpp \
+                $(CORE_PATH)/StateArena.cpp
 
 MAIN_FILES := $(LOCAL_PATH)/Main.cpp
 
@@ -122,6 +122,8 @@ void DebugHost::emulatorView(u8* data) {
 
     ImGui::Text("GB Mode: %s", (emulator->cpu.gbMode == DMG) ? "DMG" : "CGB");
     ImGui::Text("OAM DMAs: %zu  GDMAs: %zu  HDMAs: %zu", emulator->cpu.mmu.DMACounter, emulator->cpu.mmu.GDMACounter, emulator->cpu.mmu.HDMACounter);
+    ImGui::Text("Idle cycles skipped: %zu", emulator->cpu.idleCyclesSkipped);
+    emulator->cpu.materializeFlags();
     ImGui::Text("Registers:");
     ImGui::Text("PC: 0x%04X", emulator->cpu.r.pc);
     ImGui::Text("SP: 0x%04X", emulator->cpu.r.sp);
@@ -146,12 +148,14 @@ void DebugHost::memoryView() {
     static int currentItem = 0;
     ImGui::Combo("Location", &currentItem, items, IM_ARRAYSIZE(items));
 
+    // ROM is mapped read-only
+    editor.ReadOnly = currentItem < 2;
     switch (currentItem) {
         case 0:
-            editor.DrawContents(emulator->cpu.mmu.ROM_0.data(), emulator->cpu.mmu.ROM_0.size());
+            editor.DrawContents(const_cast<u8*>(emulator->cpu.mmu.ROM_0.data()), emulator->cpu.mmu.ROM_0.size());
             break;
         case 1:
-            editor.DrawContents(emulator->cpu.mmu.ROM.data(), emulator->cpu.mmu.ROM.size());
+            editor.DrawContents(const_cast<u8*>(emulator->cpu.mmu.ROM.data()), emulator->cpu.mmu.ROM.size());
             break;
         case 2:
             editor.DrawContents(emulator->cpu.mmu.WRAM.data(), emulator->cpu.mmu.WRAM.size());
@@ -170,9 +174,12 @@ void DebugHost::memoryView() {
             break;
         case 7:
             editor.DrawContents(emulator->cpu.mmu.VRAM.data(), emulator->cpu.mmu.VRAM.size());
+            // the editor writes to VRAM directly
+            emulator->cpu.gpu.invalidateTileCache();
             break;
         case 8:
             editor.DrawContents(emulator->cpu.mmu.OAM.data(), emulator->cpu.mmu.OAM.size());
+            emulator->cpu.gpu.invalidateSprites();
             break;
         case 9:
             editor.DrawContents(emulator->cpu.mmu.PaletteMemory.data(), emulator->cpu.mmu.PaletteMemory.size());
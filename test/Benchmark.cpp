@@ -0,0 +1,117 @@
+#include <chrono>
+
+#include "catch.hpp"
+#include "Emulator.hpp"
+#include "TestHelpers.hpp"
+
+// benchmarks are hidden from the default run, use ./test_runner [benchmark]
+
+TEST_CASE("CPU INSTRUCTION THROUGHPUT", "[.benchmark]") {
+    Emulator bench;
+    bench.cpu.headless = true;
+    std::string filePath = "../gb/blargg/cpu_instrs.gb";
+    REQUIRE(bench.load(filePath));
+
+    const char* mode = "interpreter";
+    bool fast = false;
+    SECTION("interpreter") {}
+    SECTION("interpreter, fast policy") {
+        fast = true;
+        mode = "interpreter, fast policy";
+    }
+    SECTION("cached interpreter") {
+        bench.cpu.cachedInterpreter = true;
+        mode = "cached interpreter";
+    }
+    SECTION("jit") {
+        bench.cpu.jitEnabled = true;
+        mode = "jit";
+    }
+
+    u64 frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::seconds(5);
+    while (std::chrono::steady_clock::now() < end) {
+        int ticks = 0;
+        while (ticks < bench.cpu.ticksPerFrame) {
+            ticks += fast ? bench.tick<Policy::Fast>() : bench.tick();
+        }
+        frames++;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // a tick runs a whole block in the cached and JIT modes, the instructions in those frames
+    // are counted by replaying them on the interpreter with one instruction per tick
+    Emulator replay;
+    replay.cpu.headless = true;
+    REQUIRE(replay.load(filePath));
+    u64 instructions = 0;
+    for (u64 frame=0; frame<frames; frame++) {
+        int ticks = 0;
+        while (ticks < replay.cpu.ticksPerFrame) {
+            ticks += fast ? replay.tick<Policy::Fast>() : replay.tick();
+            instructions++;
+        }
+    }
+
+#ifdef PHOS_TABLE_DISPATCH
+    const char* dispatch = "table";
+#else
+    const char* dispatch = "switch";
+#endif
+    WARN(mode << ", " << dispatch << " dispatch: " << (u64) (frames / elapsed.count()) << " frames per second, "
+              << (u64) (instructions / elapsed.count()) << " instructions per second");
+}
+
+TEST_CASE("CGB DMA COST PER FRAME", "[.benchmark]") {
+    // an empty CGB cartridge, the transfers don't need any code
+    Emulator bench;
+    bench.cpu.headless = true;
+    REQUIRE(loadBlankRom(bench, true));
+    MMU& mmu = bench.cpu.mmu;
+    REQUIRE(bench.cpu.gbMode == CGB);
+
+    // a scene that uploads its sprites, 2KB of tiles and a 16 byte block on every line
+    u64 frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::seconds(5);
+    while (std::chrono::steady_clock::now() < end) {
+        mmu.writeByte(0xFF46, 0xC1);
+        mmu.writeByte(0xFF51, 0xD0);
+        mmu.writeByte(0xFF52, 0x00);
+        mmu.writeByte(0xFF53, 0x08);
+        mmu.writeByte(0xFF54, 0x00);
+        mmu.writeByte(0xFF55, 0x7F);
+        mmu.writeByte(0xFF51, 0x40);
+        mmu.writeByte(0xFF53, 0x10);
+        mmu.writeByte(0xFF55, 0x80 | 143);
+        for (int line=0; line<144; line++) mmu.performHDMA();
+        frames++;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(mmu.OAM[0] == mmu.WRAM[0x100]);
+    WARN("DMA: " << (u64) (elapsed.count() * 1e9 / frames) << " ns per frame");
+}
+
+#ifdef __GLIBC__
+#include <malloc.h>
+
+TEST_CASE("HEADLESS INSTANCE FOOTPRINT", "[.benchmark]") {
+    // load the ROM once so its file and image aren't counted
+    Emulator warmup;
+    REQUIRE(loadBlankRom(warmup, true));
+
+    // heap in use by one loaded instance after a frame, the mapped ROM is shared and not counted
+    size_t before = mallinfo2().uordblks + mallinfo2().hblkhd;
+    {
+        auto bench = std::make_unique<Emulator>();
+        bench->cpu.headless = true;
+        REQUIRE(loadBlankRom(*bench, true));
+        int ticks = 0;
+        while (ticks < bench->cpu.ticksPerFrame) ticks += bench->tick();
+        size_t bytes = mallinfo2().uordblks + mallinfo2().hblkhd - before;
+        WARN("headless instance: " << bytes << " bytes, " << sizeof(Emulator) << " of them in Emulator");
+    }
+}
+#endif
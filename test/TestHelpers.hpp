@@ -0,0 +1,11 @@
+#ifndef PHOS_TESTHELPERS_HPP
+#define PHOS_TESTHELPERS_HPP
+
+#include "Emulator.hpp"
+
+// loads an empty 32KB cartridge, all calls with the same mode share one ROM file
+bool loadBlankRom(Emulator& emulator, bool cgb);
+// loads a cartridge built by the test, the file is removed again right after
+bool loadRomImage(Emulator& emulator, const std::vector<u8>& rom);
+
+#endif //PHOS_TESTHELPERS_HPP
@@ -1,7 +1,10 @@
 #include <chrono>
+#include <cstdio>
+#include <fstream>
 
 #include "catch.hpp"
 #include "Emulator.hpp"
+#include "TestHelpers.hpp"
 
 Emulator emu;
 
@@ -15,12 +18,76 @@ void runForDuration(int timeInSeconds = 5) {
     }
 }
 
+bool loadBlankRom(Emulator& emulator, bool cgb) {
+    // written on first use and removed when the runner exits
+    struct BlankRom {
+        std::string path;
+        explicit BlankRom(bool cgb) : path(cgb ? "blank_cgb.gb" : "blank_dmg.gb") {
+            std::vector<u8> rom(32768, 0);
+            if (cgb) rom[0x143] = 0xC0;
+            std::ofstream(path, std::ios::binary).write((const char*) rom.data(), rom.size());
+        }
+        ~BlankRom() { std::remove(path.c_str()); }
+    };
+    static BlankRom dmgRom(false), cgbRom(true);
+    return emulator.load(cgb ? cgbRom.path : dmgRom.path);
+}
+
+bool loadRomImage(Emulator& emulator, const std::vector<u8>& rom) {
+    // every image gets its own file, loaded ROMs are shared by path
+    static int images = 0;
+    std::string path = "test_rom_" + std::to_string(images++) + ".gb";
+    std::ofstream(path, std::ios::binary).write((const char*) rom.data(), rom.size());
+    bool success = emulator.load(path);
+    std::remove(path.c_str());
+    return success;
+}
+
 TEST_CASE("CPU INSTRUCTION TEST") {
     emu.cpu.headless = true;
+    // run every test with and without the JIT
+    emu.cpu.jitEnabled = GENERATE(false, true);
+    std::string filePath = "../gb/blargg/cpu_instrs.gb";
+    REQUIRE(emu.load(filePath));
+
+    runForDuration();
+
+    bool result =   emu.cpu.mmu.ZRAM[0x40] == 0x4C &&
+                    emu.cpu.mmu.ZRAM[0x41] == 0xD2 &&
+                    emu.cpu.mmu.ZRAM[0x42] == 0x33 &&
+                    emu.cpu.mmu.ZRAM[0x43] == 0xFE;
+    REQUIRE(result);
+}
+
+TEST_CASE("CPU INSTRUCTION TEST CACHED") {
+    emu.cpu.headless = true;
+    emu.cpu.jitEnabled = false;
     std::string filePath = "../gb/blargg/cpu_instrs.gb";
     REQUIRE(emu.load(filePath));
 
+    // only set on the shared instance while it runs, a failed load leaves it off for the other tests
+    emu.cpu.cachedInterpreter = true;
     runForDuration();
+    emu.cpu.cachedInterpreter = false;
+
+    bool result =   emu.cpu.mmu.ZRAM[0x40] == 0x4C &&
+                    emu.cpu.mmu.ZRAM[0x41] == 0xD2 &&
+                    emu.cpu.mmu.ZRAM[0x42] == 0x33 &&
+                    emu.cpu.mmu.ZRAM[0x43] == 0xFE;
+    REQUIRE(result);
+}
+
+TEST_CASE("CPU INSTRUCTION TEST FAST POLICY") {
+    emu.cpu.headless = true;
+    emu.cpu.jitEnabled = GENERATE(false, true);
+    std::string filePath = "../gb/blargg/cpu_instrs.gb";
+    REQUIRE(emu.load(filePath));
+
+    // instruction results don't depend on the cycle an access happens at
+    auto duration = std::chrono::system_clock::now() + std::chrono::seconds(5);
+    while (std::chrono::system_clock::now() < duration) {
+        emu.tick<Policy::Fast>();
+    }
 
     bool result =   emu.cpu.mmu.ZRAM[0x40] == 0x4C &&
                     emu.cpu.mmu.ZRAM[0x41] == 0xD2 &&
@@ -31,6 +98,7 @@ TEST_CASE("CPU INSTRUCTION TEST") {
 
 TEST_CASE("CPU INSTRUCTION TIMING") {
     emu.cpu.headless = true;
+    emu.cpu.jitEnabled = GENERATE(false, true);
     std::string filePath = "../gb/blargg/instr_timing.gb";
     REQUIRE(emu.load(filePath));
 
@@ -45,6 +113,7 @@ TEST_CASE("CPU INSTRUCTION TIMING") {
 
 TEST_CASE("CPU MEMORY TIMING 1") {
     emu.cpu.headless = true;
+    emu.cpu.jitEnabled = GENERATE(false, true);
     std::string filePath = "../gb/blargg/mem_timing.gb";
     REQUIRE(emu.load(filePath));
 
@@ -60,6 +129,7 @@ TEST_CASE("CPU MEMORY TIMING 1") {
 
 TEST_CASE("CPU MEMORY TIMING 2") {
     emu.cpu.headless = true;
+    emu.cpu.jitEnabled = GENERATE(false, true);
     std::string filePath = "../gb/blargg/mem_timing-2.gb";
     REQUIRE(emu.load(filePath));
 
@@ -73,3 +143,353 @@ TEST_CASE("CPU MEMORY TIMING 2") {
                     emu.cpu.mmu.ZRAM[0x05] == 0x03;
     REQUIRE(result);
 }
+
+TEST_CASE("SCHEDULER EVENT ORDER") {
+    Scheduler scheduler;
+    scheduler.schedule(EVENT_TIMER, 100);
+    scheduler.schedule(EVENT_PPU_COINCIDENCE, 50);
+    scheduler.schedule(EVENT_APU_FRAME, 100);
+    scheduler.schedule(EVENT_PPU, 80);
+    // moving an event replaces it
+    scheduler.schedule(EVENT_PPU_COINCIDENCE, 120);
+    scheduler.cancel(EVENT_PPU);
+    REQUIRE(scheduler.nextEvent() == 100);
+
+    u64 timestamp;
+    scheduler.now = 99;
+    REQUIRE(scheduler.popDue(timestamp) == EVENT_COUNT);
+
+    // events due at the same time run in type order
+    scheduler.now = 150;
+    REQUIRE(scheduler.popDue(timestamp) == EVENT_TIMER);
+    REQUIRE(timestamp == 100);
+    REQUIRE(scheduler.popDue(timestamp) == EVENT_APU_FRAME);
+    REQUIRE(scheduler.popDue(timestamp) == EVENT_PPU_COINCIDENCE);
+    REQUIRE(timestamp == 120);
+    REQUIRE(scheduler.popDue(timestamp) == EVENT_COUNT);
+    REQUIRE(scheduler.nextEvent() == NEVER);
+}
+
+TEST_CASE("ROM IMAGE SHARING") {
+    Emulator first, second;
+    REQUIRE(loadBlankRom(first, true));
+    REQUIRE(loadBlankRom(second, true));
+
+    // both instances read the same memory, the switchable bank starts right after the first one
+    REQUIRE(first.cpu.mmu.romImage == second.cpu.mmu.romImage);
+    REQUIRE(first.cpu.mmu.ROM.data() == first.cpu.mmu.ROM_0.data() + ROM_BANK_SIZE);
+    REQUIRE(second.cpu.mmu.readByte(0x0143) == 0xC0);
+}
+
+TEST_CASE("STATE ARENA LAYOUT") {
+    StateArena arena;
+    size_t end = 0;
+    for (const StateBlockLayout& block : StateArena::layout()) {
+        REQUIRE(block.offset % STATE_ALIGNMENT == 0);
+        REQUIRE(block.offset >= end);
+        end = block.offset + block.size;
+    }
+    REQUIRE(end <= StateArena::size());
+
+    // a snapshot restores every block
+    std::vector<u8> snapshot;
+    arena.block(STATE_WRAM)[0x100] = 0x42;
+    arena.snapshot(snapshot);
+    arena.block(STATE_WRAM)[0x100] = 0x00;
+    arena.restore(snapshot);
+    REQUIRE(arena.block(STATE_WRAM)[0x100] == 0x42);
+}
+
+TEST_CASE("TILE CACHE INVALIDATION") {
+    Emulator emu;
+    emu.cpu.headless = true;
+    REQUIRE(loadBlankRom(emu, true));
+    MMU& mmu = emu.cpu.mmu;
+
+    // the first row of tile 1 gets the palette indices 3 and 1 on the left
+    REQUIRE(emu.cpu.gpu.getTileData(0x10)[0] == colors[0]);
+    mmu.writeByte(0x8010, 0xC0);
+    mmu.writeByte(0x8011, 0x80);
+    u8* tile = emu.cpu.gpu.getTileData(0x10);
+    REQUIRE(tile[0] == colors[3]);
+    REQUIRE(tile[4] == colors[1]);
+
+    // a GDMA into the second bank replaces tile 2 there
+    for (int i=0; i<16; i++) mmu.writeByte(0xC000 + i, 0xFF);
+    mmu.writeByte(0xFF4F, 0x01);
+    mmu.writeByte(0xFF51, 0xC0);
+    mmu.writeByte(0xFF52, 0x00);
+    mmu.writeByte(0xFF53, 0x00);
+    mmu.writeByte(0xFF54, 0x20);
+    REQUIRE(emu.cpu.gpu.getTileData(VRAM_BANK_SIZE + 0x20)[0] == colors[0]);
+    mmu.writeByte(0xFF55, 0x00);
+    REQUIRE(emu.cpu.gpu.getTileData(VRAM_BANK_SIZE + 0x20)[0] == colors[3]);
+    REQUIRE(emu.cpu.gpu.getTileData(0x20)[0] == colors[0]);
+
+    // restoring an arena snapshot brings the old tiles back
+    std::vector<u8> snapshot;
+    emu.cpu.arena.snapshot(snapshot);
+    mmu.writeByte(0xFF4F, 0x00);
+    mmu.writeByte(0x8010, 0x00);
+    mmu.writeByte(0x8011, 0x00);
+    REQUIRE(emu.cpu.gpu.getTileData(0x10)[0] == colors[0]);
+    emu.cpu.restoreState(snapshot);
+    REQUIRE(emu.cpu.gpu.getTileData(0x10)[0] == colors[3]);
+}
+
+TEST_CASE("TILE ROW MAPPING") {
+    // the SIMD version has to match the scalar one for every row and palette
+    const u16 palettes[][4] {
+        {255, 192, 96, 0},
+        {0x7FFF, 0x0000, 0x1234, 0x7C1F},
+        {0x8001, 0xFFFF, 0x0001, 0x8000},
+    };
+    u32 mismatches = 0;
+    for (const u16* palette : palettes) {
+        for (u32 bits=0; bits<0x10000; bits++) {
+            u8 row[8];
+            for (int i=0; i<8; i++) row[i] = (bits >> (i * 2)) & 0x03;
+            u16 fast[8], reference[8];
+            GPU::mapTileRow(row, palette, fast);
+            GPU::mapTileRowScalar(row, palette, reference);
+            if (!std::equal(fast, fast + 8, reference)) mismatches++;
+        }
+    }
+    REQUIRE(mismatches == 0);
+}
+
+TEST_CASE("COLOR CORRECTION TABLES") {
+    Emulator emu;
+    GPU& gpu = emu.cpu.gpu;
+    u8 r, g, b;
+
+    // the LCD curve matches the original per pixel conversion
+    REQUIRE(gpu.getColorCorrection() == CORRECTION_LCD);
+    gpu.colorCorrect(0x7FFF, r, g, b);
+    REQUIRE((r == 247 && g == 247 && b == 247));
+    gpu.colorCorrect(0x001F, r, g, b);
+    REQUIRE((r == 200 && g == 0 && b == 46));
+
+    gpu.setColorCorrection(CORRECTION_NONE);
+    gpu.colorCorrect(0x7FFF, r, g, b);
+    REQUIRE((r == 255 && g == 255 && b == 255));
+    gpu.colorCorrect(0x03E0, r, g, b);
+    REQUIRE((r == 0 && g == 255 && b == 0));
+
+    gpu.setColorCorrection(CORRECTION_GAMMA);
+    gpu.colorCorrect(0x7FFF, r, g, b);
+    REQUIRE((r == 255 && g == 255 && b == 255));
+    gpu.colorCorrect(0x0000, r, g, b);
+    REQUIRE((r == 0 && g == 0 && b == 0));
+}
+
+TEST_CASE("SPRITE LIST INVALIDATION") {
+    Emulator emu;
+    emu.cpu.headless = true;
+    REQUIRE(loadBlankRom(emu, false));
+    MMU& mmu = emu.cpu.mmu;
+    auto runFrame = [&emu]() {
+        while (!emu.hitVBlank()) emu.tick();
+    };
+
+    // tile 1 is all color 3, sprite 0 shows it black in the top left corner
+    for (int i=0; i<16; i++) mmu.writeByte(0x8010 + i, 0xFF);
+    mmu.writeByte(0xFF48, 0xFF);
+    mmu.writeByte(0xFE00, 16);
+    mmu.writeByte(0xFE01, 8);
+    mmu.writeByte(0xFE02, 1);
+    mmu.writeByte(0xFF40, 0x93);
+    runFrame();
+    runFrame();
+    REQUIRE(emu.getDisplayState()[0] == colors[3]);
+    REQUIRE(emu.getDisplayState()[(8 * 160 + 8) * 4] == colors[0]);
+
+    // moving it between frames rebuilds the sprite lists
+    mmu.writeByte(0xFE00, 24);
+    mmu.writeByte(0xFE01, 16);
+    runFrame();
+    REQUIRE(emu.getDisplayState()[0] == colors[0]);
+    REQUIRE(emu.getDisplayState()[(8 * 160 + 8) * 4] == colors[3]);
+
+    // so does switching to 8x16 sprites, the blank tile 0 becomes the upper half
+    mmu.writeByte(0xFF40, 0x97);
+    runFrame();
+    REQUIRE(emu.getDisplayState()[(15 * 160 + 8) * 4] == colors[0]);
+    REQUIRE(emu.getDisplayState()[(16 * 160 + 8) * 4] == colors[3]);
+
+    // and restoring a snapshot from before the move
+    std::vector<u8> snapshot;
+    emu.cpu.arena.snapshot(snapshot);
+    mmu.writeByte(0xFE00, 40);
+    runFrame();
+    REQUIRE(emu.getDisplayState()[(16 * 160 + 8) * 4] == colors[0]);
+    emu.cpu.restoreState(snapshot);
+    runFrame();
+    REQUIRE(emu.getDisplayState()[(16 * 160 + 8) * 4] == colors[3]);
+}
+
+TEST_CASE("SAVE STATE VERSION") {
+    Emulator emu;
+    emu.cpu.headless = true;
+    REQUIRE(loadBlankRom(emu, false));
+    emu.saveState();
+    std::string statePath = emu.currentFile + "_Quicksave.state";
+    REQUIRE(emu.loadState(statePath));
+
+    // the version follows the 11 byte header
+    std::fstream file(statePath, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(11);
+    file.put(STATE_VERSION + 1);
+    file.close();
+    REQUIRE_FALSE(emu.loadState(statePath));
+    std::remove(statePath.c_str());
+}
+
+TEST_CASE("IDLE LOOP SKIPPING") {
+    // counts frames at C000 by polling LY, waits for DIV between them and counts that in C
+    std::vector<u8> rom(32768, 0);
+    const u8 code[] {
+        0x21, 0x00, 0xC0,                   // 0100 LD HL,C000
+        0xF0, 0x44, 0xFE, 0x90, 0x20, 0xFA, // 0103 LDH A,(44); CP 90; JR NZ,0103
+        0x34,                               // 0109 INC (HL)
+        0xF0, 0x44, 0xFE, 0x90, 0x28, 0xFA, // 010A LDH A,(44); CP 90; JR Z,010A
+        0xF0, 0x04, 0xE6, 0x0F, 0x20, 0xFA, // 0110 LDH A,(04); AND 0F; JR NZ,0110
+        0x0C,                               // 0116 INC C
+        0x18, 0xEA,                         // 0117 JR 0103
+    };
+    std::copy(std::begin(code), std::end(code), rom.begin() + 0x100);
+
+    Emulator plain, skipping;
+    for (Emulator* emu : {&plain, &skipping}) {
+        emu->cpu.headless = true;
+        emu->cpu.idleLoopDetection = emu == &skipping;
+        REQUIRE(loadRomImage(*emu, rom));
+        while (emu->cpu.mmu.WRAM[0] < 5) emu->tick();
+        emu->cpu.materializeFlags();
+    }
+
+    // skipping iterations ends at the same cycle the polling would have
+    REQUIRE(skipping.cpu.idleCyclesSkipped > 0);
+    REQUIRE(plain.cpu.idleCyclesSkipped == 0);
+    REQUIRE(skipping.cpu.scheduler.now == plain.cpu.scheduler.now);
+    REQUIRE(skipping.cpu.r.af == plain.cpu.r.af);
+    REQUIRE(skipping.cpu.r.bc == plain.cpu.r.bc);
+    REQUIRE(skipping.cpu.r.hl == plain.cpu.r.hl);
+    REQUIRE(skipping.cpu.r.pc == plain.cpu.r.pc);
+    REQUIRE(skipping.cpu.readByte(0xFF04) == plain.cpu.readByte(0xFF04));
+    REQUIRE(skipping.cpu.readByte(0xFF44) == plain.cpu.readByte(0xFF44));
+}
+
+TEST_CASE("MEMORY LOOP RUNS") {
+    // a fill into WRAM, a copy from ROM to VRAM and one from VRAM back to WRAM
+    std::vector<u8> rom(32768, 0);
+    for (size_t i=0x200; i<rom.size(); i++) rom[i] = (i * 7) & 0xFF;
+    const u8 code[] {
+        0x21, 0x00, 0xC1, 0x3E, 0x5A, 0x06, 0x00,       // 0100 LD HL,C100; LD A,5A; LD B,00
+        0x22, 0x05, 0x20, 0xFC,                         // 0107 LD (HL+),A; DEC B; JR NZ,0107
+        0x21, 0x00, 0x80, 0x11, 0x00, 0x02, 0x01, 0x00, 0x08, // 010B LD HL,8000; LD DE,0200; LD BC,0800
+        0x1A, 0x22, 0x13, 0x0B, 0x78, 0xB1, 0x20, 0xF8, // 0114 LD A,(DE); LD (HL+),A; INC DE; DEC BC; LD A,B; OR C; JR NZ,0114
+        0x21, 0x00, 0x80, 0x11, 0x00, 0xD0, 0x0E, 0xF0, // 011C LD HL,8000; LD DE,D000; LD C,F0
+        0x2A, 0x12, 0x13, 0x0D, 0x20, 0xFA,             // 0124 LD A,(HL+); LD (DE),A; INC DE; DEC C; JR NZ,0124
+        0x18, 0xFE,                                     // 012A JR 012A
+    };
+    std::copy(std::begin(code), std::end(code), rom.begin() + 0x100);
+
+    Emulator plain, bulk;
+    u32 plainTicks = 0, bulkTicks = 0;
+    for (Emulator* emu : {&plain, &bulk}) {
+        emu->cpu.headless = true;
+        emu->cpu.memoryLoopDetection = emu == &bulk;
+        emu->cpu.idleLoopDetection = false;
+        REQUIRE(loadRomImage(*emu, rom));
+        u32& ticks = emu == &bulk ? bulkTicks : plainTicks;
+        while (emu->cpu.r.pc != 0x012A) {
+            emu->tick();
+            ticks++;
+        }
+        emu->cpu.materializeFlags();
+    }
+
+    // the loops take far fewer ticks, VRAM copies still stop at every PPU mode change,
+    // but end in the same state at the same cycle
+    REQUIRE(bulkTicks * 2 < plainTicks);
+    REQUIRE(bulk.cpu.scheduler.now == plain.cpu.scheduler.now);
+    REQUIRE(bulk.cpu.r.af == plain.cpu.r.af);
+    REQUIRE(bulk.cpu.r.bc == plain.cpu.r.bc);
+    REQUIRE(bulk.cpu.r.de == plain.cpu.r.de);
+    REQUIRE(bulk.cpu.r.hl == plain.cpu.r.hl);
+    REQUIRE(std::equal(bulk.cpu.mmu.WRAM.begin(), bulk.cpu.mmu.WRAM.end(), plain.cpu.mmu.WRAM.begin()));
+    REQUIRE(std::equal(bulk.cpu.mmu.VRAM.begin(), bulk.cpu.mmu.VRAM.end(), plain.cpu.mmu.VRAM.begin()));
+    REQUIRE(plain.cpu.mmu.WRAM[0x1000] == plain.cpu.mmu.VRAM[0]);
+}
+
+TEST_CASE("AUDIO POLICY SWITCH") {
+    Emulator emu;
+    REQUIRE(loadBlankRom(emu, false));
+    auto runFrame = [&emu](bool audio) {
+        int ticks = 0;
+        while (ticks < emu.cpu.ticksPerFrame) {
+            ticks += audio ? emu.tick<Policy::Accurate>() : emu.tick<Policy::NoAudio>();
+        }
+    };
+
+    runFrame(true);
+    REQUIRE(emu.cpu.scheduler.isScheduled(EVENT_APU_FRAME));
+
+    // ticks without audio stop the APU and never schedule its frame sequencer
+    runFrame(false);
+    REQUIRE_FALSE(emu.cpu.apu.isRunning());
+    REQUIRE_FALSE(emu.cpu.scheduler.isScheduled(EVENT_APU_FRAME));
+    emu.cpu.apu.readSamples();
+    REQUIRE(emu.cpu.apu.audioBuffer.empty());
+
+    // the next tick with audio resumes it, a frame is worth about 735 stereo samples
+    runFrame(true);
+    REQUIRE(emu.cpu.apu.isRunning());
+    REQUIRE(emu.cpu.scheduler.isScheduled(EVENT_APU_FRAME));
+    emu.cpu.apu.readSamples();
+    REQUIRE(emu.cpu.apu.audioBuffer.size() > 2 * 700);
+}
+
+#ifdef PHOS_RECOMP_TEST_PLUGIN
+TEST_CASE("RECOMPILED CODE") {
+    // the ROM from RecompTestRom, the plugin was built from it by phos-recomp
+    std::string romPath = PHOS_RECOMP_TEST_ROM, pluginPath = PHOS_RECOMP_TEST_PLUGIN;
+    bool timing = GENERATE(true, false);
+
+    Emulator plain, recompiled;
+    for (Emulator* emu : {&plain, &recompiled}) {
+        emu->cpu.headless = true;
+        REQUIRE(emu->load(romPath));
+        if (emu == &recompiled) REQUIRE(emu->cpu.loadRecompiledCode(pluginPath));
+        // blocks end at HALT, both stop at the same one after 600 frames
+        while (!emu->cpu.halted || emu->cpu.scheduler.now < 600 * (u64) emu->cpu.ticksPerFrame) {
+            if (timing) emu->tick(); else emu->tick<Policy::Fast>();
+        }
+        emu->cpu.materializeFlags();
+    }
+
+    // the functions updated their checksum at FFF1 and the interrupts counted themselves
+    auto& mmu = recompiled.cpu.mmu;
+    REQUIRE(mmu.ZRAM[0x71] != 0);
+    REQUIRE(mmu.WRAM[0x1EF0] > 0);
+    REQUIRE(mmu.WRAM[0x1EF2] > 0);
+
+    REQUIRE(recompiled.cpu.scheduler.now == plain.cpu.scheduler.now);
+    REQUIRE(recompiled.cpu.r.af == plain.cpu.r.af);
+    REQUIRE(recompiled.cpu.r.bc == plain.cpu.r.bc);
+    REQUIRE(recompiled.cpu.r.de == plain.cpu.r.de);
+    REQUIRE(recompiled.cpu.r.hl == plain.cpu.r.hl);
+    REQUIRE(recompiled.cpu.r.sp == plain.cpu.r.sp);
+    REQUIRE(recompiled.cpu.r.pc == plain.cpu.r.pc);
+    REQUIRE(std::equal(mmu.WRAM.begin(), mmu.WRAM.end(), plain.cpu.mmu.WRAM.begin()));
+    // timer registers are only brought up to date when they are read
+    std::vector<u8> io, plainIO;
+    for (u16 address=0xFF00; address<0xFF80; address++) {
+        io.push_back(recompiled.cpu.readByte(address));
+        plainIO.push_back(plain.cpu.readByte(address));
+    }
+    REQUIRE(io == plainIO);
+    REQUIRE(std::equal(mmu.ZRAM.begin(), mmu.ZRAM.end(), plain.cpu.mmu.ZRAM.begin()));
+}
+#endif
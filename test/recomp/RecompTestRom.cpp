@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// RecompTestRom <output>
+// writes a 32KB ROM without MBC that phos-recomp can trace completely, the recompiled code test
+// runs it with and without the plugin built from it. main calls every function in both banks
+// and halts until the next interrupt, the functions run random register, ALU and CB operations
+// mixed with memory accesses, branches, short loops and IO accesses. most of them also add
+// all registers to a checksum so that a wrong result is still visible after it is overwritten
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+
+static std::mt19937 rng(0x5EED);
+
+static int random(int n) {
+    return (int) (rng() % n);
+}
+
+// register operand of an opcode, (HL) is left out
+static int reg() {
+    static const int registers[] = {0, 1, 2, 3, 4, 5, 7};
+    return registers[random(7)];
+}
+
+// keeps away from the interrupt counters and the stack at the end of WRAM
+static u16 wram() {
+    return (u16) (0xC000 + random(0x1E00));
+}
+
+// adds all registers to a checksum at 0xFFF1, a result that differs once stays visible there
+static const u16 DUMP = 0x0300;
+
+// IO registers that can be accessed without turning off the LCD or starting a transfer,
+// DIV is only read so that the timer keeps counting
+static u8 io(bool write) {
+    static const u8 registers[] = {0x05, 0x0F, 0x41, 0x42, 0x43, 0x44, 0x45, 0x80, 0x90, 0xFE, 0x04};
+    return registers[random(sizeof(registers) - (write ? 1 : 0))];
+}
+
+// registers that change on their own, for accesses that happen inside an instruction
+static u8 clocked(bool write) {
+    static const u8 registers[] = {0x05, 0x0F, 0x41, 0x44, 0x04};
+    return registers[random(write ? 2 : sizeof(registers))];
+}
+
+struct Rom {
+    std::vector<u8> data = std::vector<u8>(0x8000, 0);
+    u16 pc = 0;
+
+    Rom() {
+        shuffleDeck();
+    }
+
+    void put(std::initializer_list<int> bytes) {
+        for (int b : bytes) data[pc++] = (u8) b;
+    }
+
+    void putAddress(int opcode, u16 address) {
+        put({opcode, address & 0xFF, address >> 8});
+    }
+
+    // every instruction that only changes registers, CB opcodes are stored as 0x100 + opcode
+    std::vector<int> deck;
+    bool dealtAll = false;
+
+    void shuffleDeck() {
+        static const int others[] = {
+            0x00, 0x03, 0x13, 0x23, 0x0B, 0x1B, 0x2B, 0x09, 0x19, 0x29, 0x39,
+            0x07, 0x0F, 0x17, 0x1F, 0x27, 0x2F, 0x37, 0x3F, 0xE8, 0xF8
+        };
+        for (int op=0x40; op<0xC0; op++) {
+            if ((op & 0x07) != 6 && (op >= 0x80 || (op & 0x38) != 0x30)) deck.push_back(op);
+        }
+        for (int r=0; r<8; r++) {
+            if (r != 6) deck.insert(deck.end(), {0x04 + 8 * r, 0x05 + 8 * r, 0x06 + 8 * r});
+            deck.push_back(0xC6 + 8 * r);
+        }
+        deck.insert(deck.end(), std::begin(others), std::end(others));
+        for (int op=0; op<0x100; op++) {
+            if ((op & 0x07) != 6) deck.push_back(0x100 + op);
+        }
+        std::shuffle(deck.begin(), deck.end(), rng);
+    }
+
+    // one instruction that only changes registers, the stack pointer stays where it is.
+    // they are dealt from a shuffled deck so that every one of them shows up
+    void registerOp() {
+        if (deck.empty()) {
+            dealtAll = true;
+            shuffleDeck();
+        }
+        int op = deck.back();
+        deck.pop_back();
+        if (op >= 0x100) {
+            put({0xCB, op & 0xFF});
+        } else if (op == 0xE8) {
+            int n = 1 + random(8);
+            put({0xE8, n, 0xE8, 0x100 - n});
+        } else if (op == 0x27) {
+            // DAA after ADD, ADC, SUB or SBC
+            put({0x80 + 8 * random(4) + reg(), 0x27});
+        } else if (op == 0xF8 || (op & 0xC7) == 0x06 || (op & 0xC7) == 0xC6) {
+            put({op, random(0x100)});
+        } else {
+            put({op});
+        }
+    }
+
+    // memory access through a pointer that was just loaded
+    void memoryOp() {
+        u16 address = wram();
+        switch (random(9)) {
+            case 0: putAddress(0x21, address); put({0x70 + reg()}); break;
+            case 1: putAddress(0x21, address); put({0x46 + 8 * reg()}); break;
+            case 2: putAddress(0x21, address); put({0x86 + 8 * random(8)}); break;
+            case 3: putAddress(0x21, address); put({0x34 + random(2)}); break;
+            case 4: putAddress(0x21, address); put({0x36, random(0x100)}); break;
+            case 5: putAddress(0x21, address); put({0xCB, 0x06 + 8 * random(0x20)}); break;
+            case 6: putAddress(0x21, address); put({0x22 + 8 * random(4)}); break;
+            case 7: {
+                // LD (BC),A, LD A,(BC), LD (DE),A and LD A,(DE)
+                int pair = random(2);
+                putAddress(0x01 + 0x10 * pair, address);
+                put({0x02 + 0x10 * pair + 8 * random(2)});
+                break;
+            }
+            default:
+                putAddress(random(2) ? 0xEA : 0xFA, address);
+                if (random(4) == 0) putAddress(0x08, address);
+                break;
+        }
+    }
+
+    void ioOp() {
+        bool write = random(2);
+        switch (random(4)) {
+            case 0: put({write ? 0xE0 : 0xF0, io(write)}); break;
+            case 1: put({0x0E, io(write), write ? 0xE2 : 0xF2}); break;
+            case 2: putAddress(write ? 0xEA : 0xFA, 0xFF00 + io(write)); break;
+            default:
+                putAddress(0x21, 0xFF00 + clocked(write));
+                switch (random(3) + (write ? 3 : 0)) {
+                    case 0: put({0x46 + 8 * reg()}); break;
+                    case 1: put({0x86 + 8 * random(8)}); break;
+                    // BIT b,(HL)
+                    case 2: put({0xCB, 0x46 + 8 * random(8)}); break;
+                    case 3: put({0x34 + random(2)}); break;
+                    case 4: put({0x36, random(0x100)}); break;
+                    // rotates, shifts, RES and SET on (HL)
+                    default: {
+                        int op = random(0x18);
+                        put({0xCB, 0x06 + 8 * (op < 8 ? op : op + 8)});
+                    }
+                }
+        }
+    }
+
+    void function(u16 leaf) {
+        // every call starts from different values, LDH A,(F1), RRA and LD r,A
+        put({0xF0, 0xF1, 0x1F, 0x47 + 8 * reg()});
+        int length = 8 + random(16);
+        for (int i=0; i<length; i++) {
+            switch (random(16)) {
+                case 0: case 1: case 2: memoryOp(); break;
+                case 3: case 4: ioOp(); break;
+                case 5: {
+                    // JR cc over one instruction
+                    u16 branch = pc;
+                    put({0x20 + 8 * random(4), 0});
+                    registerOp();
+                    data[branch + 1] = (u8) (pc - branch - 2);
+                    break;
+                }
+                case 6: {
+                    // counts D down to zero, the body must leave D alone
+                    static const int body[] = {0x3C, 0x83, 0x07, 0xA9};
+                    put({0x16, 1 + random(12)});
+                    u16 head = pc;
+                    put({body[random(4)], 0x15, 0x20});
+                    put({(head - pc - 1) & 0xFF});
+                    break;
+                }
+                case 7: put({0xC5 + 0x10 * random(4), 0xC1 + 0x10 * random(4)}); break;
+                case 8: putAddress(0xC4 + 8 * random(4), leaf); break;
+                case 9: put({0xF3}); registerOp(); put({0xFB}); break;
+                case 10: if (random(4) == 0) put({0xC0 + 8 * random(4)}); break;
+                default: registerOp(); break;
+            }
+            if (random(3)) putAddress(0xCD, DUMP);
+        }
+        put({0xC9});
+    }
+};
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        printf("Usage: RecompTestRom <output>\n");
+        return 1;
+    }
+    Rom rom;
+
+    // every interrupt counts itself at 0xDEF0 and up
+    for (int i=0; i<5; i++) {
+        u16 handler = 0x68 + i * 12;
+        rom.pc = 0x40 + i * 8;
+        rom.putAddress(0xC3, handler);
+        rom.pc = handler;
+        rom.put({0xF5, 0xE5, 0x21, 0xF0 + i, 0xDE, 0x34, 0xE1, 0xF1, 0xD9});
+    }
+
+    rom.pc = 0x100;
+    rom.putAddress(0xC3, 0x150);
+    rom.put({0x00});
+
+    rom.pc = DUMP;
+    rom.put({0xF5, 0xC5, 0xD5, 0xE5, 0xF8, 0x00, 0xF0, 0xF1}); // PUSH AF, BC, DE and HL, LD HL,SP+0, LDH A,(F1)
+    for (int i=0; i<8; i++) rom.put({0x86, 0x07, 0x23});      // ADD A,(HL), RLCA, INC HL
+    rom.put({0xE0, 0xF1, 0xE1, 0xD1, 0xC1, 0xF1, 0xC9});      // LDH (F1),A, POP HL, DE, BC and AF, RET
+
+    // target of the conditional calls
+    u16 leaf = 0x0400;
+    rom.pc = leaf;
+    rom.put({0x3C, 0xA9, 0xC9});
+
+    // main enables the timer and VBLANK interrupts, then calls every function once per interrupt
+    u16 main = 0x150;
+    rom.pc = main;
+    rom.put({0xF3, 0x31, 0xF0, 0xDF, 0x3E, 0x05, 0xE0, 0x07, 0x3E, 0x05, 0xE0, 0xFF, 0xFB});
+    u16 loop = rom.pc;
+
+    // functions alternate between bank 0 and bank 1 until every register instruction was used
+    std::vector<u16> functions;
+    u16 next[2] = {0x0410, 0x4000};
+    while (!rom.dealtAll) {
+        u16& start = next[functions.size() % 2];
+        functions.push_back(start);
+        rom.pc = start;
+        rom.function(leaf);
+        start = rom.pc;
+    }
+
+    rom.pc = loop;
+    for (u16 function : functions) rom.putAddress(0xCD, function);
+    rom.put({0x76, 0x00});
+    rom.putAddress(0xC3, loop);
+
+    FILE* file = fopen(argv[1], "wb");
+    if (!file) {
+        printf("Failed to create file %s\n", argv[1]);
+        return 1;
+    }
+    fwrite(rom.data.data(), 1, rom.data.size(), file);
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,20 @@
+#include "Recompiler.hpp"
+
+// phos-recomp <rom> <output directory>
+// writes Bank00.cpp, Bank01.cpp and Plugin.cpp, see CMakeLists.txt for building them into a plugin
+int main(int argc, char** argv) {
+    Logger::addSink(std::make_shared<StdSink>(true));
+
+    if (argc != 3) {
+        Log(W, "Usage: phos-recomp <rom> <output directory>\n");
+        return 1;
+    }
+    std::string romPath = argv[1];
+    std::string outputPath = argv[2];
+
+    Recompiler recompiler;
+    if (!recompiler.load(romPath)) return 1;
+    recompiler.trace();
+    if (!recompiler.write(outputPath)) return 1;
+    return 0;
+}
@@ -0,0 +1,655 @@
+#include <cstdarg>
+#include <fstream>
+#include <iterator>
+
+#include "Recompiler.hpp"
+#include "MMU.hpp"
+#include "Opcodes.hpp"
+#include "Recomp.hpp"
+
+Recompiler::Recompiler(): end(0) {}
+
+bool Recompiler::load(std::string& romPath) {
+    std::ifstream file(romPath, std::ios::binary);
+    if (!file || !file.good()) {
+        Log(W, "Failed to open file %s\n", romPath.c_str());
+        return false;
+    }
+    rom.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (rom.size() < (size_t) ROM_BANK_SIZE) {
+        Log(W, "File %s is too small to be a ROM\n", romPath.c_str());
+        return false;
+    }
+    romName = romPath.substr(romPath.find_last_of('/') + 1);
+
+    // bank 1 is only fixed if there is no MBC to switch it
+    u8 cartridgeType = rom[0x147];
+    bool hasMBC = cartridgeType != 0x00 && cartridgeType != 0x08 && cartridgeType != 0x09;
+    end = (hasMBC || rom.size() < (size_t) 2 * ROM_BANK_SIZE) ? ROM_BANK_SIZE : 2 * ROM_BANK_SIZE;
+    return true;
+}
+
+void Recompiler::trace() {
+    // entry point and interrupt vectors
+    addTarget(0x0100);
+    for (u16 vector = 0x40; vector <= 0x60; vector += 0x08) addTarget(vector);
+
+    while (!targets.empty()) {
+        u16 address = targets.back();
+        targets.pop_back();
+        if (blocks.count(address)) continue;
+
+        Block block {};
+        if (!decodeBlock(address, block)) continue;
+
+        for (Instruction& in : block.instructions) {
+            u16 next = in.address + in.length;
+            u16 immediate = in.operands[0] | (in.operands[1] << 8);
+            if (in.isCB) continue;
+            switch (in.opcode) {
+                // JP
+                case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+                    addTarget(immediate);
+                    break;
+                // CALL, execution continues at the return address
+                case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+                    addTarget(immediate);
+                    addTarget(next);
+                    break;
+                // JR
+                case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+                    addTarget(next + static_cast<char>(in.operands[0]));
+                    break;
+                default:
+                    // RST
+                    if ((in.opcode & 0xC7) == 0xC7) {
+                        addTarget(in.opcode & 0x38);
+                        addTarget(next);
+                    }
+            }
+        }
+        // blocks cut at their maximum length or at the end of bank 0 continue in a new one
+        const Instruction& last = block.instructions.back();
+        if (last.isCB || !endsBlock(last.opcode)) addTarget(block.end);
+        blocks.emplace(address, std::move(block));
+    }
+    Log(I, "Traced %zu blocks in 0x0000 - 0x%04X\n", blocks.size(), end - 1);
+}
+
+bool Recompiler::decodeBlock(u16 address, Block& block) {
+    // same rules as CPU::decodeBlock, blocks never cross from bank 0 into bank 1
+    u32 regionEnd = address < ROM_BANK_SIZE ? (u32) ROM_BANK_SIZE : end;
+    u32 pc = address;
+    while (block.instructions.size() < MAX_BLOCK_LENGTH) {
+        Instruction in {};
+        in.address = pc;
+        in.opcode = rom[pc];
+        if (in.opcode == 0xCB) {
+            if (pc + 1 >= regionEnd) break;
+            in.isCB = true;
+            in.opcode = rom[pc + 1];
+            in.length = 2;
+        } else {
+            if (isInvalidOpcode(in.opcode)) break;
+            in.length = 1 + operandLengths[in.opcode];
+        }
+        if (pc + in.length > regionEnd) break;
+
+        if (in.length > 1 && !in.isCB) in.operands[0] = rom[pc + 1];
+        if (in.length > 2) in.operands[1] = rom[pc + 2];
+        block.instructions.push_back(in);
+        pc += in.length;
+        if (!in.isCB && endsBlock(in.opcode)) break;
+    }
+    block.end = pc;
+    return !block.instructions.empty();
+}
+
+void Recompiler::addTarget(u32 address) {
+    if (address < end && !blocks.count(address)) targets.push_back(address);
+}
+
+bool Recompiler::write(std::string& outputPath) {
+    return writeBank(outputPath, 0) && writeBank(outputPath, 1) && writePlugin(outputPath);
+}
+
+// register operands as they are encoded in the opcodes, index 6 is (HL)
+static const char* const registers8[8] = {"r.b", "r.c", "r.d", "r.e", "r.h", "r.l", nullptr, "r.a"};
+static const char* const registers16[4] = {"r.bc", "r.de", "r.hl", "r.sp"};
+static const char* const stackRegisters[4] = {"r.bc", "r.de", "r.hl", "r.af"};
+static const char* const conditions[4] = {"!(r.f & ZERO)", "(r.f & ZERO)", "!(r.f & CARRY)", "(r.f & CARRY)"};
+
+// appends one line of generated code
+static void emit(std::vector<std::string>& code, const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    code.emplace_back(line);
+}
+
+// cycle of a memory access, the part inside the instruction only counts with sub-instruction timing
+static std::string at(u32 elapsed, u32 partial) {
+    std::string cycle = std::to_string(elapsed);
+    if (partial) cycle += " + " + std::to_string(partial) + " * timing";
+    return cycle;
+}
+
+static void emitExit(std::vector<std::string>& code, const char* pc, u32 ticks, u32 last) {
+    emit(code, "r.pc = %s;", pc);
+    emit(code, "host.leave(cpu, %u, %u);", ticks, last);
+    emit(code, "return;");
+}
+
+// PUSH, the caller checks fast once the instruction is done
+static void emitPush(std::vector<std::string>& code, const char* value, u32 elapsed) {
+    emit(code, "u16 pushed = %s;", value);
+    emit(code, "r.sp--;");
+    emit(code, "bool fast = host.write(cpu, r.sp, pushed >> 8, %u);", elapsed);
+    emit(code, "r.sp--;");
+    emit(code, "fast = host.write(cpu, r.sp, pushed & 0xFF, %u) && fast;", elapsed);
+}
+
+// CALL and RST, the block is left after them either way
+static void emitPush(std::vector<std::string>& code, u16 returnAddress, u32 elapsed) {
+    emit(code, "r.sp--;");
+    emit(code, "host.write(cpu, r.sp, 0x%02X, %u);", returnAddress >> 8, elapsed);
+    emit(code, "r.sp--;");
+    emit(code, "host.write(cpu, r.sp, 0x%02X, %u);", returnAddress & 0xFF, elapsed);
+}
+
+// ADD, ADC, SUB, SBC, AND, XOR, OR and CP with the same flags as the interpreter
+static void emitALU(std::vector<std::string>& code, int operation, const char* value) {
+    switch (operation) {
+        case 0:
+            emit(code, "u8 rhs = %s;", value);
+            emit(code, "u8 result = r.a + rhs;");
+            emit(code, "r.f = (result == 0 ? ZERO : 0) | (((result ^ rhs ^ r.a) & 0x10) ? HALF_CARRY : 0) | (result < r.a ? CARRY : 0);");
+            emit(code, "r.a = result;");
+            break;
+        case 1:
+            emit(code, "u8 rhs = %s;", value);
+            emit(code, "int carry = (r.f & CARRY) ? 1 : 0;");
+            emit(code, "int result = r.a + rhs + carry;");
+            emit(code, "r.f = ((u8) result == 0 ? ZERO : 0) | (((r.a & 0x0F) + (rhs & 0x0F) + carry) > 0x0F ? HALF_CARRY : 0) | (result > 0xFF ? CARRY : 0);");
+            emit(code, "r.a = result;");
+            break;
+        case 2:
+        case 7:
+            emit(code, "u8 rhs = %s;", value);
+            emit(code, "u8 result = r.a - rhs;");
+            emit(code, "r.f = (result == 0 ? ZERO : 0) | ADD_SUB | ((r.a & 0x0F) < (rhs & 0x0F) ? HALF_CARRY : 0) | (r.a < rhs ? CARRY : 0);");
+            if (operation == 2) emit(code, "r.a = result;");
+            break;
+        case 3:
+            emit(code, "u8 rhs = %s;", value);
+            emit(code, "int result = r.a - rhs - ((r.f & CARRY) ? 1 : 0);");
+            emit(code, "r.f = ((u8) result == 0 ? ZERO : 0) | ADD_SUB | ((((u8) result ^ rhs ^ r.a) & 0x10) ? HALF_CARRY : 0) | (result < 0 ? CARRY : 0);");
+            emit(code, "r.a = result;");
+            break;
+        case 4:
+            emit(code, "r.a &= %s;", value);
+            emit(code, "r.f = (r.a == 0 ? ZERO : 0) | HALF_CARRY;");
+            break;
+        case 5:
+            emit(code, "r.a ^= %s;", value);
+            emit(code, "r.f = r.a == 0 ? ZERO : 0;");
+            break;
+        case 6:
+            emit(code, "r.a |= %s;", value);
+            emit(code, "r.f = r.a == 0 ? ZERO : 0;");
+            break;
+    }
+}
+
+// RLC, RRC, RL, RR, SLA, SRA, SWAP and SRL on value
+static void emitShift(std::vector<std::string>& code, int operation) {
+    static const char* const shifts[8][2] = {
+        {"value >> 7", "(value << 1) | carry"},
+        {"value & 0x01", "(value >> 1) | (carry << 7)"},
+        {"value >> 7", "(value << 1) | ((r.f & CARRY) ? 0x01 : 0)"},
+        {"value & 0x01", "(value >> 1) | ((r.f & CARRY) ? 0x80 : 0)"},
+        {"value >> 7", "value << 1"},
+        {"value & 0x01", "(value >> 1) | (value & 0x80)"},
+        {"0", "(value << 4) | (value >> 4)"},
+        {"value & 0x01", "value >> 1"},
+    };
+    emit(code, "u8 carry = %s;", shifts[operation][0]);
+    emit(code, "value = %s;", shifts[operation][1]);
+    emit(code, "r.f = (value == 0 ? ZERO : 0) | (carry ? CARRY : 0);");
+}
+
+// length of an instruction that stays in the block, its conditional branch is not taken
+static u32 fallThroughCycles(u8 opcode, bool isCB) {
+    if (isCB) return maxCyclesCB(opcode);
+    switch (opcode) {
+        case 0x20: case 0x28: case 0x30: case 0x38:
+        case 0xC0: case 0xC8: case 0xD0: case 0xD8:
+            return 8;
+        case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+        case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+            return 12;
+        default:
+            return maxCycles[opcode];
+    }
+}
+
+// writes the semantics of one instruction that starts elapsed cycles into the block,
+// returns false if it always leaves the block
+bool Recompiler::writeInstruction(std::vector<std::string>& code, const Instruction& in, u16 next, u32 elapsed) {
+    u8 op = in.opcode;
+    u8 n = in.operands[0];
+    u16 nn = in.operands[0] | (in.operands[1] << 8);
+    u32 ticks = elapsed + fallThroughCycles(op, in.isCB);
+    u32 taken = elapsed + maxCycles[op];
+    char target[8];
+    bool writes = false;
+
+    if (in.isCB) {
+        int reg = op & 0x07;
+        int bit = (op >> 3) & 0x07;
+        if (reg == 6) {
+            emit(code, "u8 value = host.read(cpu, r.hl, %s);", at(elapsed, 4).c_str());
+        } else {
+            emit(code, "u8& value = %s;", registers8[reg]);
+        }
+        if (op < 0x40) emitShift(code, op >> 3);
+        else if (op < 0x80) emit(code, "r.f = (r.f & CARRY) | ((value & 0x%02X) ? 0 : ZERO) | HALF_CARRY;", 1 << bit);
+        else if (op < 0xC0) emit(code, "value &= 0x%02X;", (u8) ~(1 << bit));
+        else emit(code, "value |= 0x%02X;", 1 << bit);
+        if (reg == 6 && (op < 0x40 || op >= 0x80)) {
+            emit(code, "bool fast = host.write(cpu, r.hl, value, %s);", at(elapsed, 8).c_str());
+            writes = true;
+        }
+    } else if (op >= 0x40 && op < 0x80) {
+        // LD r,r', LD r,(HL) and LD (HL),r, HALT is handled by the caller
+        int dst = (op >> 3) & 0x07;
+        int src = op & 0x07;
+        if (src == 6) {
+            emit(code, "%s = host.read(cpu, r.hl, %u);", registers8[dst], elapsed);
+        } else if (dst == 6) {
+            emit(code, "bool fast = host.write(cpu, r.hl, %s, %u);", registers8[src], elapsed);
+            writes = true;
+        } else if (dst != src) {
+            emit(code, "%s = %s;", registers8[dst], registers8[src]);
+        }
+    } else if (op >= 0x80 && op < 0xC0) {
+        if ((op & 0x07) == 6) {
+            emit(code, "u8 value = host.read(cpu, r.hl, %u);", elapsed);
+            emitALU(code, (op >> 3) & 0x07, "value");
+        } else {
+            emitALU(code, (op >> 3) & 0x07, registers8[op & 0x07]);
+        }
+    } else if (op < 0x40 && (op & 0x07) >= 4 && (op & 0x07) <= 6) {
+        // INC r, DEC r and LD r,n, the carry flag is kept by INC and DEC
+        int reg = (op >> 3) & 0x07;
+        if ((op & 0x07) == 6) {
+            if (reg == 6) {
+                emit(code, "bool fast = host.write(cpu, r.hl, 0x%02X, %s);", n, at(elapsed, 4).c_str());
+                writes = true;
+            } else {
+                emit(code, "%s = 0x%02X;", registers8[reg], n);
+            }
+        } else {
+            bool inc = (op & 0x07) == 4;
+            if (reg == 6) emit(code, "u8 value = host.read(cpu, r.hl, %u);", elapsed);
+            else emit(code, "u8& value = %s;", registers8[reg]);
+            emit(code, "u8 result = value %s 1;", inc ? "+" : "-");
+            if (inc) emit(code, "r.f = (result == 0 ? ZERO : 0) | ((value & 0x0F) == 0x0F ? HALF_CARRY : 0) | (r.f & CARRY);");
+            else emit(code, "r.f = (result == 0 ? ZERO : 0) | ADD_SUB | ((value & 0x0F) == 0 ? HALF_CARRY : 0) | (r.f & CARRY);");
+            if (reg == 6) {
+                emit(code, "bool fast = host.write(cpu, r.hl, result, %s);", at(elapsed, 4).c_str());
+                writes = true;
+            } else {
+                emit(code, "value = result;");
+            }
+        }
+    } else if ((op & 0xC7) == 0xC6) {
+        char value[8];
+        snprintf(value, sizeof(value), "0x%02X", n);
+        emitALU(code, (op >> 3) & 0x07, value);
+    } else if ((op & 0xC7) == 0xC7) {
+        // RST
+        snprintf(target, sizeof(target), "0x%04X", op & 0x38);
+        emitPush(code, next, elapsed);
+        emitExit(code, target, taken, maxCycles[op]);
+        return false;
+    } else {
+        int pair = (op >> 4) & 0x03;
+        int cond = (op >> 3) & 0x03;
+        switch (op) {
+            case 0x00:
+                break;
+            case 0x01: case 0x11: case 0x21: case 0x31:
+                emit(code, "%s = 0x%04X;", registers16[pair], nn);
+                break;
+            case 0x02: case 0x12:
+                emit(code, "bool fast = host.write(cpu, %s, r.a, %u);", registers16[pair], elapsed);
+                writes = true;
+                break;
+            case 0x22: case 0x32:
+                emit(code, "bool fast = host.write(cpu, r.hl, r.a, %u);", elapsed);
+                emit(code, "r.hl%s;", op == 0x22 ? "++" : "--");
+                writes = true;
+                break;
+            case 0x0A: case 0x1A:
+                emit(code, "r.a = host.read(cpu, %s, %u);", registers16[pair], elapsed);
+                break;
+            case 0x2A: case 0x3A:
+                emit(code, "r.a = host.read(cpu, r.hl, %u);", elapsed);
+                emit(code, "r.hl%s;", op == 0x2A ? "++" : "--");
+                break;
+            case 0x03: case 0x13: case 0x23: case 0x33:
+                emit(code, "%s++;", registers16[pair]);
+                break;
+            case 0x0B: case 0x1B: case 0x2B: case 0x3B:
+                emit(code, "%s--;", registers16[pair]);
+                break;
+            case 0x09: case 0x19: case 0x29: case 0x39:
+                emit(code, "u16 value = %s;", registers16[pair]);
+                emit(code, "u16 result = r.hl + value;");
+                emit(code, "r.f = (r.f & ZERO) | (((result ^ r.hl ^ value) & 0x1000) ? HALF_CARRY : 0) | (result < r.hl ? CARRY : 0);");
+                emit(code, "r.hl = result;");
+                break;
+            case 0x07:
+                emit(code, "u8 carry = r.a >> 7;");
+                emit(code, "r.a = (r.a << 1) | carry;");
+                emit(code, "r.f = carry ? CARRY : 0;");
+                break;
+            case 0x0F:
+                emit(code, "u8 carry = r.a & 0x01;");
+                emit(code, "r.a = (r.a >> 1) | (carry << 7);");
+                emit(code, "r.f = carry ? CARRY : 0;");
+                break;
+            case 0x17:
+                emit(code, "u8 carry = r.a >> 7;");
+                emit(code, "r.a = (r.a << 1) | ((r.f & CARRY) ? 0x01 : 0);");
+                emit(code, "r.f = carry ? CARRY : 0;");
+                break;
+            case 0x1F:
+                emit(code, "u8 carry = r.a & 0x01;");
+                emit(code, "r.a = (r.a >> 1) | ((r.f & CARRY) ? 0x80 : 0);");
+                emit(code, "r.f = carry ? CARRY : 0;");
+                break;
+            case 0x08:
+                emit(code, "bool fast = host.writeWord(cpu, 0x%04X, r.sp, %u);", nn, elapsed);
+                writes = true;
+                break;
+            case 0x27:
+                emit(code, "u8 flags = r.f;");
+                emit(code, "if (!(flags & ADD_SUB)) {");
+                emit(code, "    if ((flags & CARRY) || r.a > 0x99) {");
+                emit(code, "        r.a += 0x60;");
+                emit(code, "        flags |= CARRY;");
+                emit(code, "    }");
+                emit(code, "    if ((flags & HALF_CARRY) || (r.a & 0x0F) > 0x09) r.a += 0x06;");
+                emit(code, "} else {");
+                emit(code, "    if (flags & CARRY) r.a -= 0x60;");
+                emit(code, "    if (flags & HALF_CARRY) r.a -= 0x06;");
+                emit(code, "}");
+                emit(code, "r.f = (flags & (ADD_SUB | CARRY)) | (r.a == 0 ? ZERO : 0);");
+                break;
+            case 0x2F:
+                emit(code, "r.a ^= 0xFF;");
+                emit(code, "r.f |= ADD_SUB | HALF_CARRY;");
+                break;
+            case 0x37:
+                emit(code, "r.f = (r.f & ZERO) | CARRY;");
+                break;
+            case 0x3F:
+                emit(code, "r.f = (r.f & ZERO) | ((r.f & CARRY) ^ CARRY);");
+                break;
+            case 0x18:
+            case 0x20: case 0x28: case 0x30: case 0x38: {
+                u16 jump = next + static_cast<char>(n);
+                snprintf(target, sizeof(target), "0x%04X", jump);
+                if (op != 0x18) emit(code, "if (%s) {", conditions[cond]);
+                std::vector<std::string> branch;
+                if (static_cast<char>(n) < 0) emit(branch, "host.loop(cpu, %s, 0x%04X);", target, next);
+                emitExit(branch, target, taken, maxCycles[op]);
+                for (std::string& line : branch) code.push_back(op == 0x18 ? line : "    " + line);
+                if (op == 0x18) return false;
+                emit(code, "}");
+                break;
+            }
+            case 0xC3:
+            case 0xC2: case 0xCA: case 0xD2: case 0xDA: {
+                snprintf(target, sizeof(target), "0x%04X", nn);
+                if (op != 0xC3) emit(code, "if (%s) {", conditions[cond]);
+                std::vector<std::string> branch;
+                if (nn < next) emit(branch, "host.loop(cpu, %s, 0x%04X);", target, next);
+                emitExit(branch, target, taken, maxCycles[op]);
+                for (std::string& line : branch) code.push_back(op == 0xC3 ? line : "    " + line);
+                if (op == 0xC3) return false;
+                emit(code, "}");
+                break;
+            }
+            case 0xCD:
+            case 0xC4: case 0xCC: case 0xD4: case 0xDC: {
+                snprintf(target, sizeof(target), "0x%04X", nn);
+                if (op != 0xCD) emit(code, "if (%s) {", conditions[cond]);
+                std::vector<std::string> branch;
+                emitPush(branch, next, elapsed);
+                emitExit(branch, target, taken, maxCycles[op]);
+                for (std::string& line : branch) code.push_back(op == 0xCD ? line : "    " + line);
+                if (op == 0xCD) return false;
+                emit(code, "}");
+                break;
+            }
+            case 0xC9:
+            case 0xC0: case 0xC8: case 0xD0: case 0xD8: {
+                if (op != 0xC9) emit(code, "if (%s) {", conditions[cond]);
+                std::vector<std::string> branch;
+                emit(branch, "u16 pc = host.readWord(cpu, r.sp, %u);", elapsed);
+                emit(branch, "r.sp += 2;");
+                emitExit(branch, "pc", taken, maxCycles[op]);
+                for (std::string& line : branch) code.push_back(op == 0xC9 ? line : "    " + line);
+                if (op == 0xC9) return false;
+                emit(code, "}");
+                break;
+            }
+            case 0xE9:
+                emitExit(code, "r.hl", taken, maxCycles[op]);
+                return false;
+            case 0xC1: case 0xD1: case 0xE1: case 0xF1:
+                emit(code, "u16 value = host.readWord(cpu, r.sp, %u);", elapsed);
+                emit(code, "r.sp += 2;");
+                emit(code, "%s = value%s;", stackRegisters[pair], op == 0xF1 ? " & 0xFFF0" : "");
+                break;
+            case 0xC5: case 0xD5: case 0xE5: case 0xF5:
+                emitPush(code, stackRegisters[pair], elapsed);
+                writes = true;
+                break;
+            case 0xE0:
+                emit(code, "bool fast = host.write(cpu, 0xFF%02X, r.a, %s);", n, at(elapsed, 4).c_str());
+                writes = true;
+                break;
+            case 0xF0:
+                emit(code, "r.a = host.read(cpu, 0xFF%02X, %s);", n, at(elapsed, 4).c_str());
+                break;
+            case 0xE2:
+                emit(code, "bool fast = host.write(cpu, 0xFF00 + r.c, r.a, %u);", elapsed);
+                writes = true;
+                break;
+            case 0xF2:
+                emit(code, "r.a = host.read(cpu, 0xFF00 + r.c, %u);", elapsed);
+                break;
+            case 0xEA:
+                emit(code, "bool fast = host.write(cpu, 0x%04X, r.a, %s);", nn, at(elapsed, 8).c_str());
+                writes = true;
+                break;
+            case 0xFA:
+                emit(code, "r.a = host.read(cpu, 0x%04X, %s);", nn, at(elapsed, 8).c_str());
+                break;
+            case 0xE8:
+                emit(code, "u16 result = r.sp + %d;", static_cast<char>(n));
+                emit(code, "r.f = ((result & 0x0F) < (r.sp & 0x0F) ? HALF_CARRY : 0) | ((result & 0xFF) < (r.sp & 0xFF) ? CARRY : 0);");
+                emit(code, "r.sp = result;");
+                break;
+            case 0xF8:
+                emit(code, "u16 result = r.sp + %d;", static_cast<char>(n));
+                emit(code, "int changed = r.sp ^ %d ^ result;", static_cast<char>(n));
+                emit(code, "r.f = ((changed & 0x10) ? HALF_CARRY : 0) | ((changed & 0x100) ? CARRY : 0);");
+                emit(code, "r.hl = result;");
+                break;
+            case 0xF9:
+                emit(code, "r.sp = r.hl;");
+                break;
+            case 0xF3:
+                emit(code, "r.ime = 0;");
+                break;
+            default:
+                Log(W, "No inline code for opcode 0x%02X at 0x%04X\n", op, in.address);
+                break;
+        }
+    }
+
+    // a write to IO or IE can schedule an event or request an interrupt, the rest of the block
+    // is left to the interpreter
+    if (writes) {
+        emit(code, "if (!fast) {");
+        snprintf(target, sizeof(target), "0x%04X", next);
+        std::vector<std::string> exit;
+        emitExit(exit, target, ticks, ticks - elapsed);
+        for (std::string& line : exit) code.push_back("    " + line);
+        emit(code, "}");
+    }
+    return true;
+}
+
+// instructions that change IME or halt the CPU run through their step outside of the inline path
+static bool needsStep(u8 opcode) {
+    return opcode == 0x10 || opcode == 0x76 || opcode == 0xD9 || opcode == 0xFB;
+}
+
+void Recompiler::writeBlock(FILE* file, u16 address, const Block& block) {
+    const std::vector<Instruction>& instructions = block.instructions;
+    u32 cycles = 0;
+    for (const Instruction& in : instructions) cycles += in.isCB ? maxCyclesCB(in.opcode) : maxCycles[in.opcode];
+
+    fprintf(file, "\n// 0x%04X - 0x%04X\n", address, block.end - 1);
+    fprintf(file, "template<bool timing> static void block_%04X(CPU* cpu, const RecompHost& host) {\n", address);
+    fprintf(file, "    static const u8 operands[][2] = {\n");
+    for (const Instruction& in : instructions) {
+        fprintf(file, "        {0x%02X, 0x%02X},\n", in.operands[0], in.operands[1]);
+    }
+    fprintf(file, "    };\n");
+
+    // an event or an interrupt can come up before the block ends, every step finishes on its own
+    fprintf(file, "    if (!host.enter(cpu, %u)) {\n", cycles);
+    for (size_t i=0; i<instructions.size(); i++) {
+        const Instruction& in = instructions[i];
+        u16 next = i + 1 < instructions.size() ? instructions[i + 1].address : block.end;
+        const char* table = in.isCB ? "host.stepsCB" : "host.steps";
+        fprintf(file, "        if (!%s[0x%02X](cpu, operands[%zu], 0x%04X)) return;\n", table, in.opcode, i, next);
+    }
+    fprintf(file, "        return;\n");
+    fprintf(file, "    }\n\n");
+
+    fprintf(file, "    Registers& r = cpu->r;\n");
+    u32 elapsed = 0;
+    u32 last = 0;
+    for (size_t i=0; i<instructions.size(); i++) {
+        const Instruction& in = instructions[i];
+        u16 next = i + 1 < instructions.size() ? instructions[i + 1].address : block.end;
+        fprintf(file, "    // 0x%04X: %s%02X\n", in.address, in.isCB ? "CB " : "", in.opcode);
+        if (!in.isCB && needsStep(in.opcode)) {
+            fprintf(file, "    r.pc = 0x%04X;\n", in.address);
+            if (elapsed) fprintf(file, "    host.leave(cpu, %u, %u);\n", elapsed, last);
+            fprintf(file, "    host.steps[0x%02X](cpu, operands[%zu], 0x%04X);\n", in.opcode, i, next);
+            fprintf(file, "}\n");
+            return;
+        }
+
+        std::vector<std::string> code;
+        bool fallsThrough = writeInstruction(code, in, next, elapsed);
+        if (code.size() == 1) {
+            fprintf(file, "    %s\n", code[0].c_str());
+        } else if (!code.empty()) {
+            fprintf(file, "    {\n");
+            for (std::string& line : code) fprintf(file, "        %s\n", line.c_str());
+            fprintf(file, "    }\n");
+        }
+        if (!fallsThrough) {
+            fprintf(file, "}\n");
+            return;
+        }
+        last = fallThroughCycles(in.opcode, in.isCB);
+        elapsed += last;
+    }
+    // cut at the maximum length or the end of the bank
+    fprintf(file, "    r.pc = 0x%04X;\n", block.end);
+    fprintf(file, "    host.leave(cpu, %u, %u);\n", elapsed, last);
+    fprintf(file, "}\n");
+}
+
+bool Recompiler::writeBank(std::string& outputPath, int bank) {
+    char fileName[16];
+    snprintf(fileName, sizeof(fileName), "/Bank%02d.cpp", bank);
+    std::string path = outputPath + fileName;
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        Log(W, "Failed to create file %s\n", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "// generated by phos-recomp from %s, do not edit\n", romName.c_str());
+    fprintf(file, "#include \"CPU.hpp\"\n");
+
+    std::vector<u16> entries;
+    for (auto& [address, block] : blocks) {
+        if (address / ROM_BANK_SIZE != (u32) bank) continue;
+        entries.push_back(address);
+        writeBlock(file, address, block);
+    }
+
+    fprintf(file, "\n");
+    if (entries.empty()) {
+        fprintf(file, "extern const RecompEntry* const bank%02dBlocks = nullptr;\n", bank);
+    } else {
+        fprintf(file, "static const RecompEntry entries[] = {\n");
+        for (u16 address : entries) {
+            fprintf(file, "    {0x%04X, {block_%04X<false>, block_%04X<true>}},\n", address, address, address);
+        }
+        fprintf(file, "};\n");
+        fprintf(file, "extern const RecompEntry* const bank%02dBlocks = entries;\n", bank);
+    }
+    fprintf(file, "extern const u32 bank%02dBlockCount = %zu;\n", bank, entries.size());
+
+    fclose(file);
+    return true;
+}
+
+bool Recompiler::writePlugin(std::string& outputPath) {
+    std::string path = outputPath + "/Plugin.cpp";
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        Log(W, "Failed to create file %s\n", path.c_str());
+        return false;
+    }
+
+    u32 checksum = recompChecksum(rom.data(), end);
+
+    fprintf(file, "// generated by phos-recomp from %s, do not edit\n", romName.c_str());
+    fprintf(file, "#include \"Recomp.hpp\"\n\n");
+    for (int bank=0; bank<2; bank++) {
+        fprintf(file, "extern const RecompEntry* const bank%02dBlocks;\n", bank);
+        fprintf(file, "extern const u32 bank%02dBlockCount;\n", bank);
+    }
+    fprintf(file, "\nextern \"C\" const RecompPlugin* " RECOMP_PLUGIN_SYMBOL "() {\n");
+    fprintf(file, "    static std::vector<RecompEntry> blocks;\n");
+    fprintf(file, "    static RecompPlugin plugin {};\n");
+    fprintf(file, "    if (blocks.empty()) {\n");
+    for (int bank=0; bank<2; bank++) {
+        fprintf(file, "        if (bank%02dBlocks) blocks.insert(blocks.end(), bank%02dBlocks, bank%02dBlocks + bank%02dBlockCount);\n",
+                bank, bank, bank, bank);
+    }
+    fprintf(file, "        plugin = {RECOMP_VERSION, 0x%08X, 0x%04X, (u32) blocks.size(), blocks.data()};\n", checksum, end);
+    fprintf(file, "    }\n");
+    fprintf(file, "    return &plugin;\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef PHOS_RECOMPILER_HPP
+#define PHOS_RECOMPILER_HPP
+
+#include <map>
+
+#include "Common.hpp"
+
+// traces the fixed ROM banks of a cartridge and writes one C++ function per basic block
+class Recompiler {
+public:
+    Recompiler();
+    bool load(std::string& romPath);
+    void trace();
+    bool write(std::string& outputPath);
+private:
+    struct Instruction {
+        u16 address;
+        u8 opcode;
+        bool isCB;
+        u8 length;
+        u8 operands[2];
+    };
+    struct Block {
+        u16 end;
+        std::vector<Instruction> instructions;
+    };
+private:
+    bool decodeBlock(u16 address, Block& block);
+    void addTarget(u32 address);
+    void writeBlock(FILE* file, u16 address, const Block& block);
+    bool writeInstruction(std::vector<std::string>& code, const Instruction& in, u16 next, u32 elapsed);
+    bool writeBank(std::string& outputPath, int bank);
+    bool writePlugin(std::string& outputPath);
+private:
+    std::string romName;
+    std::vector<u8> rom;
+    // end of the recompiled range, 0x4000 with MBC and 0x8000 for cartridges without one
+    u32 end;
+    std::map<u16, Block> blocks;
+    std::vector<u16> targets;
+};
+
+#endif //PHOS_RECOMPILER_HPP